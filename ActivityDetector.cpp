@@ -0,0 +1,197 @@
+#include "ActivityDetector.h"
+#include <cmath>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define ACTIVITY_NEON
+#elif defined(__AVX__)
+#include <immintrin.h>
+#define ACTIVITY_AVX
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define ACTIVITY_SSE
+#endif
+
+static constexpr float Pi = 3.14159265358979f;
+static constexpr float LowCutHz = 0.5f;
+static constexpr float HighCutHz = 3.0f;
+
+// out[i] = |(x, y, z)[i]| * scale
+static void magnitudeBlock(const float *x, const float *y, const float *z, float *out, int n, float scale) {
+  int i = 0;
+#if defined(ACTIVITY_NEON)
+  const float32x4_t s = vdupq_n_f32(scale);
+  for (; i + 4 <= n; i += 4) {
+    const float32x4_t vx = vld1q_f32(x + i), vy = vld1q_f32(y + i), vz = vld1q_f32(z + i);
+    float32x4_t sq = vmlaq_f32(vmlaq_f32(vmulq_f32(vx, vx), vy, vy), vz, vz);
+    // sqrt(v) = v * rsqrt(v), refined by one Newton step; zero stays zero.
+    float32x4_t r = vrsqrteq_f32(vmaxq_f32(sq, vdupq_n_f32(1e-12f)));
+    r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(sq, r), r));
+    vst1q_f32(out + i, vmulq_f32(vmulq_f32(sq, r), s));
+  }
+#elif defined(ACTIVITY_AVX)
+  const __m256 s = _mm256_set1_ps(scale);
+  for (; i + 8 <= n; i += 8) {
+    const __m256 vx = _mm256_loadu_ps(x + i), vy = _mm256_loadu_ps(y + i), vz = _mm256_loadu_ps(z + i);
+    const __m256 sq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy)), _mm256_mul_ps(vz, vz));
+    _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_sqrt_ps(sq), s));
+  }
+#elif defined(ACTIVITY_SSE)
+  const __m128 s = _mm_set1_ps(scale);
+  for (; i + 4 <= n; i += 4) {
+    const __m128 vx = _mm_loadu_ps(x + i), vy = _mm_loadu_ps(y + i), vz = _mm_loadu_ps(z + i);
+    const __m128 sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+    _mm_storeu_ps(out + i, _mm_mul_ps(_mm_sqrt_ps(sq), s));
+  }
+#endif
+  for (; i < n; ++i)
+    out[i] = std::sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]) * scale;
+}
+
+// out[i] = sum_k taps[k] * in[i + k], vectorized over i.
+static void firBlock(const float *in, const float *taps, float *out, int n) {
+  int i = 0;
+#if defined(ACTIVITY_NEON)
+  for (; i + 4 <= n; i += 4) {
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (int k = 0; k < ActivityDetector::Taps; ++k)
+      acc = vmlaq_n_f32(acc, vld1q_f32(in + i + k), taps[k]);
+    vst1q_f32(out + i, acc);
+  }
+#elif defined(ACTIVITY_AVX)
+  for (; i + 8 <= n; i += 8) {
+    __m256 acc = _mm256_setzero_ps();
+    for (int k = 0; k < ActivityDetector::Taps; ++k)
+      acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(in + i + k), _mm256_set1_ps(taps[k])));
+    _mm256_storeu_ps(out + i, acc);
+  }
+#elif defined(ACTIVITY_SSE)
+  for (; i + 4 <= n; i += 4) {
+    __m128 acc = _mm_setzero_ps();
+    for (int k = 0; k < ActivityDetector::Taps; ++k)
+      acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(in + i + k), _mm_set1_ps(taps[k])));
+    _mm_storeu_ps(out + i, acc);
+  }
+#endif
+  for (; i < n; ++i) {
+    float acc = 0.0f;
+    for (int k = 0; k < ActivityDetector::Taps; ++k)
+      acc += in[i + k] * taps[k];
+    out[i] = acc;
+  }
+}
+
+ActivityDetector::ActivityDetector(float sampleRate, float countsPerG) : m_sampleRate(sampleRate), m_invCountsPerG(1.0f / countsPerG) {
+  // Hamming-windowed sinc band-pass around walking and running step frequencies.
+  const float f1 = LowCutHz / sampleRate, f2 = HighCutHz / sampleRate;
+  const int mid = Taps / 2;
+  float sum = 0.0f;
+  for (int k = 0; k < Taps; ++k) {
+    const int m = k - mid;
+    const float ideal = m == 0 ? 2.0f * (f2 - f1) : (std::sin(2.0f * Pi * f2 * m) - std::sin(2.0f * Pi * f1 * m)) / (Pi * m);
+    m_taps[k] = ideal * (0.54f - 0.46f * std::cos(2.0f * Pi * k / (Taps - 1)));
+    sum += m_taps[k];
+  }
+  // The short window leaks some DC; remove it so gravity never reads as motion.
+  for (float &t : m_taps)
+    t -= sum / Taps;
+  // Start from 1 g at rest, so the first block does not look like a huge step.
+  for (float &h : m_history)
+    h = 1.0f;
+}
+
+void ActivityDetector::process(const int16_t *xyz, int count) {
+  while (count > 0) {
+    const int n = count < BlockSize ? count : BlockSize;
+    processBlock(xyz, n);
+    xyz += 3 * n;
+    count -= n;
+  }
+}
+
+void ActivityDetector::processBlock(const int16_t *xyz, int n) {
+  for (int i = 0; i < n; ++i) {
+    m_x[i] = xyz[3 * i];
+    m_y[i] = xyz[3 * i + 1];
+    m_z[i] = xyz[3 * i + 2];
+  }
+  float *block = m_history + Taps - 1;
+  magnitudeBlock(m_x, m_y, m_z, block, n, m_invCountsPerG);
+  firBlock(m_history, m_taps, m_filtered, n);
+
+  // Two-second moving statistics of the magnitude, for classification.
+  const float alpha = 1.0f / (2.0f * m_sampleRate);
+  for (int i = 0; i < n; ++i) {
+    const float d = block[i] - m_mean;
+    m_mean += alpha * d;
+    m_variance += alpha * (d * d - m_variance);
+  }
+  detectPeaks(n);
+
+  for (int i = 0; i < Taps - 1; ++i)
+    m_history[i] = m_history[n + i];
+}
+
+void ActivityDetector::detectPeaks(int n) {
+  const uint64_t minDistance = static_cast<uint64_t>(0.25f * m_sampleRate);
+  const float envelopeAlpha = 1.0f / (2.0f * m_sampleRate);
+  for (int i = 0; i < n; ++i) {
+    const float y = m_filtered[i];
+    m_envelope += envelopeAlpha * (std::fabs(y) - m_envelope);
+    // A step is a local maximum clearly above the recent signal level.
+    const float threshold = m_envelope > 0.1f ? m_envelope : 0.1f;
+    if (m_prev1 > m_prev2 && m_prev1 >= y && m_prev1 > threshold && m_sample - m_lastStep >= minDistance) {
+      m_lastStep = m_sample;
+      m_stepSamples[m_steps % StepHistory] = m_sample;
+      m_steps++;
+    }
+    m_prev2 = m_prev1;
+    m_prev1 = y;
+    m_sample++;
+  }
+}
+
+float ActivityDetector::cadence() const {
+  if (m_steps < 2 || m_sample - m_lastStep > static_cast<uint64_t>(2.0f * m_sampleRate))
+    return 0.0f;
+  const int count = m_steps < StepHistory ? static_cast<int>(m_steps) : StepHistory;
+  const uint64_t first = m_stepSamples[(m_steps - count) % StepHistory];
+  return 60.0f * m_sampleRate * (count - 1) / static_cast<float>(m_lastStep - first);
+}
+
+ActivityDetector::Activity ActivityDetector::activity() const {
+  const float deviation = std::sqrt(m_variance);
+  const float spm = cadence();
+  if (spm == 0.0f)
+    return deviation < 0.05f ? Still : Active;
+  if (spm >= 140.0f || deviation > 0.6f)
+    return Running;
+  if (spm >= 60.0f)
+    return Walking;
+  return Active;
+}
+
+const char *ActivityDetector::activityName(Activity activity) {
+  switch (activity) {
+  case Still:
+    return "still";
+  case Walking:
+    return "walking";
+  case Running:
+    return "running";
+  default:
+    return "active";
+  }
+}
+
+const char *ActivityDetector::simdPath() {
+#if defined(ACTIVITY_NEON)
+  return "NEON";
+#elif defined(ACTIVITY_AVX)
+  return "AVX";
+#elif defined(ACTIVITY_SSE)
+  return "SSE";
+#else
+  return "scalar";
+#endif
+}
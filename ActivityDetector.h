@@ -0,0 +1,48 @@
+#pragma once
+// Step detection and activity classification on raw 3-axis accelerometer samples.
+// Plain C++ so it can be benchmarked without Qt. Samples are processed in blocks;
+// magnitude and band-pass kernels use NEON, AVX or SSE when the build targets them.
+#include <cstdint>
+
+class ActivityDetector {
+public:
+  enum Activity { Still, Walking, Running, Active };
+
+  ActivityDetector(float sampleRate = 25.0f, float countsPerG = 4096.0f);
+
+  // Interleaved x, y, z samples in raw sensor counts.
+  void process(const int16_t *xyz, int count);
+
+  uint64_t steps() const { return m_steps; }
+  // Steps per minute from the most recent steps, 0 when none in the last two seconds.
+  float cadence() const;
+  Activity activity() const;
+  static const char *activityName(Activity activity);
+  // Which kernel set this build uses.
+  static const char *simdPath();
+
+  static constexpr int BlockSize = 64;
+  static constexpr int Taps = 49;
+
+private:
+  void processBlock(const int16_t *xyz, int n);
+  void detectPeaks(int n);
+
+  float m_sampleRate;
+  float m_invCountsPerG;
+  alignas(32) float m_taps[Taps];
+  // The last Taps - 1 magnitudes of the previous block followed by the current block.
+  alignas(32) float m_history[Taps - 1 + BlockSize]{};
+  alignas(32) float m_x[BlockSize], m_y[BlockSize], m_z[BlockSize];
+  alignas(32) float m_filtered[BlockSize];
+
+  uint64_t m_sample{};
+  uint64_t m_steps{};
+  float m_prev1{}, m_prev2{};
+  float m_envelope{};
+  uint64_t m_lastStep{};
+  static constexpr int StepHistory = 8;
+  uint64_t m_stepSamples[StepHistory]{};
+  float m_mean{1.0f};
+  float m_variance{};
+};
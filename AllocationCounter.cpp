@@ -0,0 +1,54 @@
+#include "AllocationCounter.h"
+#include <cerrno>
+#include <cstddef>
+
+// glibc's allocator under its internal names, so the definitions below can interpose
+// malloc and friends for the whole process, Qt and libstdc++ included.
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *p, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+}
+
+// Per thread, so D-Bus and worker threads do not show up in the replay thread's count.
+// Executable TLS is reached without allocating.
+static thread_local quint64 allocations = 0;
+
+quint64 AllocationCounter::count() { return allocations; }
+
+extern "C" {
+
+void *malloc(size_t size) {
+  allocations++;
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+  allocations++;
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *p, size_t size) {
+  allocations++;
+  return __libc_realloc(p, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+  allocations++;
+  return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) { return memalign(alignment, size); }
+
+int posix_memalign(void **p, size_t alignment, size_t size) {
+  if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+    return EINVAL;
+  void *block = memalign(alignment, size);
+  if (!block)
+    return ENOMEM;
+  *p = block;
+  return 0;
+}
+
+} // extern "C"
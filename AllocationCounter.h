@@ -0,0 +1,11 @@
+#pragma once
+#include <QtGlobal>
+
+// Counts heap allocations (malloc, calloc, realloc and the aligned variants, which
+// operator new and QArrayData both end up in) made by the calling thread. The
+// replacement functions are only linked into builds configured with
+// MIBAND3_ALLOCATION_CHECK, and forward to glibc's own allocator.
+class AllocationCounter {
+public:
+  static quint64 count();
+};
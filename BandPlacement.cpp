@@ -0,0 +1,141 @@
+#include "BandPlacement.h"
+#include <QDebug>
+
+BandPlacement::BandPlacement(QObject *parent) : QObject(parent) {}
+
+void BandPlacement::addAdapter(const QString &address, int maxLinks) {
+  QMutexLocker lock(&m_mutex);
+  const int i = indexOf(address);
+  if (i >= 0) {
+    m_adapters[i].maxLinks = maxLinks;
+    m_adapters[i].up = true;
+    return;
+  }
+  m_adapters.append(Adapter{address, maxLinks, 0, true});
+  qDebug() << "Adapter" << address << "available for" << maxLinks << "bands";
+}
+
+QStringList BandPlacement::adapters() const {
+  QMutexLocker lock(&m_mutex);
+  QStringList list;
+  for (const Adapter &a : m_adapters)
+    list.append(a.address);
+  return list;
+}
+
+int BandPlacement::load(const QString &adapter) const {
+  QMutexLocker lock(&m_mutex);
+  const int i = indexOf(adapter);
+  return i >= 0 ? m_adapters[i].load : 0;
+}
+
+QString BandPlacement::acquire(QObject *session) {
+  QMutexLocker lock(&m_mutex);
+  return acquireLocked(session);
+}
+
+QString BandPlacement::acquireLocked(QObject *session) {
+  const int current = indexOf(m_sessions.value(session));
+  if (current >= 0 && m_adapters[current].up)
+    return m_adapters[current].address;
+  releaseLocked(session);
+
+  int best = -1;
+  for (int i = 0; i < m_adapters.size(); ++i) {
+    const Adapter &a = m_adapters[i];
+    if (!a.up || a.load >= a.maxLinks)
+      continue;
+    // Compare relative load, so adapters with more link slots get proportionally more bands.
+    if (best < 0 || a.load * m_adapters[best].maxLinks < m_adapters[best].load * a.maxLinks)
+      best = i;
+  }
+  if (best < 0)
+    return QString();
+  m_adapters[best].load++;
+  m_sessions.insert(session, m_adapters[best].address);
+  if (!m_known.contains(session)) {
+    m_known.insert(session);
+    connect(session, &QObject::destroyed, this, [this, session]() {
+      QMutexLocker lock(&m_mutex);
+      releaseLocked(session);
+      releaseDeviceLocked(session);
+      m_known.remove(session);
+    });
+  }
+  return m_adapters[best].address;
+}
+
+void BandPlacement::release(QObject *session) {
+  QMutexLocker lock(&m_mutex);
+  releaseLocked(session);
+}
+
+void BandPlacement::releaseLocked(QObject *session) {
+  auto it = m_sessions.find(session);
+  if (it == m_sessions.end())
+    return;
+  const int i = indexOf(it.value());
+  if (i >= 0)
+    m_adapters[i].load--;
+  m_sessions.erase(it);
+}
+
+bool BandPlacement::claimDevice(QObject *session, const QString &device) {
+  QMutexLocker lock(&m_mutex);
+  QObject *owner = m_devices.value(device);
+  if (owner == session)
+    return true;
+  if (owner)
+    return false;
+  releaseDeviceLocked(session);
+  m_devices.insert(device, session);
+  return true;
+}
+
+void BandPlacement::releaseDevice(QObject *session) {
+  QMutexLocker lock(&m_mutex);
+  releaseDeviceLocked(session);
+}
+
+void BandPlacement::releaseDeviceLocked(QObject *session) {
+  for (auto it = m_devices.begin(); it != m_devices.end();) {
+    if (it.value() == session)
+      it = m_devices.erase(it);
+    else
+      ++it;
+  }
+}
+
+void BandPlacement::setAdapterUp(const QString &address, bool up) {
+  QMutexLocker lock(&m_mutex);
+  const int i = indexOf(address);
+  if (i < 0 || m_adapters[i].up == up)
+    return;
+  m_adapters[i].up = up;
+  if (up) {
+    qDebug() << "Adapter" << address << "is back.";
+    return;
+  }
+
+  qWarning() << "Adapter" << address << "went down, moving its" << m_adapters[i].load << "bands";
+  QList<QObject *> moved;
+  for (auto it = m_sessions.cbegin(); it != m_sessions.cend(); ++it) {
+    if (it.value() == address)
+      moved.append(it.key());
+  }
+  QStringList targets;
+  for (QObject *session : moved)
+    targets.append(acquireLocked(session));
+  // Sessions handling the move call back in, so they are told after unlocking.
+  lock.unlock();
+  for (int s = 0; s < moved.size(); ++s)
+    emit sessionMoved(moved[s], targets[s]);
+}
+
+int BandPlacement::indexOf(const QString &address) const {
+  for (int i = 0; i < m_adapters.size(); ++i) {
+    if (m_adapters[i].address == address)
+      return i;
+  }
+  return -1;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QVector>
+
+// Decides which local adapter each band session uses and which remote band it owns.
+// Adapters and bands are plain address strings, so the policy runs without a radio.
+// Sessions may call in from their own threads.
+class BandPlacement : public QObject {
+  Q_OBJECT
+public:
+  BandPlacement(QObject *parent = nullptr);
+
+  void addAdapter(const QString &address, int maxLinks);
+  QStringList adapters() const;
+  int load(const QString &adapter) const;
+
+  // Keeps the session on its adapter while that is up, otherwise moves it to the
+  // least-loaded adapter with a free link. Returns an empty string if none is left.
+  QString acquire(QObject *session);
+  void release(QObject *session);
+  QString adapterOf(QObject *session) const {
+    QMutexLocker lock(&m_mutex);
+    return m_sessions.value(session);
+  }
+
+  // A band is owned by at most one session; claiming another band drops the previous claim.
+  bool claimDevice(QObject *session, const QString &device);
+  void releaseDevice(QObject *session);
+
+public slots:
+  void setAdapterUp(const QString &address, bool up);
+
+signals:
+  // The adapter of the session went down; adapter is its new one or empty if none is free.
+  void sessionMoved(QObject *session, const QString &adapter);
+
+private:
+  struct Adapter {
+    QString address;
+    int maxLinks;
+    int load;
+    bool up;
+  };
+  int indexOf(const QString &address) const;
+  // The *Locked helpers expect m_mutex to be held.
+  QString acquireLocked(QObject *session);
+  void releaseLocked(QObject *session);
+  void releaseDeviceLocked(QObject *session);
+
+  QVector<Adapter> m_adapters;
+  QHash<QObject *, QString> m_sessions;
+  QHash<QString, QObject *> m_devices;
+  QSet<QObject *> m_known;
+  mutable QMutex m_mutex;
+};
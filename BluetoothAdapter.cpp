@@ -0,0 +1,73 @@
+#include "BluetoothAdapter.h"
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusReply>
+#include <QDBusVariant>
+#include <QDebug>
+#include <QDir>
+
+BluetoothAdapter::BluetoothAdapter(const QString &name, QObject *parent) : QObject(parent), m_name(name), m_path("/org/bluez/" + name) {
+  QDBusConnection::systemBus().connect("org.bluez", m_path, "org.freedesktop.DBus.Properties", "PropertiesChanged", this,
+                                       SLOT(propertiesChanged(QString, QVariantMap, QStringList)));
+}
+
+QStringList BluetoothAdapter::adapterNames() {
+  QStringList names;
+  // Connections show up here as "hci0:64", only the adapters themselves are wanted.
+  for (const QString &entry : QDir("/sys/class/bluetooth").entryList({"hci*"}, QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name)) {
+    if (!entry.contains(':'))
+      names.append(entry);
+  }
+  if (names.isEmpty())
+    names.append("hci0");
+  return names;
+}
+
+void BluetoothAdapter::powerCycle() {
+  qDebug() << "Power cycling adapter" << m_name << "...";
+  connect(setPowered(false), &QDBusPendingCallWatcher::finished, this, &BluetoothAdapter::poweredOff);
+}
+
+void BluetoothAdapter::poweredOff(QDBusPendingCallWatcher *watcher) {
+  watcher->deleteLater();
+  if (watcher->isError())
+    qWarning() << "Could not power off adapter" << m_name << ':' << watcher->error().message();
+  connect(setPowered(true), &QDBusPendingCallWatcher::finished, this, &BluetoothAdapter::poweredOn);
+}
+
+void BluetoothAdapter::poweredOn(QDBusPendingCallWatcher *watcher) {
+  watcher->deleteLater();
+  if (watcher->isError())
+    qCritical() << "Could not power on adapter" << m_name << ':' << watcher->error().message();
+  else
+    qDebug() << "Adapter" << m_name << "powered on.";
+
+  QDBusMessage msg = QDBusMessage::createMethodCall("org.bluez", m_path, "org.freedesktop.DBus.Properties", "Get");
+  msg << QStringLiteral("org.bluez.Adapter1") << QStringLiteral("Address");
+  auto addressWatcher = new QDBusPendingCallWatcher(QDBusConnection::systemBus().asyncCall(msg), this);
+  connect(addressWatcher, &QDBusPendingCallWatcher::finished, this, &BluetoothAdapter::addressReceived);
+}
+
+void BluetoothAdapter::addressReceived(QDBusPendingCallWatcher *watcher) {
+  watcher->deleteLater();
+  QDBusReply<QVariant> reply = *watcher;
+  if (reply.isValid())
+    m_address = reply.value().toString();
+  else
+    qWarning() << "Could not read address of adapter" << m_name << ':' << reply.error().message();
+  emit ready();
+}
+
+void BluetoothAdapter::propertiesChanged(const QString &interface, const QVariantMap &changed, const QStringList &) {
+  if (interface != "org.bluez.Adapter1" || !changed.contains("Powered") || m_address.isEmpty())
+    return;
+  const bool powered = changed.value("Powered").toBool();
+  qDebug() << "Adapter" << m_name << (powered ? "powered on." : "powered off.");
+  emit poweredChanged(m_address, powered);
+}
+
+QDBusPendingCallWatcher *BluetoothAdapter::setPowered(bool powered) {
+  QDBusMessage msg = QDBusMessage::createMethodCall("org.bluez", m_path, "org.freedesktop.DBus.Properties", "Set");
+  msg << QStringLiteral("org.bluez.Adapter1") << QStringLiteral("Powered") << QVariant::fromValue(QDBusVariant(powered));
+  return new QDBusPendingCallWatcher(QDBusConnection::systemBus().asyncCall(msg), this);
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <QDBusPendingCallWatcher>
+#include <QObject>
+#include <QVariantMap>
+
+// Power-cycles a local BlueZ adapter over D-Bus without blocking the event loop
+// and reports when it gets powered off or on afterwards.
+class BluetoothAdapter : public QObject {
+  Q_OBJECT
+public:
+  BluetoothAdapter(const QString &name = "hci0", QObject *parent = nullptr);
+  QString name() const { return m_name; }
+  // Bluetooth address as reported by BlueZ, known once ready() was emitted.
+  QString address() const { return m_address; }
+  // Local adapters known to the kernel, hci0 if none are found.
+  static QStringList adapterNames();
+
+public slots:
+  void powerCycle();
+
+signals:
+  // Emitted once the adapter is powered on, or when bring-up failed and scanning should be tried anyway.
+  void ready();
+  void poweredChanged(const QString &address, bool powered);
+
+private slots:
+  void poweredOff(QDBusPendingCallWatcher *watcher);
+  void poweredOn(QDBusPendingCallWatcher *watcher);
+  void addressReceived(QDBusPendingCallWatcher *watcher);
+  void propertiesChanged(const QString &interface, const QVariantMap &changed, const QStringList &invalidated);
+
+private:
+  QDBusPendingCallWatcher *setPowered(bool powered);
+
+  QString m_name;
+  QString m_path;
+  QString m_address;
+};
@@ -0,0 +1,94 @@
+#include "CommandChannel.h"
+#include "Crc16.h"
+#include <QDateTime>
+#include <QDebug>
+#include <cstring>
+
+CommandChannel::CommandChannel(QObject *parent) : QObject(parent), m_expiryTimer(this) {
+  setHandler(Ping, [this](quint8 id, const QByteArray &) { respond(id, Ok); });
+  connect(&m_expiryTimer, &QTimer::timeout, this, &CommandChannel::expireRequests);
+}
+
+void CommandChannel::seal(uchar *frame) {
+  const quint16 crc = crc16(frame, FrameSize - 2);
+  frame[FrameSize - 2] = crc >> 8;
+  frame[FrameSize - 1] = crc & 0xff;
+}
+
+void CommandChannel::respond(quint8 id, Status status, const QByteArray &payload) {
+  if (!m_inFlight.contains(id)) {
+    qWarning() << "ESP32 command" << id << "answered twice or never asked";
+    return;
+  }
+  qDebug() << "ESP32 command" << id << "done with status" << status << "after" << QDateTime::currentMSecsSinceEpoch() - m_inFlight.take(id) << "ms";
+
+  Frame f{};
+  f.data[0] = FrameMarker;
+  f.data[1] = Response;
+  f.data[2] = id;
+  f.data[3] = status;
+  const int len = qMin(payload.size(), MaxPayload);
+  f.data[4] = static_cast<uchar>(len);
+  memcpy(f.data + 5, payload.constData(), len);
+  m_outgoing.enqueue(f);
+  emit outgoingReady();
+}
+
+void CommandChannel::takeOutgoing(uchar *frame) {
+  if (m_outgoing.isEmpty()) {
+    memset(frame, 0, FrameSize);
+    frame[0] = FrameMarker;
+    frame[1] = Poll;
+  } else {
+    memcpy(frame, m_outgoing.dequeue().data, FrameSize);
+  }
+  if (!m_outgoing.isEmpty())
+    frame[1] |= 0x80;
+  seal(frame);
+}
+
+bool CommandChannel::handleIncoming(const uchar *frame) {
+  if (frame[0] != FrameMarker || (frame[FrameSize - 2] << 8 | frame[FrameSize - 1]) != crc16(frame, FrameSize - 2) || frame[4] > MaxPayload)
+    return false;
+  m_peerHasMore = frame[1] & 0x80;
+  const uchar type = frame[1] & 0x7f;
+  if (type != Request)
+    return true;
+
+  const quint8 id = frame[2];
+  const uchar command = frame[3];
+  const qint64 now = QDateTime::currentMSecsSinceEpoch();
+  if (m_inFlight.contains(id)) {
+    if (now - m_inFlight.value(id) < m_requestTimeout) {
+      qWarning() << "ESP32 reused request id" << id << "while it is in flight";
+      return true;
+    }
+    expireRequests();
+  }
+  m_inFlight.insert(id, now);
+  if (!m_expiryTimer.isActive())
+    m_expiryTimer.start(qMax(100, m_requestTimeout / 4));
+  auto it = m_handlers.constFind(command);
+  if (it == m_handlers.constEnd()) {
+    respond(id, UnknownCommand);
+    return true;
+  }
+  it.value()(id, QByteArray(reinterpret_cast<const char *>(frame + 5), frame[4]));
+  return true;
+}
+
+void CommandChannel::expireRequests() {
+  const qint64 now = QDateTime::currentMSecsSinceEpoch();
+  QList<quint8> expired;
+  for (auto it = m_inFlight.cbegin(); it != m_inFlight.cend(); ++it) {
+    if (now - it.value() >= m_requestTimeout)
+      expired.append(it.key());
+  }
+  for (quint8 id : expired) {
+    qWarning() << "ESP32 command" << id << "got no answer within" << m_requestTimeout << "ms";
+    respond(id, Failed);
+    emit requestExpired(id);
+  }
+  if (m_inFlight.isEmpty())
+    m_expiryTimer.stop();
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+#include <QQueue>
+#include <QTimer>
+#include <functional>
+
+// Request/response messages with the ESP32, carried in the 32-byte SPI transfers.
+//
+// Frame: uint8 0xC3 marker, uint8 type (bit 7: sender has more frames queued),
+//        uint8 request id, uint8 command (requests) or status (responses),
+//        uint8 payload length (max 25), payload, CRC-16/CCITT (big endian) over bytes 0..29.
+//
+// The ESP32 may have several requests in flight; each is answered with its id whenever
+// its handler finishes, so responses can come back in any order. A request its handler
+// leaves unanswered past the request timeout is answered with Failed, so the id can be reused.
+class CommandChannel : public QObject {
+  Q_OBJECT
+public:
+  static constexpr int FrameSize = 32;
+  static constexpr int MaxPayload = 25;
+  static constexpr uchar FrameMarker = 0xc3;
+  enum FrameType : uchar { Poll = 0, Request = 1, Response = 2 };
+  enum Command : uchar { Ping = 1, GetLatest = 2, SetMeasureInterval = 3, Vibrate = 4 };
+  enum Status : uchar { Ok = 0, UnknownCommand = 1, BadRequest = 2, Failed = 3 };
+
+  // Called with the request id and payload; must eventually call respond() with that id.
+  using Handler = std::function<void(quint8 id, const QByteArray &payload)>;
+
+  CommandChannel(QObject *parent = nullptr);
+
+  void setHandler(Command command, Handler handler) { m_handlers.insert(command, handler); }
+  void setRequestTimeout(int ms) { m_requestTimeout = ms; }
+  void respond(quint8 id, Status status, const QByteArray &payload = QByteArray());
+
+  // For ESP32SPI: fills the next frame to send, a poll frame if nothing is queued.
+  void takeOutgoing(uchar *frame);
+  bool hasOutgoing() const { return !m_outgoing.isEmpty(); }
+  // For ESP32SPI: returns false if the frame is garbled.
+  bool handleIncoming(const uchar *frame);
+  bool peerHasMore() const { return m_peerHasMore; }
+  int inFlight() const { return m_inFlight.size(); }
+
+signals:
+  // A response was queued, the SPI side should clock it out.
+  void outgoingReady();
+  // The request was answered with Failed after the timeout; a late respond() is dropped.
+  void requestExpired(quint8 id);
+
+private slots:
+  void expireRequests();
+
+private:
+  struct Frame {
+    uchar data[FrameSize];
+  };
+  static void seal(uchar *frame);
+
+  QHash<uchar, Handler> m_handlers;
+  QQueue<Frame> m_outgoing;
+  QHash<quint8, qint64> m_inFlight; // request id -> receive time, for latency and expiry
+  int m_requestTimeout{10000};
+  QTimer m_expiryTimer;
+  bool m_peerHasMore = false;
+};
@@ -0,0 +1,13 @@
+#pragma once
+#include <QtGlobal>
+
+// CRC-16/CCITT-FALSE, used by the SPI probe and command frames.
+inline quint16 crc16(const uchar *data, int len) {
+  quint16 crc = 0xffff;
+  for (int i = 0; i < len; ++i) {
+    crc ^= static_cast<quint16>(data[i]) << 8;
+    for (int b = 0; b < 8; ++b)
+      crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
@@ -0,0 +1,91 @@
+#include "DataReadyLine.h"
+#include <QDebug>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+static qint64 clockNs(clockid_t clock) {
+  timespec ts;
+  clock_gettime(clock, &ts);
+  return static_cast<qint64>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+DataReadyLine::DataReadyLine(const QString &chip, int line, QObject *parent) : QObject(parent) {
+  const QByteArray path = "/dev/" + chip.toLocal8Bit();
+  const int chipFd = open(path.constData(), O_RDONLY | O_CLOEXEC);
+  if (chipFd < 0) {
+    perror("Could not open GPIO chip");
+    return;
+  }
+  gpioevent_request request{};
+  request.lineoffset = static_cast<__u32>(line);
+  request.handleflags = GPIOHANDLE_REQUEST_INPUT;
+  request.eventflags = GPIOEVENT_REQUEST_RISING_EDGE;
+  strncpy(request.consumer_label, "miband3-data-ready", sizeof(request.consumer_label) - 1);
+  if (ioctl(chipFd, GPIO_GET_LINEEVENT_IOCTL, &request) < 0)
+    perror("Could not request GPIO line events");
+  else
+    m_fd = request.fd;
+  close(chipFd);
+  watch();
+}
+
+DataReadyLine::DataReadyLine(int fd, QObject *parent) : QObject(parent), m_fd(fd) { watch(); }
+
+DataReadyLine::~DataReadyLine() {
+  if (m_fd >= 0)
+    close(m_fd);
+}
+
+void DataReadyLine::watch() {
+  if (m_fd < 0)
+    return;
+  fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) | O_NONBLOCK);
+  m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+  connect(m_notifier, &QSocketNotifier::activated, this, &DataReadyLine::readEvents);
+}
+
+bool DataReadyLine::isAsserted() const {
+  gpiohandle_data data{};
+  return m_fd >= 0 && ioctl(m_fd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) == 0 && data.values[0];
+}
+
+void DataReadyLine::readEvents() {
+  // Edges that piled up are served by the same transfers, so only the oldest counts. All
+  // are read, so a pile larger than the buffer still asks for one poll; an edge that comes
+  // after the last read wakes the notifier again.
+  gpioevent_data events[16];
+  quint64 oldest = 0;
+  bool any = false;
+  for (;;) {
+    const ssize_t n = read(m_fd, events, sizeof(events));
+    if (n < 0) {
+      if (errno != EAGAIN && errno != EINTR)
+        perror("Could not read GPIO line events");
+      break;
+    }
+    if (n < static_cast<ssize_t>(sizeof(gpioevent_data))) {
+      // Writer of a test fd went away.
+      m_notifier->setEnabled(false);
+      break;
+    }
+    if (!any)
+      oldest = events[0].timestamp;
+    any = true;
+    if (n < static_cast<ssize_t>(sizeof(events)))
+      break;
+  }
+  if (!any)
+    return;
+  // Kernels before 5.7 stamp edges with CLOCK_REALTIME, later ones with CLOCK_MONOTONIC.
+  const qint64 monotonic = clockNs(CLOCK_MONOTONIC);
+  const qint64 realtime = clockNs(CLOCK_REALTIME);
+  qint64 edge = static_cast<qint64>(oldest);
+  if (qAbs(edge - realtime) < qAbs(edge - monotonic))
+    edge += monotonic - realtime;
+  emit asserted(edge);
+}
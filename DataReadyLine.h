@@ -0,0 +1,36 @@
+#pragma once
+#include <QObject>
+#include <QSocketNotifier>
+
+// Data-ready input from the ESP32 on a GPIO line, read through the GPIO character device
+// (line event ABI v1, which all kernels shipped for the Pi have). asserted() fires on
+// every rising edge with the kernel's edge timestamp.
+//
+// For tests, any readable fd that yields struct gpioevent_data records works in place of
+// the line, e.g. the read end of a pipe; isAsserted() then always reports false.
+class DataReadyLine : public QObject {
+  Q_OBJECT
+public:
+  // chip is a name below /dev such as "gpiochip0", line the offset on that chip.
+  DataReadyLine(const QString &chip, int line, QObject *parent = nullptr);
+  // Takes ownership of fd.
+  DataReadyLine(int fd, QObject *parent = nullptr);
+  ~DataReadyLine();
+
+  bool isValid() const { return m_fd >= 0; }
+  // Current level; the ESP32 keeps the line high while it has more to send.
+  bool isAsserted() const;
+
+signals:
+  // edgeNs is CLOCK_MONOTONIC nanoseconds of the edge.
+  void asserted(qint64 edgeNs);
+
+private slots:
+  void readEvents();
+
+private:
+  void watch();
+
+  int m_fd = -1;
+  QSocketNotifier *m_notifier = nullptr;
+};
@@ -1,26 +1,229 @@
 #include "ESP32SPI.h"
+#include "CommandChannel.h"
+#include "Crc16.h"
+#include "DataReadyLine.h"
+#include "Logging.h"
 #include "fcntl.h"
 #include <QDataStream>
 #include <QDebug>
 #include <QThread>
+#include <cstring>
+#include <ctime>
 #include <linux/spi/spidev.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
 
-ESP32SPI::ESP32SPI(QObject *parent) : QObject(parent) { openSpiPort(); }
+// Days since 1970-01-01 of a proleptic Gregorian date.
+static qint64 daysFromCivil(int y, int m, int d) {
+  y -= m <= 2;
+  const qint64 era = (y >= 0 ? y : y - 399) / 400;
+  const int yoe = y - era * 400;
+  const int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+// Clock rates tried by calibrate(), slowest first. Index 1 is the 1 MHz default.
+static const unsigned int SpiSpeeds[] = {500'000, 1'000'000, 2'000'000, 4'000'000, 8'000'000, 10'000'000, 16'000'000, 20'000'000};
+static constexpr int SpiSpeedCount = sizeof(SpiSpeeds) / sizeof(SpiSpeeds[0]);
+static constexpr int ProbeFrames = 32;
+// Replies checked per window, and how many may be garbled before the clock steps down.
+static constexpr int ErrorWindow = 64;
+static constexpr int MaxWindowErrors = 2;
+// Upper bound on back-to-back command transfers per poll(), so samples are not starved.
+static constexpr int MaxPollTransfers = 16;
+// Data-ready edges summarised per latency log line.
+static constexpr int LatencyWindow = 100;
+
+static void makeProbeFrame(uchar *frame, quint8 sequence) {
+  frame[0] = 'P';
+  frame[1] = 'R';
+  frame[2] = 'B';
+  frame[3] = sequence;
+  // Alternating and solid patterns stress both edges, the rest is pseudo-random.
+  static const uchar fixed[] = {0x55, 0xaa, 0x00, 0xff, 0x0f, 0xf0};
+  quint32 x = 0x9e3779b9u * (sequence + 1);
+  for (int i = 4; i < 30; ++i) {
+    x = x * 1664525u + 1013904223u;
+    frame[i] = i < 10 ? fixed[i - 4] : static_cast<uchar>(x >> 24);
+  }
+  const quint16 crc = crc16(frame, 30);
+  frame[30] = crc >> 8;
+  frame[31] = crc & 0xff;
+}
+
+static bool isTimeReply(const char *time) {
+  // "YYYY-MM-DDTHH:MM:SS"
+  static const char format[] = "dddd-dd-ddTdd:dd:dd";
+  for (int i = 0; format[i]; ++i) {
+    if (format[i] == 'd' ? (time[i] < '0' || time[i] > '9') : time[i] != format[i])
+      return false;
+  }
+  return true;
+}
+
+ESP32SPI::ESP32SPI(QObject *parent) : QObject(parent) {
+  m_clock.start();
+  openSpiPort();
+}
+
+ESP32SPI::ESP32SPI(Transfer transfer, QObject *parent) : QObject(parent), m_transfer(std::move(transfer)) { m_clock.start(); }
 
 ESP32SPI::~ESP32SPI() { closeSpiPort(); }
 
 void ESP32SPI::sendData(uint8_t hr, uint16_t steps) {
   char data[32] = {0};
-  char time[32] = {0};
-  auto len = sprintf(data, "hr=%hhu;steps=%hu;", hr, steps);
-  qDebug() << "Send Data to SPI:" << data;
+  char time[33] = {0};
+  sprintf(data, "hr=%hhu;steps=%hu;", hr, steps);
+  memcpy(m_lastData, data, sizeof(m_lastData));
+  qCDebug(lcData) << "Send Data to SPI:" << data;
   writeAndRead(data, time, 32);
-  qDebug() << "Read Time from SPI:" << time;
-  QDateTime t = QDateTime::fromString(time, Qt::ISODate);
-  if (t.isValid())
+  qCDebug(lcData) << "Read Time from SPI:" << time;
+  handleReply(time);
+}
+
+void ESP32SPI::setCommandChannel(CommandChannel *channel, int pollInterval) {
+  m_commands = channel;
+  connect(channel, &CommandChannel::outgoingReady, this, &ESP32SPI::poll, Qt::QueuedConnection);
+  connect(&m_pollTimer, &QTimer::timeout, this, &ESP32SPI::poll);
+  if (pollInterval > 0)
+    m_pollTimer.start(pollInterval);
+}
+
+void ESP32SPI::setDataReadyLine(DataReadyLine *line) {
+  m_dataReady = line;
+  connect(line, &DataReadyLine::asserted, this, &ESP32SPI::dataReady);
+}
+
+void ESP32SPI::dataReady(qint64 edgeNs) {
+  poll();
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  const qint64 latency = static_cast<qint64>(now.tv_sec) * 1000000000 + now.tv_nsec - edgeNs;
+  m_readyLatencyMin = m_readyEdges ? qMin(m_readyLatencyMin, latency) : latency;
+  m_readyLatencyMax = m_readyEdges ? qMax(m_readyLatencyMax, latency) : latency;
+  m_readyLatencySum += latency;
+  if (++m_readyEdges < LatencyWindow)
+    return;
+  qDebug() << "ESP32 data-ready to reply latency over" << m_readyEdges << "edges: min" << m_readyLatencyMin / 1000 << "us, avg"
+           << m_readyLatencySum / m_readyEdges / 1000 << "us, max" << m_readyLatencyMax / 1000 << "us";
+  m_readyEdges = 0;
+  m_readyLatencySum = 0;
+}
+
+void ESP32SPI::poll() {
+  if ((m_spiHandle < 0 && !m_transfer) || (!m_commands && !m_dataReady))
+    return;
+  for (int i = 0; i < MaxPollTransfers; ++i) {
+    char tx[32];
+    char rx[32] = {0};
+    if (m_commands)
+      m_commands->takeOutgoing(reinterpret_cast<uchar *>(tx));
+    else
+      memcpy(tx, m_lastData, sizeof(tx));
+    if (static_cast<int>(writeAndRead(tx, rx, sizeof(rx))) < 0)
+      return;
+    handleReply(rx);
+    const bool more = m_commands && (m_commands->hasOutgoing() || m_commands->peerHasMore());
+    if (!more && !(m_dataReady && m_dataReady->isAsserted()))
+      return;
+  }
+}
+
+void ESP32SPI::handleReply(const char *reply) {
+  if (m_commands && static_cast<uchar>(reply[0]) == CommandChannel::FrameMarker) {
+    recordReply(m_commands->handleIncoming(reinterpret_cast<const uchar *>(reply)));
+    return;
+  }
+  // An idle ESP32 answers with zeros; anything else must be a well-formed time.
+  if (reply[0] != '\0')
+    recordReply(isTimeReply(reply));
+  handleTimeReply(reply);
+}
+
+void ESP32SPI::recordReply(bool ok) {
+  if (!ok)
+    m_windowErrors++;
+  if (++m_window < ErrorWindow && m_windowErrors <= MaxWindowErrors)
+    return;
+  if (m_windowErrors > MaxWindowErrors && m_speedIndex > 0) {
+    qWarning() << m_windowErrors << "garbled SPI replies in" << m_window << "transfers, slowing down to" << SpiSpeeds[m_speedIndex - 1] << "Hz";
+    setSpeed(m_speedIndex - 1);
+  }
+  qCDebug(lcData) << "SPI at" << m_spiSpeed << "Hz:" << throughput() / 1000 << "kB/s effective," << m_windowErrors << "garbled replies";
+  m_window = 0;
+  m_windowErrors = 0;
+}
+
+void ESP32SPI::setSpeed(int index) {
+  m_speedIndex = index;
+  m_spiSpeed = SpiSpeeds[index];
+  if (m_spiHandle >= 0 && ioctl(m_spiHandle, SPI_IOC_WR_MAX_SPEED_HZ, &m_spiSpeed) < 0)
+    perror("Could not set SPI speed (WR)...ioctl fail");
+  m_transferBytes = 0;
+  m_transferNs = 0;
+}
+
+bool ESP32SPI::probeSpeed(int index) {
+  setSpeed(index);
+  uchar sent[32], previous[32], reply[32];
+  // The echo of frame n arrives with frame n + 1, so one extra frame is sent.
+  for (int i = 0; i <= ProbeFrames; ++i) {
+    makeProbeFrame(sent, m_probeSequence++);
+    memset(reply, 0, sizeof(reply));
+    if (static_cast<int>(writeAndRead(reinterpret_cast<char *>(sent), reinterpret_cast<char *>(reply), sizeof(reply))) < 0)
+      return false;
+    if (i > 0) {
+      const quint16 crc = static_cast<quint16>(reply[30] << 8 | reply[31]);
+      if (crc != crc16(reply, 30) || memcmp(reply, previous, sizeof(reply)) != 0)
+        return false;
+    }
+    memcpy(previous, sent, sizeof(sent));
+  }
+  return true;
+}
+
+void ESP32SPI::calibrate() {
+  if (m_spiHandle < 0 && !m_transfer)
+    return;
+  const int initial = m_speedIndex;
+  int fastest = -1;
+  for (int i = 0; i < SpiSpeedCount; ++i) {
+    if (!probeSpeed(i))
+      break;
+    qDebug() << "SPI probe at" << SpiSpeeds[i] << "Hz clean," << throughput() / 1000 << "kB/s";
+    fastest = i;
+  }
+  if (fastest < 0) {
+    qWarning() << "SPI probing failed at" << SpiSpeeds[0] << "Hz (firmware without probe echo?), keeping" << SpiSpeeds[initial] << "Hz";
+    setSpeed(initial);
+    return;
+  }
+  // One step of margin below the fastest clean rate, unless that is the slowest we have.
+  setSpeed(fastest > 0 ? fastest - 1 : 0);
+  qDebug() << "SPI clock calibrated to" << m_spiSpeed << "Hz";
+}
+
+void ESP32SPI::handleTimeReply(const char *time) {
+  // The ESP32 answers every transfer with its clock. Only pass it on when its offset
+  // from our monotonic clock jumped, or once a minute so a newly connected band gets it.
+  if (memcmp(time, m_lastTimeReply, sizeof(m_lastTimeReply)) == 0)
+    return;
+  memcpy(m_lastTimeReply, time, sizeof(m_lastTimeReply));
+  int year, month, day, hour, minute, second;
+  if (sscanf(time, "%4d-%2d-%2dT%2d:%2d:%2d", &year, &month, &day, &hour, &minute, &second) != 6)
+    return;
+  const qint64 now = m_clock.elapsed();
+  const qint64 offset = (daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second) * 1000 - now;
+  if (m_lastTimeEmit >= 0 && qAbs(offset - m_timeOffset) <= 2000 && now - m_lastTimeEmit < 60000)
+    return;
+
+  QDateTime t = QDateTime::fromString(QString::fromLatin1(time), Qt::ISODate);
+  if (t.isValid()) {
+    m_timeOffset = offset;
+    m_lastTimeEmit = now;
     timeReceived(t);
+  }
 }
 
 void ESP32SPI::openSpiPort() {
@@ -56,7 +259,7 @@ void ESP32SPI::openSpiPort() {
 }
 
 void ESP32SPI::closeSpiPort() {
-  if (close(m_spiHandle) < 0) {
+  if (m_spiHandle >= 0 && close(m_spiHandle) < 0) {
     perror("Error - Could not close SPI device");
   }
 }
@@ -71,10 +274,14 @@ size_t ESP32SPI::writeAndRead(char *tx, char *rx, size_t len) {
   spi.speed_hz = m_spiSpeed;
   spi.bits_per_word = m_spiBitsPerWord;
 
-  retVal = ioctl(m_spiHandle, SPI_IOC_MESSAGE(1), &spi);
+  const qint64 start = m_clock.nsecsElapsed();
+  retVal = m_transfer ? m_transfer(tx, rx, len) : ioctl(m_spiHandle, SPI_IOC_MESSAGE(1), &spi);
 
   if (retVal < 0) {
     perror("Error - Problem transmitting spi data..ioctl");
+  } else {
+    m_transferNs += m_clock.nsecsElapsed() - start;
+    m_transferBytes += len;
   }
   return retVal;
 }
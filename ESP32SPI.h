@@ -1,26 +1,90 @@
 #pragma once
 #include <QDateTime>
+#include <QElapsedTimer>
 #include <QObject>
+#include <QTimer>
+#include <functional>
 
+class CommandChannel;
+class DataReadyLine;
+
+// SPI link to the ESP32. Every 32-byte transfer carries "hr=..;steps=..;" out and the
+// ESP32's ISO time back.
+//
+// Link probing: a probe frame is "PRB", uint8 sequence, 26 pattern bytes and a CRC-16/CCITT
+// (big endian) over the first 30 bytes. Firmware that supports probing echoes the last probe
+// frame it received in its next reply.
+//
+// With a CommandChannel attached, replies starting with its frame marker are ESP32 requests.
+// They are clocked out by poll transfers at a fixed interval and right after every response,
+// so command latency does not depend on how often the band sends samples.
+//
+// With a DataReadyLine attached the ESP32 asks for transfers itself: an edge triggers poll(),
+// which keeps clocking while the line stays high. Without a CommandChannel those transfers
+// repeat the last sample so legacy firmware can still push its time.
 class ESP32SPI : public QObject {
   Q_OBJECT
 public:
+  // One full-duplex transfer; returns len on success, < 0 on failure like the spidev ioctl.
+  using Transfer = std::function<int(const char *tx, char *rx, size_t len)>;
+
   ESP32SPI(QObject *parent = nullptr);
+  // Runs over transfer instead of spidev, for benchmarks with a simulated ESP32.
+  explicit ESP32SPI(Transfer transfer, QObject *parent = nullptr);
   ~ESP32SPI();
+
+  unsigned int speed() const { return m_spiSpeed; }
+  // Payload bytes per second of time spent inside transfers.
+  double throughput() const { return m_transferNs ? m_transferBytes * 1e9 / m_transferNs : 0.0; }
+  // pollInterval 0 relies on the data-ready line alone.
+  void setCommandChannel(CommandChannel *channel, int pollInterval = 100);
+  void setDataReadyLine(DataReadyLine *line);
+
 public slots:
   void sendData(uint8_t hr, uint16_t steps);
+  // Probes increasing clock rates and keeps one step below the fastest clean one.
+  void calibrate();
+  // Exchanges frames until neither side has anything queued.
+  void poll();
 signals:
   void timeReceived(QDateTime time);
 private slots:
   void openSpiPort();
   void closeSpiPort();
+  void dataReady(qint64 edgeNs);
   size_t writeAndRead(char *tx, char *rx, size_t len);
   size_t write(char *tx, size_t len);
   size_t read(char *rx, size_t len);
-  
+
 private:
-  int m_spiHandle{};
+  void handleReply(const char *reply);
+  void handleTimeReply(const char *time);
+  void setSpeed(int index);
+  bool probeSpeed(int index);
+  void recordReply(bool ok);
+
+  int m_spiHandle{-1};
+  Transfer m_transfer;
   unsigned char m_spiMode{};
   unsigned char m_spiBitsPerWord{8};
   unsigned int m_spiSpeed{1'000'000};
+  int m_speedIndex{1};
+  quint8 m_probeSequence{};
+  int m_window{};
+  int m_windowErrors{};
+  quint64 m_transferBytes{};
+  qint64 m_transferNs{};
+  char m_lastTimeReply[32]{};
+  QElapsedTimer m_clock;
+  qint64 m_timeOffset{};
+  qint64 m_lastTimeEmit{-1};
+  CommandChannel *m_commands{};
+  QTimer m_pollTimer;
+  DataReadyLine *m_dataReady{};
+  char m_lastData[32]{};
+  // Data-ready edge to reply handled, in ns.
+  qint64 m_readyLatencyMin{};
+  qint64 m_readyLatencyMax{};
+  qint64 m_readyLatencySum{};
+  int m_readyEdges{};
 };
\ No newline at end of file
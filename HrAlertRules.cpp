@@ -0,0 +1,156 @@
+#include "HrAlertRules.h"
+#include <QRegularExpression>
+#include <QStringList>
+
+static constexpr int DefaultHysteresis = 3;
+static constexpr int MaxRateWindowMs = 60000;
+
+bool HrAlertRules::parse(const QString &spec, QString *error) {
+  static const QRegularExpression ruleRe("^(above|below|rise|fall)=(\\d+)(?:@(\\d+)s)?(?:~(\\d+))?(?:@(\\d+)s)?(!)?$");
+  m_count = 0;
+  m_historySize = 0;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+  const QStringList parts = spec.split(',', Qt::SkipEmptyParts);
+#else
+  const QStringList parts = spec.split(',', QString::SkipEmptyParts);
+#endif
+  for (const QString &part : parts) {
+    const QRegularExpressionMatch m = ruleRe.match(part.trimmed());
+    auto fail = [error, &part](const QString &reason) {
+      if (error)
+        *error = QString("%1: %2").arg(part.trimmed(), reason);
+      return false;
+    };
+    if (!m.hasMatch())
+      return fail("expected kind=<bpm>[~<hysteresis>][@<seconds>s][!]");
+    if (m_count == MaxRules)
+      return fail(QString("more than %1 rules").arg(MaxRules));
+    const QString kind = m.captured(1);
+    const int threshold = m.captured(2).toInt();
+    const QString seconds = m.captured(3).isEmpty() ? m.captured(5) : m.captured(3);
+    const qint64 durationMs = seconds.toLongLong() * 1000;
+    const bool rate = kind == "rise" || kind == "fall";
+    if (threshold < 1 || threshold > 255)
+      return fail("bpm must be 1 to 255");
+    if (rate && (durationMs <= 0 || durationMs > MaxRateWindowMs))
+      return fail(QString("rate rules need a window of 1 to %1 s").arg(MaxRateWindowMs / 1000));
+    if (durationMs > 24 * 3600 * 1000)
+      return fail("duration longer than a day");
+
+    Rule &rule = m_rules[m_count++];
+    rule.kind = kind == "above" ? Above : kind == "below" ? Below : kind == "rise" ? Rise : Fall;
+    rule.threshold = static_cast<quint8>(threshold);
+    rule.hysteresis = static_cast<quint8>(qBound(0, m.captured(4).isEmpty() ? DefaultHysteresis : m.captured(4).toInt(), threshold));
+    rule.durationMs = static_cast<qint32>(durationMs);
+    rule.level = m.captured(6).isEmpty() ? 1 : 2;
+    rule.since = 0;
+    rule.pending = false;
+    rule.active = false;
+  }
+  return true;
+}
+
+void HrAlertRules::range(qint64 now, qint32 windowMs, quint8 *low, quint8 *high) const {
+  *low = 255;
+  *high = 0;
+  for (int i = 0; i < m_historySize; ++i) {
+    const Point &p = m_history[(m_historyHead - 1 - i + HistorySize) % HistorySize];
+    if (now - p.time > windowMs)
+      break;
+    *low = qMin(*low, p.hr);
+    *high = qMax(*high, p.hr);
+  }
+}
+
+int HrAlertRules::evaluate(qint64 now, quint8 hr, int *fired) {
+  if (!hr || !m_count)
+    return 0;
+  m_history[m_historyHead] = {now, hr};
+  m_historyHead = (m_historyHead + 1) % HistorySize;
+  m_historySize = qMin(m_historySize + 1, HistorySize);
+
+  int level = 0;
+  for (int i = 0; i < m_count; ++i) {
+    Rule &rule = m_rules[i];
+    // How far the condition is past its threshold; below -hysteresis it is cleared.
+    int excess;
+    switch (rule.kind) {
+    case Above:
+      excess = hr - rule.threshold;
+      break;
+    case Below:
+      excess = rule.threshold - hr;
+      break;
+    default: {
+      quint8 low, high;
+      range(now, rule.durationMs, &low, &high);
+      excess = (rule.kind == Rise ? hr - low : high - hr) - rule.threshold;
+      break;
+    }
+    }
+
+    // Hysteresis only holds back re-arming a rule that fired; one still waiting out its
+    // duration starts over on any sample that misses the threshold.
+    if (excess < -rule.hysteresis || (excess < 0 && !rule.active)) {
+      rule.pending = false;
+      rule.since = 0;
+      rule.active = false;
+      continue;
+    }
+    if (rule.active || excess < 0)
+      continue;
+    if (!rule.pending) {
+      rule.pending = true;
+      rule.since = now;
+    }
+    // Rate rules already look back over their window; thresholds may have to be sustained.
+    const bool sustained = rule.kind == Rise || rule.kind == Fall || now - rule.since >= rule.durationMs;
+    if (!sustained)
+      continue;
+    rule.active = true;
+    if (rule.level > level) {
+      level = rule.level;
+      if (fired)
+        *fired = i;
+    }
+  }
+  return level;
+}
+
+QString HrAlertRules::describe(int index) const {
+  if (index < 0 || index >= m_count)
+    return QString();
+  static const char *const kinds[] = {"above", "below", "rise", "fall"};
+  const Rule &rule = m_rules[index];
+  QString text = QString("%1=%2").arg(kinds[rule.kind]).arg(rule.threshold);
+  if (rule.durationMs)
+    text += QString("@%1s").arg(rule.durationMs / 1000);
+  if (rule.level > 1)
+    text += '!';
+  return text;
+}
+
+quint32 AlertAckQueue::acknowledge(qint64 now) {
+  if (m_late && now < m_lateUntil) {
+    m_late--;
+    return 0;
+  }
+  m_late = 0;
+  return m_tokens.isEmpty() ? 0 : m_tokens.dequeue();
+}
+
+quint32 AlertAckQueue::timeOut(qint64 now) {
+  if (m_tokens.isEmpty())
+    return 0;
+  m_late++;
+  m_lateUntil = now + m_graceMs;
+  return m_tokens.dequeue();
+}
+
+QVector<quint32> AlertAckQueue::clear() {
+  QVector<quint32> tokens;
+  while (!m_tokens.isEmpty())
+    tokens.append(m_tokens.dequeue());
+  m_late = 0;
+  return tokens;
+}
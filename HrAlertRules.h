@@ -0,0 +1,81 @@
+#pragma once
+#include <QQueue>
+#include <QString>
+#include <QVector>
+
+// HR alert rules, compiled from a spec into a flat array and evaluated on every decoded
+// sample without allocating. A spec is a comma-separated list of
+//
+//   above=<bpm>[~<hysteresis>][@<seconds>s][!]   HR at or above bpm, for seconds if given
+//   below=<bpm>[~<hysteresis>][@<seconds>s][!]   HR at or below bpm, for seconds if given
+//   rise=<bpm>@<seconds>s[~<hysteresis>][!]      HR rose by bpm within the last seconds
+//   fall=<bpm>@<seconds>s[~<hysteresis>][!]      HR fell by bpm within the last seconds
+//
+// e.g. "above=150!,below=40@30s,rise=30@10s". "!" asks for a high alert instead of a mild
+// one. A rule fires once when its condition starts to hold and re-arms only after HR moved
+// back past the threshold by the hysteresis (3 bpm unless given); a duration starts over
+// on any sample that misses the threshold. Rate rules look back at most 60 s. HR 0 (no
+// skin contact) is ignored.
+class HrAlertRules {
+public:
+  static constexpr int MaxRules = 16;
+
+  bool parse(const QString &spec, QString *error = nullptr);
+  bool isEmpty() const { return m_count == 0; }
+  // Alert level (1 mild, 2 high) of the most urgent rule that fired on this sample, or 0.
+  // rule receives its index for describe().
+  int evaluate(qint64 now, quint8 hr, int *rule = nullptr);
+  QString describe(int rule) const;
+
+private:
+  enum Kind : quint8 { Above, Below, Rise, Fall };
+  struct Rule {
+    qint64 since;
+    qint32 durationMs;
+    Kind kind;
+    quint8 threshold;
+    quint8 hysteresis;
+    quint8 level;
+    bool pending;
+    bool active;
+  };
+  // One sample per notification; about a minute at the band's 1 Hz.
+  static constexpr int HistorySize = 64;
+  struct Point {
+    qint64 time;
+    quint8 hr;
+  };
+
+  // Lowest and highest HR since now - windowMs, the current sample included.
+  void range(qint64 now, qint32 windowMs, quint8 *low, quint8 *high) const;
+
+  Rule m_rules[MaxRules];
+  int m_count = 0;
+  Point m_history[HistorySize];
+  int m_historyHead = 0;
+  int m_historySize = 0;
+};
+
+// Matches acknowledgements of alert writes to their tokens. GATT answers writes in order, so
+// an ack belongs to the oldest write still waiting. A write failed by the timeout may still
+// be acked after it; that ack is swallowed rather than credited to the next write, but only
+// within graceMs of the timeout, so an ack that never comes cannot swallow genuine ones.
+class AlertAckQueue {
+public:
+  explicit AlertAckQueue(qint64 graceMs) : m_graceMs(graceMs) {}
+
+  bool isEmpty() const { return m_tokens.isEmpty(); }
+  void push(quint32 token) { m_tokens.enqueue(token); }
+  // The token an ack answers; 0 for a late ack or when nothing waits.
+  quint32 acknowledge(qint64 now);
+  // Fails the oldest waiting write and returns its token, 0 if none.
+  quint32 timeOut(qint64 now);
+  // The link dropped and took every outstanding write with it; returns their tokens.
+  QVector<quint32> clear();
+
+private:
+  QQueue<quint32> m_tokens;
+  qint64 m_graceMs;
+  int m_late = 0;
+  qint64 m_lateUntil = 0;
+};
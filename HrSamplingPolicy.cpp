@@ -0,0 +1,119 @@
+#include "HrSamplingPolicy.h"
+#include <QDebug>
+
+// Minimum time in a mode before leaving it for anything but Continuous on motion.
+static constexpr qint64 MinDwellMs = 2 * 60 * 1000;
+// Without motion for this long the wearer counts as still.
+static constexpr qint64 StillDayMs = 30 * 60 * 1000;
+static constexpr qint64 StillNightMs = 15 * 60 * 1000;
+// Consecutive HR 0 readings, with no motion for a while, mean the band is off the wrist.
+static constexpr int OffWristReadings = 3;
+static constexpr qint64 OffWristStillMs = 10 * 60 * 1000;
+static constexpr int PeriodicDayMs = 5 * 60 * 1000;
+static constexpr int PeriodicNightMs = 10 * 60 * 1000;
+static constexpr int SuspendedProbeMs = 30 * 60 * 1000;
+
+// Rough band-side costs for the battery estimate: the optical sensor draws about 1 mA
+// while measuring, a one-shot keeps it on for about 20 s and a GATT operation costs
+// about 0.05 mAs of radio time. The Mi Band 3 battery holds 110 mAh.
+static constexpr double SensorMa = 1.0;
+static constexpr double OneShotSeconds = 20.0;
+static constexpr double RadioOpMas = 0.05;
+
+const char *HrSamplingPolicy::modeName(Mode mode) {
+  static const char *const names[ModeCount] = {"continuous", "periodic", "suspended"};
+  return names[mode];
+}
+
+bool HrSamplingPolicy::isNight(int minuteOfDay) const {
+  return m_nightStart <= m_nightEnd ? minuteOfDay >= m_nightStart && minuteOfDay < m_nightEnd : minuteOfDay >= m_nightStart || minuteOfDay < m_nightEnd;
+}
+
+bool HrSamplingPolicy::setMode(qint64 now, Mode mode) {
+  if (mode == m_mode)
+    return false;
+  m_modeTime[m_mode] += now - qMax(m_modeSince, m_reportSince);
+  qDebug() << "HR sampling" << modeName(m_mode) << "->" << modeName(mode) << "after" << (now - m_modeSince) / 1000 << "s";
+  m_mode = mode;
+  m_modeSince = now;
+  return true;
+}
+
+bool HrSamplingPolicy::noteHr(qint64 now, quint8 hr, int minuteOfDay) {
+  if (hr) {
+    m_lastValidHr = now;
+    m_zeroHrRun = 0;
+    // Back on the wrist.
+    if (m_mode == Suspended)
+      return setMode(now, Periodic);
+  } else {
+    m_zeroHrRun++;
+  }
+  return evaluate(now, minuteOfDay);
+}
+
+bool HrSamplingPolicy::noteMotion(qint64 now) {
+  m_lastMotion = now;
+  m_zeroHrRun = 0;
+  return setMode(now, Continuous);
+}
+
+bool HrSamplingPolicy::evaluate(qint64 now, int minuteOfDay) {
+  m_night = isNight(minuteOfDay);
+  if (now - m_modeSince < MinDwellMs)
+    return false;
+  const bool recentMotion = m_lastMotion >= 0 && now - m_lastMotion < OffWristStillMs;
+  if (m_zeroHrRun >= OffWristReadings && !recentMotion)
+    return setMode(now, Suspended);
+  if (m_mode == Continuous) {
+    const qint64 still = m_night ? StillNightMs : StillDayMs;
+    if (m_lastMotion < 0 ? now - m_modeSince >= still : now - m_lastMotion >= still)
+      return setMode(now, Periodic);
+  }
+  return false;
+}
+
+int HrSamplingPolicy::hrInterval() const {
+  switch (m_mode) {
+  case Continuous:
+    return m_keepAlive;
+  case Periodic:
+    return m_night ? PeriodicNightMs : PeriodicDayMs;
+  default:
+    return SuspendedProbeMs;
+  }
+}
+
+int HrSamplingPolicy::stepPollInterval() const {
+  static const int intervals[ModeCount] = {60 * 1000, 5 * 60 * 1000, 15 * 60 * 1000};
+  return intervals[m_mode];
+}
+
+void HrSamplingPolicy::report(qint64 now) {
+  const qint64 period = now - m_reportSince;
+  if (period <= 0)
+    return;
+  qint64 modeTime[ModeCount];
+  for (int i = 0; i < ModeCount; i++)
+    modeTime[i] = m_modeTime[i];
+  modeTime[m_mode] += now - qMax(m_modeSince, m_reportSince);
+
+  // The sensor runs for the whole of Continuous and for one measurement per period
+  // otherwise.
+  const double hours = period / 3600000.0;
+  double sensorSeconds = modeTime[Continuous] / 1000.0;
+  sensorSeconds += modeTime[Periodic] / double(m_night ? PeriodicNightMs : PeriodicDayMs) * OneShotSeconds;
+  sensorSeconds += modeTime[Suspended] / double(SuspendedProbeMs) * OneShotSeconds;
+  const double mas = sensorSeconds * SensorMa + m_radioOps * RadioOpMas;
+  const double mahPerDay = mas / 3600.0 / hours * 24.0;
+
+  qInfo().nospace().noquote() << "HR sampling: continuous " << 100 * modeTime[Continuous] / period << "%, periodic " << 100 * modeTime[Periodic] / period << "%, suspended "
+                    << 100 * modeTime[Suspended] / period << "%, " << qRound(m_wakeups / hours) << " wakeups/h, " << qRound(m_radioOps / hours) << " radio ops/h, ~"
+                    << QString::number(mahPerDay, 'f', 1) << " mAh/day of the band's 110 mAh";
+
+  for (qint64 &t : m_modeTime)
+    t = 0;
+  m_wakeups = 0;
+  m_radioOps = 0;
+  m_reportSince = now;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <QtGlobal>
+
+// Chooses how a band measures HR from what it saw recently:
+//
+//   Continuous  band streams HR, kept alive by a ping every keepAliveInterval
+//   Periodic    one-shot measurements every few minutes, when still or asleep
+//   Suspended   off-wrist (HR 0 and no steps); a rare one-shot probes for the wrist
+//
+// Motion switches to Continuous at once; other changes wait out a minimum dwell so a
+// single odd reading does not flap the mode. Pure logic: times are monotonic ms and the
+// caller passes the local minute of day, so it runs without a band.
+class HrSamplingPolicy {
+public:
+  enum Mode { Continuous, Periodic, Suspended, ModeCount };
+
+  Mode mode() const { return m_mode; }
+  static const char *modeName(Mode mode);
+  // Both return true if the mode changed.
+  bool noteHr(qint64 now, quint8 hr, int minuteOfDay);
+  bool noteMotion(qint64 now);
+  // Re-evaluates without new input, on timer ticks.
+  bool evaluate(qint64 now, int minuteOfDay);
+
+  // HR timer: ping in Continuous, one-shot measurement otherwise.
+  int hrInterval() const;
+  int stepPollInterval() const;
+  void setKeepAliveInterval(int ms) { m_keepAlive = ms; }
+  // Night is [start, end) in minutes of the local day, may wrap midnight.
+  void setNight(int startMinute, int endMinute) {
+    m_nightStart = startMinute;
+    m_nightEnd = endMinute;
+  }
+
+  // Wakeup and radio accounting, fed by the caller.
+  void countWakeup() { m_wakeups++; }
+  void countRadioOp() { m_radioOps++; }
+  // Logs mode shares, wakeups and radio operations per hour and an estimate of the band's
+  // battery drain for HR since the last report, then starts a new period.
+  void report(qint64 now);
+
+private:
+  bool isNight(int minuteOfDay) const;
+  bool setMode(qint64 now, Mode mode);
+
+  Mode m_mode = Continuous;
+  qint64 m_modeSince = 0;
+  qint64 m_lastMotion = -1;
+  qint64 m_lastValidHr = -1;
+  int m_zeroHrRun = 0;
+  int m_keepAlive = 10000;
+  int m_nightStart = 23 * 60;
+  int m_nightEnd = 7 * 60;
+  // Whether the last evaluation fell in the night window; sets the periodic interval.
+  bool m_night = false;
+
+  qint64 m_reportSince = 0;
+  qint64 m_modeTime[ModeCount]{};
+  quint64 m_wakeups = 0;
+  quint64 m_radioOps = 0;
+};
@@ -0,0 +1,4 @@
+#include "Logging.h"
+
+Q_LOGGING_CATEGORY(lcData, "miband3.data", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcScan, "miband3.scan", QtInfoMsg)
@@ -0,0 +1,10 @@
+#pragma once
+#include <QLoggingCategory>
+
+// Per-sample messages. Off by default, because a constructed QDebug allocates on every
+// notification; enable with QT_LOGGING_RULES="miband3.data.debug=true".
+Q_DECLARE_LOGGING_CATEGORY(lcData)
+
+// Per-advertisement scan details, also off by default;
+// enable with QT_LOGGING_RULES="miband3.scan.debug=true".
+Q_DECLARE_LOGGING_CATEGORY(lcScan)
@@ -1,12 +1,73 @@
 #include "MiBand3.h"
+#include "BandPlacement.h"
+#include "Logging.h"
+#include "TraceRecorder.h"
 #include "aes.hpp"
-#include <QDataStream>
 #include <QDebug>
+#include <QMetaEnum>
 #include <QRandomGenerator>
+#include <QTime>
+#include <QtEndian>
 #include <algorithm>
 
-MiBand3::MiBand3(QObject *parent) : QObject(parent) {
-  m_deviceDiscoveryAgent = new QBluetoothDeviceDiscoveryAgent(this);
+// Built once, so comparing UUIDs on the notification path does not parse strings.
+static const QBluetoothUuid MiBand0Uuid{QString(MiBand3::ServiceMiBand0Uuid)};
+static const QBluetoothUuid MiBand1Uuid{QString(MiBand3::ServiceMiBand1Uuid)};
+static const QBluetoothUuid AuthUuid{QString(MiBand3::CharAuthUuid)};
+static const QBluetoothUuid StepsUuid{QString(MiBand3::CharStepsUuid)};
+static const QBluetoothUuid SensorUuid{QString(MiBand3::CharSensorUuid)};
+static const QBluetoothUuid SensorDataUuid{QString(MiBand3::CharSensorDataUuid)};
+
+static const QByteArray NotificationsOn = QByteArray::fromHex("0100");
+static const QByteArray NotificationsOff = QByteArray::fromHex("0000");
+static const QByteArray HrManualOff = QByteArray::fromHex("150200");
+static const QByteArray HrManualOn = QByteArray::fromHex("150201");
+static const QByteArray HrContinuousOff = QByteArray::fromHex("150100");
+static const QByteArray HrContinuousOn = QByteArray::fromHex("150101");
+static const QByteArray HrPing = QByteArray::fromHex("16");
+static const QByteArray SensorEnableRaw = QByteArray::fromHex("010319");
+static const QByteArray SensorStart = QByteArray::fromHex("02");
+
+// Default deadline per state in ms, indexed by MiBand3::State.
+static const int DefaultStateDeadlines[MiBand3::StateCount] = {
+    0,     // Idle
+    20000, // Scanning, the discovery agent itself gives up after 15 s
+    10000, // Connecting
+    10000, // Discovering
+    10000, // Authenticating
+    10000, // Subscribing
+    15000, // Streaming, longest gap between HR notifications
+};
+
+// The timers are children so moveToThread() takes them along.
+MiBand3::MiBand3(QObject *parent)
+    : QObject(parent), m_scanFilter(MiBand0Uuid, ManufacturerId), m_measureTimer(this), m_stepsTimer(this), m_alertTimer(this), m_stateTimer(this) {
+  createDiscoveryAgent();
+
+  connect(this, &MiBand3::authenticated, this, &MiBand3::startMeasureWhenReady);
+  connect(&m_measureTimer, &QTimer::timeout, this, &MiBand3::keepHRAlive);
+  connect(&m_stepsTimer, &QTimer::timeout, this, &MiBand3::pollSteps);
+  connect(this, &MiBand3::alertFinished, this, &MiBand3::alertAcknowledged);
+  m_alertTimer.setSingleShot(true);
+  connect(&m_alertTimer, &QTimer::timeout, this, &MiBand3::alertAckTimedOut);
+  m_samplingClock.start();
+
+  std::copy(std::begin(DefaultStateDeadlines), std::end(DefaultStateDeadlines), m_stateDeadlines);
+  m_stateTimer.setSingleShot(true);
+  connect(&m_stateTimer, &QTimer::timeout, this, &MiBand3::stateDeadlineExpired);
+  m_stateClock.start();
+}
+
+void MiBand3::createDiscoveryAgent() {
+  if (m_deviceDiscoveryAgent) {
+    m_deviceDiscoveryAgent->disconnect(this);
+    m_deviceDiscoveryAgent->stop();
+    m_deviceDiscoveryAgent->deleteLater();
+  }
+  if (m_localAdapter.isNull())
+    m_deviceDiscoveryAgent = new QBluetoothDeviceDiscoveryAgent(this);
+  else
+    m_deviceDiscoveryAgent = new QBluetoothDeviceDiscoveryAgent(m_localAdapter, this);
   m_deviceDiscoveryAgent->setLowEnergyDiscoveryTimeout(15000);
 
   connect(m_deviceDiscoveryAgent, &QBluetoothDeviceDiscoveryAgent::deviceDiscovered, this, &MiBand3::addDevice);
@@ -16,14 +77,128 @@ MiBand3::MiBand3(QObject *parent) : QObject(parent) {
 
   connect(m_deviceDiscoveryAgent, &QBluetoothDeviceDiscoveryAgent::finished, this, &MiBand3::scanFinished);
   connect(m_deviceDiscoveryAgent, &QBluetoothDeviceDiscoveryAgent::canceled, this, &MiBand3::scanFinished);
+}
 
-  connect(this, &MiBand3::authenticated, this, &MiBand3::startServicesDiscover);
-  connect(&m_measureTimer, &QTimer::timeout, this, &MiBand3::keepHRAlive);
+void MiBand3::setPlacement(BandPlacement *placement) {
+  m_placement = placement;
+  connect(m_placement, &BandPlacement::sessionMoved, this, &MiBand3::adapterMoved);
+}
+
+void MiBand3::adapterMoved(QObject *session, const QString &adapter) {
+  if (session != this)
+    return;
+  qWarning() << "Adapter" << m_localAdapter.toString() << "lost, moving to" << (adapter.isEmpty() ? QString("none") : adapter);
+  reconnect();
+}
+
+void MiBand3::setState(State state) {
+  if (state != m_state) {
+    const qint64 spent = m_stateClock.restart();
+    m_timeInState[m_state] += spent;
+    m_connectPhases[m_state] += spent;
+    m_stateEntries[state]++;
+    const QMetaEnum e = QMetaEnum::fromType<State>();
+    qDebug() << "State" << e.valueToKey(m_state) << "->" << e.valueToKey(state) << "after" << spent << "ms";
+    if (state == Scanning)
+      logStateTelemetry();
+    m_state = state;
+    emit stateChanged(state);
+  }
+  if (m_stateDeadlines[state] > 0)
+    m_stateTimer.start(stateDeadline(state));
+  else
+    m_stateTimer.stop();
+}
+
+int MiBand3::stateDeadline(State state) const {
+  // Between one-shot measurements no notification is due for a whole interval.
+  if (state == Streaming && m_sampling.mode() != HrSamplingPolicy::Continuous)
+    return m_stateDeadlines[state] + m_sampling.hrInterval();
+  return m_stateDeadlines[state];
+}
+
+void MiBand3::stateDeadlineExpired() {
+  if (m_state == Streaming && m_lastHrClock.isValid()) {
+    // Counted from the last notification rather than re-armed on each one, as restarting
+    // a QTimer allocates.
+    const qint64 left = stateDeadline(Streaming) - m_lastHrClock.elapsed();
+    if (left > 0) {
+      m_stateTimer.start(static_cast<int>(left));
+      return;
+    }
+  }
+  const QMetaEnum e = QMetaEnum::fromType<State>();
+  qWarning() << "State" << e.valueToKey(m_state) << "missed its deadline of" << m_stateDeadlines[m_state] << "ms";
+  switch (m_state) {
+  case Scanning:
+    // Finishes the scan with whatever was found so far. An agent that already stopped,
+    // e.g. after an error, sends neither finished nor canceled, so finish it here.
+    if (m_deviceDiscoveryAgent->isActive())
+      m_deviceDiscoveryAgent->stop();
+    else
+      scanFinished();
+    break;
+  case Subscribing:
+  case Streaming:
+    // First try to get HR notifications going again on the same link.
+    if (m_stallRetries++ == 0 && m_hrService && m_hrmNotifDesc.isValid()) {
+      qWarning() << "No HR notification, resubscribing...";
+      setState(Subscribing);
+      startMeasure();
+    } else {
+      reconnect();
+    }
+    break;
+  default:
+    reconnect();
+    break;
+  }
+}
+
+void MiBand3::reconnect() {
+  qWarning() << "Forcing reconnect...";
+  if (m_control) {
+    // Handle the disconnect here rather than waiting for a signal the stalled link may never deliver.
+    m_control->disconnect(this);
+    m_control->disconnectFromDevice();
+  }
+  deviceDisconnected();
+}
+
+void MiBand3::logStateTelemetry() {
+  const QMetaEnum e = QMetaEnum::fromType<State>();
+  QString line;
+  for (int i = 0; i < StateCount; ++i)
+    line += QString(" %1=%2ms/%3").arg(e.valueToKey(i)).arg(m_timeInState[i]).arg(m_stateEntries[i]);
+  qDebug().noquote() << "Time in state (total/entries):" << line;
+}
+
+void MiBand3::logConnectLatency() {
+  qDebug() << "Connect to first sample:" << m_connectClock.elapsed() << "ms (connect" << m_connectPhases[Connecting] << "ms, discover"
+           << m_connectPhases[Discovering] << "ms, auth" << m_connectPhases[Authenticating] << "ms, subscribe" << m_connectPhases[Subscribing] << "ms)";
+  m_connectClock.invalidate();
 }
 
 void MiBand3::startSearch() {
   m_device = QBluetoothDeviceInfo();
+  if (m_placement) {
+    m_placement->releaseDevice(this);
+    const QBluetoothAddress adapter(m_placement->acquire(this));
+    if (adapter.isNull()) {
+      qWarning() << "No Bluetooth adapter has a free link, retrying later.";
+      setState(Idle);
+      QTimer::singleShot(60000, this, &MiBand3::startSearch);
+      return;
+    }
+    if (adapter != m_localAdapter) {
+      m_localAdapter = adapter;
+      qDebug() << "Using adapter" << m_localAdapter.toString();
+      createDiscoveryAgent();
+    }
+  }
+  setState(Scanning);
 
+  m_scanFilter.reset();
   m_deviceDiscoveryAgent->start(QBluetoothDeviceDiscoveryAgent::LowEnergyMethod);
 }
 
@@ -58,14 +233,10 @@ void MiBand3::setTime(QDateTime time) {
 }
 
 void MiBand3::addDevice(const QBluetoothDeviceInfo &device) {
-  if (device.coreConfigurations() & QBluetoothDeviceInfo::LowEnergyCoreConfiguration) {
-    auto services = device.serviceUuids();
-    if (services.contains(QBluetoothUuid(QString(ServiceMiBand0Uuid)))) {
-      m_device = device;
-    }
-    qDebug() << "Low Energy device found" << device.name() << ". Scanning more...";
-    qDebug() << "Services:" << device.serviceUuids();
-  }
+  if (m_scanFilter.check(device) != ScanFilter::Candidate)
+    return;
+  if (!m_placement || m_placement->claimDevice(this, device.address().toString()))
+    m_device = device;
 }
 
 void MiBand3::scanError(QBluetoothDeviceDiscoveryAgent::Error error) {
@@ -75,11 +246,22 @@ void MiBand3::scanError(QBluetoothDeviceDiscoveryAgent::Error error) {
     qCritical() << "Writing or reading from the device resulted in an error.";
   else
     qCritical() << "An unknown error has occurred.";
+  // The agent stops without finished or canceled after an error.
+  if (m_state == Scanning) {
+    m_scanFilter.logSummary();
+    setState(Idle);
+    QTimer::singleShot(60000, this, &MiBand3::startSearch);
+  }
 }
 
 void MiBand3::scanFinished() {
+  // A scan already given up on after an error.
+  if (m_state != Scanning)
+    return;
+  m_scanFilter.logSummary();
   if (!m_device.isValid()) {
     qWarning() << "No Mi Band 3 devices found.";
+    setState(Idle);
     QTimer::singleShot(60000, this, &MiBand3::startSearch);
   } else {
     qDebug() << "Mi Band 3 found.";
@@ -95,8 +277,18 @@ void MiBand3::connectToDevice() {
   }
 
   if (m_device.isValid()) {
-
-    m_control = QLowEnergyController::createCentral(m_device, this);
+    std::fill(std::begin(m_connectPhases), std::end(m_connectPhases), 0);
+    m_connectClock.start();
+    setState(Connecting);
+
+    if (m_localAdapter.isNull())
+      m_control = QLowEnergyController::createCentral(m_device, this);
+    else
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+      m_control = QLowEnergyController::createCentral(m_device, m_localAdapter, this);
+#else
+      m_control = new QLowEnergyController(m_device.address(), m_localAdapter, this);
+#endif
     m_control->setRemoteAddressType(QLowEnergyController::RandomAddress);
 
     connect(m_control, &QLowEnergyController::serviceDiscovered, this, &MiBand3::serviceDiscovered);
@@ -109,6 +301,7 @@ void MiBand3::connectToDevice() {
             });
     connect(m_control, &QLowEnergyController::connected, this, [this]() {
       qDebug() << "Controller connected. Search services...";
+      setState(Discovering);
       m_control->discoverServices();
     });
     connect(m_control, &QLowEnergyController::disconnected, this, &MiBand3::deviceDisconnected);
@@ -121,12 +314,14 @@ void MiBand3::serviceDiscovered(const QBluetoothUuid &gatt) {
   if (gatt == QBluetoothUuid(QBluetoothUuid::HeartRate)) {
     qDebug() << "Heart Rate service discovered. Waiting for service scan to be done...";
     m_foundHRService = true;
-  } else if (gatt == QBluetoothUuid(QString(ServiceMiBand0Uuid))) {
+  } else if (gatt == MiBand0Uuid) {
     qDebug() << "MiBand0 service discovered. Waiting for service scan to be done...";
     m_foundMiBand0Service = true;
-  } else if (gatt == QBluetoothUuid(QString(ServiceMiBand1Uuid))) {
+  } else if (gatt == MiBand1Uuid) {
     qDebug() << "MiBand1 service discovered. Waiting for service scan to be done...";
     m_foundMiBand1Service = true;
+  } else if (gatt == QBluetoothUuid(QBluetoothUuid::ImmediateAlert)) {
+    m_foundAlertService = true;
   }
 }
 
@@ -146,18 +341,28 @@ void MiBand3::serviceScanDone() {
     delete m_miBand1Service;
     m_miBand1Service = nullptr;
   }
+  if (m_alertService) {
+    delete m_alertService;
+    m_alertService = nullptr;
+  }
 
   if (m_foundHRService && m_foundMiBand0Service && m_foundMiBand1Service) {
     m_hrService = m_control->createServiceObject(QBluetoothUuid(QBluetoothUuid::HeartRate), this);
-    m_miBand0Service = m_control->createServiceObject(QBluetoothUuid(QString(ServiceMiBand0Uuid)), this);
-    m_miBand1Service = m_control->createServiceObject(QBluetoothUuid(QString(ServiceMiBand1Uuid)), this);
+    m_miBand0Service = m_control->createServiceObject(MiBand0Uuid, this);
+    m_miBand1Service = m_control->createServiceObject(MiBand1Uuid, this);
+    // Optional, only needed for alert().
+    if (m_foundAlertService)
+      m_alertService = m_control->createServiceObject(QBluetoothUuid(QBluetoothUuid::ImmediateAlert), this);
   }
 
+  // Details of all services are discovered while authentication runs on MiBand1;
+  // HR subscription starts once both auth and HR discovery are done.
   if (m_hrService) {
     connect(m_hrService, &QLowEnergyService::stateChanged, this, &MiBand3::hrStateChanged);
     connect(m_hrService, &QLowEnergyService::characteristicChanged, this, &MiBand3::updateCharacteristicValue);
     connect(m_hrService, &QLowEnergyService::descriptorWritten, this, &MiBand3::confirmedHRDescriptorWrite);
     connect(m_hrService, &QLowEnergyService::characteristicRead, this, &MiBand3::readCharacteristicValue);
+    m_hrService->discoverDetails();
   } else {
     qCritical() << "Heart Rate Service not found.";
   }
@@ -166,6 +371,7 @@ void MiBand3::serviceScanDone() {
     connect(m_miBand0Service, &QLowEnergyService::characteristicChanged, this, &MiBand3::updateCharacteristicValue);
     connect(m_miBand0Service, &QLowEnergyService::descriptorWritten, this, &MiBand3::confirmedMiBand0DescriptorWrite);
     connect(m_miBand0Service, &QLowEnergyService::characteristicRead, this, &MiBand3::readCharacteristicValue);
+    m_miBand0Service->discoverDetails();
   } else {
     qCritical() << "MiBand0 Service not found.";
   }
@@ -177,17 +383,40 @@ void MiBand3::serviceScanDone() {
   } else {
     qCritical() << "MiBand1 Service not found.";
   }
+  if (m_alertService) {
+    connect(m_alertService, &QLowEnergyService::characteristicWritten, this, [this](const QLowEnergyCharacteristic &c) {
+      if (c.uuid() == QBluetoothUuid(QBluetoothUuid::AlertLevel))
+        finishAlert(true);
+    });
+    connect(m_alertService, static_cast<void (QLowEnergyService::*)(QLowEnergyService::ServiceError)>(&QLowEnergyService::error), this,
+            [this](QLowEnergyService::ServiceError error) {
+              if (error == QLowEnergyService::CharacteristicWriteError)
+                finishAlert(false);
+            });
+    m_alertService->discoverDetails();
+  }
 }
 
 void MiBand3::deviceDisconnected() {
   qWarning() << "LowEnergy controller disconnected";
   m_authenticated = false;
   m_canBeAuthenticated = false;
+  m_hrDiscovered = false;
   m_authKey.clear();
   m_foundHRService = false;
   m_foundMiBand0Service = false;
   m_foundMiBand1Service = false;
+  m_foundAlertService = false;
+  m_stallRetries = 0;
+  // The link took the outstanding writes with it; their acks will not come.
+  m_alertTimer.stop();
+  m_samplingModePending = false;
+  for (quint32 token : m_alertAcks.clear())
+    emit alertFinished(token, false);
   m_measureTimer.stop();
+  m_stepsTimer.stop();
+  m_stepsKnown = false;
+  setState(Idle);
   if (m_hrService != nullptr) {
     delete m_hrService;
     m_hrService = nullptr;
@@ -200,12 +429,16 @@ void MiBand3::deviceDisconnected() {
     delete m_miBand1Service;
     m_miBand1Service = nullptr;
   }
+  if (m_alertService != nullptr) {
+    delete m_alertService;
+    m_alertService = nullptr;
+  }
   startSearch();
   // emit finished();
 }
 
 void MiBand3::authenticate(const QByteArray &value) {
-  const QLowEnergyCharacteristic authChar = m_miBand1Service->characteristic(QBluetoothUuid(QString(CharAuthUuid)));
+  const QLowEnergyCharacteristic authChar = m_miBand1Service->characteristic(AuthUuid);
   if (!authChar.isValid()) {
     qCritical() << "Auth Data not found.";
     return;
@@ -250,6 +483,7 @@ void MiBand3::authenticate(const QByteArray &value) {
     } else if (value.startsWith(QByteArray::fromHex("100301"))) {
       qDebug() << "Authentication: success.";
       m_authenticated = true;
+      setState(Subscribing);
       emit authenticated();
     } else {
       qDebug() << "Authentication: failed.";
@@ -272,7 +506,8 @@ void MiBand3::hrStateChanged(QLowEnergyService::ServiceState s) {
       return;
     }
     m_hrmNotifDesc = hrmChar.descriptor(QBluetoothUuid::ClientCharacteristicConfiguration);
-    startMeasure();
+    m_hrDiscovered = true;
+    startMeasureWhenReady();
     break;
   }
   default:
@@ -287,6 +522,7 @@ void MiBand3::miBand0StateChanged(QLowEnergyService::ServiceState s) {
     break;
   case QLowEnergyService::ServiceDiscovered:
     qDebug() << "MiBand0 Service discovered.";
+    startRawSensor();
     break;
   default:
     break;
@@ -301,14 +537,15 @@ void MiBand3::miBand1StateChanged(QLowEnergyService::ServiceState s) {
   case QLowEnergyService::ServiceDiscovered: {
     qDebug() << "MiBand1 Service discovered.";
     qDebug() << "Authentication: init.";
-    const QLowEnergyCharacteristic authChar = m_miBand1Service->characteristic(QBluetoothUuid(QString(CharAuthUuid)));
+    setState(Authenticating);
+    const QLowEnergyCharacteristic authChar = m_miBand1Service->characteristic(AuthUuid);
     if (!authChar.isValid()) {
       qCritical() << "Auth Data not found.";
       return;
     }
     m_authNotifDesc = authChar.descriptor(QBluetoothUuid::ClientCharacteristicConfiguration);
     if (m_authNotifDesc.isValid())
-      m_miBand1Service->writeDescriptor(m_authNotifDesc, QByteArray::fromHex("0100"));
+      m_miBand1Service->writeDescriptor(m_authNotifDesc, NotificationsOn);
     break;
   }
   default:
@@ -317,24 +554,51 @@ void MiBand3::miBand1StateChanged(QLowEnergyService::ServiceState s) {
 }
 
 void MiBand3::updateCharacteristicValue(const QLowEnergyCharacteristic &c, const QByteArray &value) {
-  qDebug() << "Characteristic" << c.name() << ':' << c.uuid() << "changed to" << value.toHex(' ');
-  if (c.isValid() && c.uuid() == QBluetoothUuid(QString(CharAuthUuid))) {
-    authenticate(value);
-  } else if (c.isValid() && c.uuid() == QBluetoothUuid::HeartRateMeasurement) {
+  qCDebug(lcData) << "Characteristic" << c.name() << ':' << c.uuid() << "changed to" << value.toHex(' ');
+  if (c.isValid())
+    handleCharacteristicChanged(c.uuid(), value);
+}
+
+void MiBand3::handleCharacteristicChanged(const QBluetoothUuid &uuid, const QByteArray &value) {
+  if (m_recorder)
+    m_recorder->record(TraceRecorder::TraceChanged, uuid, value);
+  if (uuid == AuthUuid) {
+    if (m_miBand1Service)
+      authenticate(value);
+  } else if (uuid == SensorDataUuid) {
+    m_rawSensor.decode(value);
+    emit rawSensorDataAvailable();
+  } else if (uuid == QBluetoothUuid::HeartRateMeasurement && value.size() >= 2) {
+    // Each notification holds off the stall watchdog; replayed traces have no live link to watch.
+    if (m_state == Subscribing || m_state == Streaming) {
+      m_stallRetries = 0;
+      m_lastHrClock.start();
+      if (m_state != Streaming)
+        setState(Streaming);
+      if (m_connectClock.isValid())
+        logConnectLatency();
+    }
     m_hr = value[1];
+    if (!m_alertRules.isEmpty())
+      checkAlertRules();
+    if (m_adaptive) {
+      m_sampling.countWakeup();
+      if (m_sampling.noteHr(m_samplingClock.elapsed(), m_hr, QTime::currentTime().msecsSinceStartOfDay() / 60000))
+        applySamplingMode();
+    }
     emit dataChanged(m_hr, m_steps);
   }
 }
 
 void MiBand3::confirmedHRDescriptorWrite(const QLowEnergyDescriptor &d, const QByteArray &value) {
-  if (d.isValid() && d == m_authNotifDesc && value == QByteArray::fromHex("0000")) {
+  if (d.isValid() && d == m_authNotifDesc && value == NotificationsOff) {
     qDebug() << "Notifications disabled.";
     m_control->disconnectFromDevice();
   }
 }
 
 void MiBand3::confirmedMiBand0DescriptorWrite(const QLowEnergyDescriptor &d, const QByteArray &value) {
-  if (d.isValid() && d == m_authNotifDesc && value == QByteArray::fromHex("0000")) {
+  if (d.isValid() && d == m_authNotifDesc && value == NotificationsOff) {
     qDebug() << "Notifications disabled.";
     m_control->disconnectFromDevice();
   }
@@ -342,7 +606,7 @@ void MiBand3::confirmedMiBand0DescriptorWrite(const QLowEnergyDescriptor &d, con
 
 void MiBand3::confirmedMiBand1DescriptorWrite(const QLowEnergyDescriptor &d, const QByteArray &value) {
   if (d.isValid() && d == m_authNotifDesc) {
-    if (value == QByteArray::fromHex("0000")) {
+    if (value == NotificationsOff) {
       qDebug() << "Notifications disabled.";
       m_control->disconnectFromDevice();
     } else {
@@ -352,18 +616,29 @@ void MiBand3::confirmedMiBand1DescriptorWrite(const QLowEnergyDescriptor &d, con
 }
 
 void MiBand3::readCharacteristicValue(const QLowEnergyCharacteristic &c, const QByteArray &value) {
-  qDebug() << "Read characteristic" << c.name() << ':' << c.uuid() << "value" << value.toHex(' ');
-  if (c.isValid() && c.uuid() == QBluetoothUuid(QString(CharStepsUuid))) {
-    QDataStream ds(value);
-    uint16_t steps{};
-    ds >> steps;
+  qCDebug(lcData) << "Read characteristic" << c.name() << ':' << c.uuid() << "value" << value.toHex(' ');
+  if (c.isValid())
+    handleCharacteristicRead(c.uuid(), value);
+}
+
+void MiBand3::handleCharacteristicRead(const QBluetoothUuid &uuid, const QByteArray &value) {
+  if (m_recorder)
+    m_recorder->record(TraceRecorder::TraceRead, uuid, value);
+  if (uuid == StepsUuid) {
+    // Same big-endian read QDataStream did, without the QBuffer it allocates.
+    const uint16_t steps = value.size() >= 2 ? qFromBigEndian<quint16>(value.constData()) : 0;
+    // The counter only grows while the wearer walks; a reset at midnight is not motion.
+    if (m_adaptive && m_stepsKnown && steps > m_steps)
+      noteMotion();
     m_steps = steps;
+    m_stepsKnown = true;
   }
 }
 
-void MiBand3::startServicesDiscover() {
-  m_miBand0Service->discoverDetails();
-  m_hrService->discoverDetails();
+void MiBand3::startMeasureWhenReady() {
+  if (!m_authenticated || !m_hrDiscovered)
+    return;
+  startMeasure();
 }
 
 void MiBand3::startMeasure() {
@@ -373,26 +648,208 @@ void MiBand3::startMeasure() {
     return;
   }
 
-  m_hrService->writeCharacteristic(hrcChar, QByteArray::fromHex("150200"));
-  m_hrService->writeCharacteristic(hrcChar, QByteArray::fromHex("150100"));
-  m_hrService->writeDescriptor(m_hrmNotifDesc, QByteArray::fromHex("0100"));
-  m_hrService->writeCharacteristic(hrcChar, QByteArray::fromHex("150101"));
+  m_hrService->writeCharacteristic(hrcChar, HrManualOff);
+  m_hrService->writeCharacteristic(hrcChar, HrContinuousOff);
+  m_hrService->writeDescriptor(m_hrmNotifDesc, NotificationsOn);
+  if (m_sampling.mode() == HrSamplingPolicy::Continuous)
+    m_hrService->writeCharacteristic(hrcChar, HrContinuousOn);
+  else
+    m_hrService->writeCharacteristic(hrcChar, HrManualOn);
+  startRawSensor();
+
+  m_sampling.setKeepAliveInterval(m_measureInterval);
+  m_measureTimer.start(m_sampling.hrInterval());
+  m_stepsTimer.start(m_adaptive ? m_sampling.stepPollInterval() : m_measureInterval);
+}
+
+void MiBand3::setMeasureInterval(int ms) {
+  m_measureInterval = ms;
+  m_sampling.setKeepAliveInterval(ms);
+  if (m_measureTimer.isActive())
+    m_measureTimer.start(m_sampling.hrInterval());
+  if (m_stepsTimer.isActive() && !m_adaptive)
+    m_stepsTimer.start(m_measureInterval);
+}
+
+void MiBand3::noteMotion() {
+  if (m_adaptive && m_sampling.noteMotion(m_samplingClock.elapsed()))
+    applySamplingMode();
+}
+
+void MiBand3::applySamplingMode() {
+  if (!m_hrService || !m_measureTimer.isActive())
+    return;
+  m_measureTimer.start(m_sampling.hrInterval());
+  m_stepsTimer.start(m_sampling.stepPollInterval());
+  if (m_state == Streaming)
+    setState(Streaming);
+  // Like the other routine writes, the mode change waits for outstanding alerts.
+  m_samplingModePending = true;
+  if (m_alertAcks.isEmpty())
+    writeSamplingMode();
+}
+
+void MiBand3::writeSamplingMode() {
+  m_samplingModePending = false;
+  const QLowEnergyCharacteristic hrcChar = m_hrService->characteristic(QBluetoothUuid::HeartRateControlPoint);
+  if (!hrcChar.isValid())
+    return;
+  // Continuous streams until switched off; the other modes measure once per timer tick.
+  if (m_sampling.mode() == HrSamplingPolicy::Continuous) {
+    m_hrService->writeCharacteristic(hrcChar, HrContinuousOn);
+  } else {
+    m_hrService->writeCharacteristic(hrcChar, HrContinuousOff);
+  }
+  m_sampling.countRadioOp();
+}
+
+quint32 MiBand3::alert(quint8 level) {
+  if (!m_alertService || m_alertService->state() != QLowEnergyService::ServiceDiscovered)
+    return 0;
+  const QLowEnergyCharacteristic alertChar = m_alertService->characteristic(QBluetoothUuid::AlertLevel);
+  if (!alertChar.isValid())
+    return 0;
+  const quint32 token = ++m_lastAlertToken ? m_lastAlertToken : ++m_lastAlertToken;
+  // Bands that only take unacknowledged writes get no characteristicWritten.
+  if (alertChar.properties() & QLowEnergyCharacteristic::Write) {
+    if (m_alertAcks.isEmpty())
+      m_alertTimer.start(AlertAckTimeoutMs);
+    m_alertAcks.push(token);
+    m_alertService->writeCharacteristic(alertChar, QByteArray(1, static_cast<char>(level)));
+  } else {
+    m_alertService->writeCharacteristic(alertChar, QByteArray(1, static_cast<char>(level)), QLowEnergyService::WriteWithoutResponse);
+    QTimer::singleShot(0, this, [this, token]() { emit alertFinished(token, true); });
+  }
+  return token;
+}
+
+void MiBand3::finishAlert(bool ok) {
+  const quint32 token = m_alertAcks.acknowledge(m_samplingClock.elapsed());
+  if (!token)
+    return;
+  if (m_alertAcks.isEmpty())
+    m_alertTimer.stop();
+  else
+    m_alertTimer.start(AlertAckTimeoutMs);
+  if (m_alertAcks.isEmpty() && m_samplingModePending && m_hrService)
+    writeSamplingMode();
+  emit alertFinished(token, ok);
+}
+
+void MiBand3::alertAckTimedOut() {
+  if (m_alertAcks.isEmpty())
+    return;
+  qWarning() << "Alert write not acknowledged within" << AlertAckTimeoutMs << "ms";
+  const quint32 token = m_alertAcks.timeOut(m_samplingClock.elapsed());
+  if (!m_alertAcks.isEmpty())
+    m_alertTimer.start(AlertAckTimeoutMs);
+  else if (m_samplingModePending && m_hrService)
+    writeSamplingMode();
+  emit alertFinished(token, false);
+}
+
+void MiBand3::checkAlertRules() {
+  const qint64 notified = m_samplingClock.nsecsElapsed();
+  int rule = -1;
+  const int level = m_alertRules.evaluate(notified / 1000000, m_hr, &rule);
+  if (!level)
+    return;
+  const quint32 token = alert(static_cast<quint8>(level));
+  const qint64 issued = m_samplingClock.nsecsElapsed();
+  qInfo() << "HR alert" << m_alertRules.describe(rule) << "at" << m_hr << "bpm," << (token ? "write issued after" : "no alert service, checked in")
+          << (issued - notified) / 1000 << "us";
+  if (token) {
+    m_ruleAlertToken = token;
+    m_alertNotifiedNs = notified;
+  }
+}
+
+void MiBand3::alertAcknowledged(quint32 token, bool ok) {
+  // Alerts written for others, e.g. Vibrate requests, say nothing about rule latency.
+  if (token != m_ruleAlertToken || m_alertNotifiedNs < 0)
+    return;
+  m_ruleAlertToken = 0;
+  // The band vibrates as soon as it takes the write, so the acknowledgement marks it.
+  const qint64 latency = m_samplingClock.nsecsElapsed() - m_alertNotifiedNs;
+  m_alertNotifiedNs = -1;
+  if (!ok) {
+    qWarning() << "HR alert write failed after" << latency / 1000000 << "ms";
+    return;
+  }
+  m_alertLatencyMin = m_alertCount ? qMin(m_alertLatencyMin, latency) : latency;
+  m_alertLatencyMax = m_alertCount ? qMax(m_alertLatencyMax, latency) : latency;
+  m_alertLatencySum += latency;
+  m_alertCount++;
+  qInfo() << "HR alert acknowledged" << latency / 1000 << "us after the notification (min" << m_alertLatencyMin / 1000 << "us, avg"
+          << m_alertLatencySum / m_alertCount / 1000 << "us, max" << m_alertLatencyMax / 1000 << "us over" << m_alertCount << "alerts)";
+}
 
-  m_measureTimer.start(10000);
+void MiBand3::startRawSensor() {
+  // Needs authentication and MiBand0 details, which arrive in either order.
+  if (!m_rawSensorEnabled || !m_authenticated || !m_miBand0Service || m_miBand0Service->state() != QLowEnergyService::ServiceDiscovered)
+    return;
+  const QLowEnergyCharacteristic sensorChar = m_miBand0Service->characteristic(SensorUuid);
+  const QLowEnergyCharacteristic dataChar = m_miBand0Service->characteristic(SensorDataUuid);
+  if (!sensorChar.isValid() || !dataChar.isValid()) {
+    qCritical() << "Raw sensor Data not found.";
+    return;
+  }
+  qDebug() << "Starting raw sensor stream...";
+  m_rawSensor.reset();
+  m_miBand0Service->writeCharacteristic(sensorChar, SensorEnableRaw, QLowEnergyService::WriteWithoutResponse);
+  m_miBand0Service->writeDescriptor(dataChar.descriptor(QBluetoothUuid::ClientCharacteristicConfiguration), NotificationsOn);
+  m_miBand0Service->writeCharacteristic(sensorChar, SensorStart, QLowEnergyService::WriteWithoutResponse);
 }
 
 void MiBand3::keepHRAlive() {
+  if (m_rawSensorEnabled)
+    m_rawSensor.logStats();
+  // Qt sends GATT requests strictly in order; routine ones wait while an alert is
+  // outstanding so a follow-up alert never queues behind them.
+  if (!m_alertAcks.isEmpty())
+    return;
+
   const QLowEnergyCharacteristic hrcChar = m_hrService->characteristic(QBluetoothUuid::HeartRateControlPoint);
   if (!hrcChar.isValid()) {
     qCritical() << "HRC Data not found.";
     return;
   };
-  const QLowEnergyCharacteristic stepsChar = m_miBand0Service->characteristic(QBluetoothUuid(QString(CharStepsUuid)));
-  if (!stepsChar.isValid()) {
-    qCritical() << "Steps Data not found.";
+
+  if (m_sampling.mode() == HrSamplingPolicy::Continuous) {
+    m_hrService->writeCharacteristic(hrcChar, HrPing);
+  } else {
+    m_hrService->writeCharacteristic(hrcChar, HrManualOn);
+  }
+  if (m_adaptive) {
+    m_sampling.countWakeup();
+    m_sampling.countRadioOp();
+  }
+}
+
+void MiBand3::pollSteps() {
+  // The read waits while an alert is outstanding, as in keepHRAlive(); the policy does not.
+  const bool read = m_alertAcks.isEmpty();
+  if (read) {
+    const QLowEnergyCharacteristic stepsChar = m_miBand0Service->characteristic(StepsUuid);
+    if (!stepsChar.isValid()) {
+      qCritical() << "Steps Data not found.";
+      return;
+    };
+    m_miBand0Service->readCharacteristic(stepsChar);
+  }
+  if (!m_adaptive)
     return;
-  };
 
-  m_hrService->writeCharacteristic(hrcChar, QByteArray::fromHex("16"));
-  m_miBand0Service->readCharacteristic(stepsChar);
+  // Stillness and night only show on the clock, not in any notification.
+  const qint64 now = m_samplingClock.elapsed();
+  m_sampling.countWakeup();
+  if (read)
+    m_sampling.countRadioOp();
+  // The periodic interval also follows night and day without a mode change.
+  if (m_sampling.evaluate(now, QTime::currentTime().msecsSinceStartOfDay() / 60000) || m_measureTimer.interval() != m_sampling.hrInterval())
+    applySamplingMode();
+  if (now - m_lastSamplingReport >= 3600 * 1000) {
+    m_sampling.report(now);
+    m_lastSamplingReport = now;
+  }
 }
\ No newline at end of file
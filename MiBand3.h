@@ -1,13 +1,22 @@
 #pragma once
 
+#include "HrAlertRules.h"
+#include "HrSamplingPolicy.h"
+#include "RawSensorStream.h"
+#include "ScanFilter.h"
+#include <QBluetoothAddress>
 #include <QBluetoothDeviceDiscoveryAgent>
 #include <QBluetoothDeviceInfo>
 #include <QBluetoothUuid>
 #include <QDateTime>
+#include <QElapsedTimer>
 #include <QLowEnergyController>
 #include <QTimer>
 #include <QDateTime>
 
+class BandPlacement;
+class TraceRecorder;
+
 class MiBand3 : public QObject {
   Q_OBJECT
 public:
@@ -16,7 +25,52 @@ public:
   static constexpr char CharAuthUuid[] = "00000009-0000-3512-2118-0009af100700";
   static constexpr char CharStepsUuid[] = "00000007-0000-3512-2118-0009af100700";
   static constexpr char CharSensorUuid[] = "00000001-0000-3512-2118-0009af100700";
+  static constexpr char CharSensorDataUuid[] = "00000002-0000-3512-2118-0009af100700";
+  // Bluetooth SIG company identifier of Huami, in the band's manufacturer data.
+  static constexpr quint16 ManufacturerId = 0x0157;
+  // Connection progress; every state has a deadline after which recovery kicks in.
+  enum State { Idle, Scanning, Connecting, Discovering, Authenticating, Subscribing, Streaming, StateCount };
+  Q_ENUM(State)
+
   MiBand3(QObject *parent = nullptr);
+
+  State state() const { return m_state; }
+  // 0 disables the deadline. The Streaming deadline is the HR stall watchdog window.
+  void setStateDeadline(State state, int ms) { m_stateDeadlines[state] = ms; }
+  qint64 timeInState(State state) const { return m_timeInState[state]; }
+  // Enters a state without a link, e.g. Subscribing so replayed HR notifications take the
+  // live Streaming path. For TraceReplayer's allocation check; Idle leaves it again.
+  void simulateState(State state) { setState(state); }
+
+  // Lets the placement pick the local adapter and keeps other sessions off our band.
+  void setPlacement(BandPlacement *placement);
+  QBluetoothAddress localAdapter() const { return m_localAdapter; }
+  void setTraceRecorder(TraceRecorder *recorder) { m_recorder = recorder; }
+  // Streams raw accelerometer and PPG data next to HR once subscribed.
+  void setRawSensorEnabled(bool enabled) { m_rawSensorEnabled = enabled; }
+  RawSensorStream &rawSensorStream() { return m_rawSensor; }
+  uint8_t hr() const { return m_hr; }
+  uint16_t steps() const { return m_steps; }
+  // Period of the HR keep-alive ping and steps read while streaming.
+  void setMeasureInterval(int ms);
+  // Lets the sampling policy drop to one-shot or suspended HR when still, asleep or
+  // off-wrist; otherwise HR is always continuous.
+  void setAdaptiveSampling(bool enabled) { m_adaptive = enabled; }
+  const HrSamplingPolicy &samplingPolicy() const { return m_sampling; }
+  // Motion seen elsewhere, e.g. by the raw accelerometer; brings back continuous HR.
+  void noteMotion();
+  // Writes the Immediate Alert level (0 none, 1 mild, 2 high) and returns a token that
+  // alertFinished carries once the band acknowledged it, or failed when the band does not
+  // ack within AlertAckTimeoutMs or the link drops. Returns 0 if the band has no alert
+  // service. Routine pings and steps reads hold off while an alert is unacknowledged.
+  quint32 alert(quint8 level);
+  static constexpr int AlertAckTimeoutMs = 5000;
+  // Checked on every HR notification before the sample is passed on; a rule that fires
+  // vibrates the band.
+  void setAlertRules(const HrAlertRules &rules) { m_alertRules = rules; }
+  // Raw characteristic events, called by the GATT slots and by TraceReplayer.
+  void handleCharacteristicChanged(const QBluetoothUuid &uuid, const QByteArray &value);
+  void handleCharacteristicRead(const QBluetoothUuid &uuid, const QByteArray &value);
 public slots:
   void startSearch();
   void setTime(QDateTime time);
@@ -25,6 +79,10 @@ signals:
   void finished();
   void authenticated();
   void dataChanged(uint8_t hr, uint16_t steps);
+  void stateChanged(MiBand3::State state);
+  // New samples were decoded into rawSensorStream().
+  void rawSensorDataAvailable();
+  void alertFinished(quint32 token, bool ok);
 
 private slots:
   void addDevice(const QBluetoothDeviceInfo &device);
@@ -47,26 +105,89 @@ private slots:
   void confirmedMiBand1DescriptorWrite(const QLowEnergyDescriptor &d, const QByteArray &value);
   void readCharacteristicValue(const QLowEnergyCharacteristic &c, const QByteArray &value);
 
-  void startServicesDiscover();
+  void startMeasureWhenReady();
   void startMeasure();
+  void startRawSensor();
   void keepHRAlive();
+  void pollSteps();
+  void alertAcknowledged(quint32 token, bool ok);
+  void alertAckTimedOut();
+
+  void stateDeadlineExpired();
+  void adapterMoved(QObject *session, const QString &adapter);
 
 private:
+  void createDiscoveryAgent();
+  void setState(State state);
+  int stateDeadline(State state) const;
+  void applySamplingMode();
+  void writeSamplingMode();
+  void checkAlertRules();
+  // Answers the oldest outstanding alert write.
+  void finishAlert(bool ok);
+  void reconnect();
+  void logStateTelemetry();
+  void logConnectLatency();
+
   QBluetoothDeviceDiscoveryAgent *m_deviceDiscoveryAgent = nullptr;
   QBluetoothDeviceInfo m_device;
+  ScanFilter m_scanFilter;
   QLowEnergyController *m_control = nullptr;
   bool m_foundHRService = false;
   bool m_foundMiBand0Service = false;
   bool m_foundMiBand1Service = false;
+  bool m_foundAlertService = false;
   QLowEnergyService *m_hrService = nullptr;
   QLowEnergyService *m_miBand0Service = nullptr;
   QLowEnergyService *m_miBand1Service = nullptr;
+  QLowEnergyService *m_alertService = nullptr;
   QLowEnergyDescriptor m_authNotifDesc, m_hrmNotifDesc;
   bool m_authenticated = false;
   bool m_canBeAuthenticated = false;
+  bool m_hrDiscovered = false;
   QByteArray m_authKey;
   QTimer m_measureTimer;
+  int m_measureInterval{10000};
+  QTimer m_stepsTimer;
+  QTimer m_alertTimer;
+  bool m_adaptive = false;
+  HrSamplingPolicy m_sampling;
+  // A mode change the band has not been told about, held back by an outstanding alert.
+  bool m_samplingModePending = false;
+  QElapsedTimer m_samplingClock;
+  qint64 m_lastSamplingReport{};
+  bool m_stepsKnown = false;
+  HrAlertRules m_alertRules;
+  // Acknowledged writes still waiting; a late ack counts for a timed-out write for as long
+  // as one more timeout.
+  AlertAckQueue m_alertAcks{AlertAckTimeoutMs};
+  quint32 m_lastAlertToken{};
+  // Token of the outstanding rule alert and the notification that fired it, on
+  // m_samplingClock in ns; 0 and -1 if none.
+  quint32 m_ruleAlertToken{};
+  qint64 m_alertNotifiedNs{-1};
+  qint64 m_alertLatencyMin{};
+  qint64 m_alertLatencyMax{};
+  qint64 m_alertLatencySum{};
+  int m_alertCount{};
   QDateTime m_dateTime;
-  uint16_t m_steps;
-  uint8_t m_hr;
+  uint16_t m_steps{};
+  uint8_t m_hr{};
+  TraceRecorder *m_recorder = nullptr;
+  BandPlacement *m_placement = nullptr;
+  bool m_rawSensorEnabled = false;
+  RawSensorStream m_rawSensor;
+  QBluetoothAddress m_localAdapter;
+
+  State m_state = Idle;
+  int m_stateDeadlines[StateCount];
+  qint64 m_timeInState[StateCount]{};
+  int m_stateEntries[StateCount]{};
+  QElapsedTimer m_stateClock;
+  QElapsedTimer m_connectClock;
+  qint64 m_connectPhases[StateCount]{};
+  QTimer m_stateTimer;
+  // Last HR notification while Streaming; the watchdog checks it rather than being re-armed.
+  QElapsedTimer m_lastHrClock;
+  int m_stallRetries{};
 };
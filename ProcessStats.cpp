@@ -0,0 +1,28 @@
+#include "ProcessStats.h"
+#include <QDir>
+#include <QFile>
+#include <QTimer>
+#include <malloc.h>
+#include <unistd.h>
+
+ProcessStats ProcessStats::sample(const QList<QObject *> &roots) {
+  ProcessStats stats;
+  QFile statm("/proc/self/statm");
+  if (statm.open(QIODevice::ReadOnly)) {
+    const QList<QByteArray> fields = statm.readAll().split(' ');
+    stats.rssKb = fields.value(1).toLongLong() * (sysconf(_SC_PAGESIZE) / 1024);
+  }
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  stats.heapBytes = static_cast<qint64>(mallinfo2().uordblks);
+#elif defined(__GLIBC__)
+  stats.heapBytes = static_cast<unsigned int>(mallinfo().uordblks);
+#endif
+  stats.openFds = QDir("/proc/self/fd").entryList(QDir::Files | QDir::System | QDir::NoDotAndDotDot).size();
+  for (QObject *root : roots) {
+    const QList<QObject *> children = root->findChildren<QObject *>();
+    stats.liveObjects += 1 + children.size();
+    for (QObject *o : children)
+      stats.timers += qobject_cast<QTimer *>(o) != nullptr;
+  }
+  return stats;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <QtGlobal>
+
+class QObject;
+
+// Resource usage of this process, for spotting leaks over long runs.
+struct ProcessStats {
+  qint64 rssKb = 0;
+  qint64 heapBytes = 0; // in use by malloc
+  int openFds = 0;
+  int liveObjects = 0; // QObjects reachable from the roots passed to sample()
+  int timers = 0; // QTimers among them
+
+  static ProcessStats sample(const QList<QObject *> &roots);
+};
@@ -0,0 +1,50 @@
+#include "RawSensorStream.h"
+#include <QDebug>
+#include <QtEndian>
+
+RawSensorStream::RawSensorStream() { m_statsClock.start(); }
+
+void RawSensorStream::reset() { m_lastSequence = -1; }
+
+void RawSensorStream::decode(const QByteArray &packet) {
+  const uchar *p = reinterpret_cast<const uchar *>(packet.constData());
+  const int size = packet.size();
+  if (size < 2) {
+    m_malformed++;
+    return;
+  }
+  m_packets++;
+  // Both packet types share one sequence counter.
+  const int sequence = p[1];
+  if (m_lastSequence >= 0)
+    m_lostPackets += (sequence - m_lastSequence - 1) & 0xff;
+  m_lastSequence = sequence;
+
+  if (p[0] == 1 && size == 20) {
+    for (int i = 0; i < 3; ++i) {
+      const uchar *s = p + 2 + i * 6;
+      const AccelSample sample{qFromLittleEndian<qint16>(s), qFromLittleEndian<qint16>(s + 2), qFromLittleEndian<qint16>(s + 4)};
+      if (!m_accel.push(sample))
+        m_droppedSamples++;
+    }
+    m_accelSamples += 3;
+  } else if (p[0] == 2 && size == 16) {
+    for (int i = 0; i < 7; ++i) {
+      if (!m_ppg.push(qFromLittleEndian<quint16>(p + 2 + i * 2)))
+        m_droppedSamples++;
+    }
+    m_ppgSamples += 7;
+  } else {
+    m_malformed++;
+  }
+}
+
+void RawSensorStream::logStats() {
+  const qint64 ms = m_statsClock.restart();
+  if (ms <= 0)
+    return;
+  qDebug() << "Raw sensor:" << (m_accelSamples - m_statsAccel) * 1000.0 / ms << "accel/s," << (m_ppgSamples - m_statsPpg) * 1000.0 / ms << "ppg/s,"
+           << m_lostPackets << "lost packets," << m_droppedSamples << "dropped samples," << m_malformed << "malformed";
+  m_statsAccel = m_accelSamples;
+  m_statsPpg = m_ppgSamples;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "SensorRing.h"
+#include <QByteArray>
+#include <QElapsedTimer>
+
+// Decodes the band's raw sensor notifications (sensor data characteristic) into
+// preallocated rings: 3-axis accelerometer and PPG samples.
+//
+// Packet: uint8 type, uint8 sequence, payload.
+//   type 1, 20 bytes: 3 accelerometer samples of int16 x, y, z (little endian)
+//   type 2, 16 bytes: 7 PPG samples of uint16 (little endian)
+class RawSensorStream {
+public:
+  struct AccelSample {
+    qint16 x, y, z;
+  };
+  static_assert(sizeof(AccelSample) == 6, "read as interleaved x, y, z by ActivityDetector");
+  static constexpr int AccelCapacity = 4096;
+  static constexpr int PpgCapacity = 4096;
+
+  RawSensorStream();
+  void decode(const QByteArray &packet);
+  void reset();
+
+  int readAccel(AccelSample *out, int max) { return m_accel.read(out, max); }
+  int readPpg(quint16 *out, int max) { return m_ppg.read(out, max); }
+
+  quint64 packets() const { return m_packets; }
+  quint64 accelSamples() const { return m_accelSamples; }
+  quint64 ppgSamples() const { return m_ppgSamples; }
+  quint64 lostPackets() const { return m_lostPackets; }
+  quint64 droppedSamples() const { return m_droppedSamples; }
+  // Logs sample rates since the previous call and the drop counters.
+  void logStats();
+
+private:
+  SensorRing<AccelSample, AccelCapacity> m_accel;
+  SensorRing<quint16, PpgCapacity> m_ppg;
+  int m_lastSequence = -1;
+  quint64 m_packets{};
+  quint64 m_accelSamples{};
+  quint64 m_ppgSamples{};
+  quint64 m_lostPackets{};
+  quint64 m_droppedSamples{};
+  quint64 m_malformed{};
+  QElapsedTimer m_statsClock;
+  quint64 m_statsAccel{};
+  quint64 m_statsPpg{};
+};
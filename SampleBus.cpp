@@ -0,0 +1,119 @@
+#include "SampleBus.h"
+#include <QDateTime>
+#include <QDebug>
+#include <algorithm>
+#include <cerrno>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+static int roundUpToPowerOfTwo(int v) {
+  int p = 1;
+  while (p < v)
+    p <<= 1;
+  return p;
+}
+
+SampleBus::SampleBus(int capacity, QObject *parent) : QObject(parent) {
+  m_ring.resize(roundUpToPowerOfTwo(std::max(capacity, 2)));
+  m_mask = static_cast<quint64>(m_ring.size() - 1);
+
+  m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (m_wakeFd < 0) {
+    perror("Could not create sample bus eventfd");
+    m_synchronous = true;
+    return;
+  }
+  m_wakeNotifier = new QSocketNotifier(m_wakeFd, QSocketNotifier::Read, this);
+  connect(m_wakeNotifier, &QSocketNotifier::activated, this, &SampleBus::notifySinks);
+}
+
+SampleBus::~SampleBus() {
+  if (m_wakeFd >= 0)
+    close(m_wakeFd);
+}
+
+int SampleBus::subscribe(DropPolicy policy, int highWatermark) {
+  if (highWatermark <= 0 || highWatermark > m_ring.size())
+    highWatermark = m_ring.size() * 3 / 4;
+  m_sinks.append(Sink{m_head.load(std::memory_order_acquire), 0, policy, highWatermark, false});
+  return m_sinks.size() - 1;
+}
+
+void SampleBus::catchUp(Sink &sink, quint64 head) {
+  const quint64 capacity = static_cast<quint64>(m_ring.size());
+  if (head - sink.cursor <= capacity)
+    return;
+  const quint64 target = sink.policy == SkipToLatest ? head - 1 : head - capacity;
+  sink.dropped += target - sink.cursor;
+  sink.cursor = target;
+}
+
+const SampleBus::Sample *SampleBus::peek(int sink) {
+  Sink &s = m_sinks[sink];
+  const quint64 head = m_head.load(std::memory_order_acquire);
+  catchUp(s, head);
+  if (s.cursor == head)
+    return nullptr;
+  return &m_ring[static_cast<int>(s.cursor & m_mask)];
+}
+
+void SampleBus::consume(int sink) {
+  Sink &s = m_sinks[sink];
+  if (s.cursor != m_head.load(std::memory_order_acquire))
+    s.cursor++;
+  if (s.lagging && backlog(sink) < static_cast<quint64>(s.highWatermark) / 2)
+    s.lagging = false;
+}
+
+bool SampleBus::read(int sink, Sample &sample) {
+  const Sample *s = peek(sink);
+  if (!s)
+    return false;
+  sample = *s;
+  consume(sink);
+  return true;
+}
+
+quint64 SampleBus::backlog(int sink) const {
+  const quint64 head = m_head.load(std::memory_order_acquire);
+  return std::min(head - m_sinks[sink].cursor, static_cast<quint64>(m_ring.size()));
+}
+
+void SampleBus::publish(uint8_t hr, uint16_t steps) { publishFromBand(0, hr, steps); }
+
+void SampleBus::publishFromBand(uint8_t band, uint8_t hr, uint16_t steps) {
+  publishSample(Sample{QDateTime::currentMSecsSinceEpoch(), SampleType::HeartRate, band, hr, steps});
+}
+
+void SampleBus::publishSample(const SampleBus::Sample &sample) {
+  const quint64 head = m_head.load(std::memory_order_relaxed);
+  m_ring[static_cast<int>(head & m_mask)] = sample;
+  m_head.store(head + 1, std::memory_order_release);
+
+  for (int i = 0; i < m_sinks.size(); ++i) {
+    Sink &s = m_sinks[i];
+    const quint64 pending = head + 1 - s.cursor;
+    if (!s.lagging && pending >= static_cast<quint64>(s.highWatermark)) {
+      s.lagging = true;
+      qWarning() << "Sample bus sink" << i << "is lagging, backlog" << pending;
+      emit sinkLagging(i, pending);
+    }
+  }
+
+  if (m_synchronous) {
+    emit samplesAvailable();
+  } else if (!m_notifyPending) {
+    m_notifyPending = true;
+    const quint64 one = 1;
+    if (::write(m_wakeFd, &one, sizeof(one)) < 0)
+      perror("Could not wake sample bus");
+  }
+}
+
+void SampleBus::notifySinks() {
+  quint64 count;
+  if (::read(m_wakeFd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+    perror("Could not read sample bus eventfd");
+  m_notifyPending = false;
+  emit samplesAvailable();
+}
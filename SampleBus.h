@@ -0,0 +1,75 @@
+#pragma once
+#include <QObject>
+#include <QSocketNotifier>
+#include <QVector>
+#include <atomic>
+
+// Single-writer ring of timestamped samples. Every sink owns a cursor into the ring
+// and reads at its own pace; the writer never waits for a sink.
+class SampleBus : public QObject {
+  Q_OBJECT
+public:
+  enum class SampleType : uint8_t { HeartRate, Steps };
+  // What happens to a sink that fell more than the ring capacity behind.
+  enum DropPolicy { DropOldest, SkipToLatest };
+
+  struct Sample {
+    qint64 timestamp; // ms since epoch
+    SampleType type;
+    uint8_t band; // index of the band session that produced the sample
+    uint8_t hr;
+    uint16_t steps;
+  };
+
+  SampleBus(int capacity = 1024, QObject *parent = nullptr);
+  ~SampleBus();
+
+  // Emit samplesAvailable() from publish() itself instead of from the event loop.
+  void setSynchronous(bool synchronous) { m_synchronous = synchronous; }
+
+  int subscribe(DropPolicy policy = DropOldest, int highWatermark = 0);
+  // Returns the next unread sample of the sink in place, or nullptr when it is up to date.
+  // The pointer stays valid until consume() is called.
+  const Sample *peek(int sink);
+  void consume(int sink);
+  bool read(int sink, Sample &sample);
+  quint64 backlog(int sink) const;
+  quint64 dropped(int sink) const { return m_sinks[sink].dropped; }
+  quint64 published() const { return m_head.load(std::memory_order_relaxed); }
+
+public slots:
+  void publish(uint8_t hr, uint16_t steps);
+  void publishFromBand(uint8_t band, uint8_t hr, uint16_t steps);
+  void publishSample(const SampleBus::Sample &sample);
+
+signals:
+  // Emitted once per event loop iteration after new samples were published.
+  void samplesAvailable();
+  // Emitted when a sink's backlog crosses its high watermark, so it can shed load.
+  void sinkLagging(int sink, quint64 backlog);
+
+private slots:
+  void notifySinks();
+
+private:
+  struct Sink {
+    quint64 cursor;
+    quint64 dropped;
+    DropPolicy policy;
+    int highWatermark;
+    bool lagging;
+  };
+  void catchUp(Sink &sink, quint64 head);
+
+  QVector<Sample> m_ring;
+  quint64 m_mask;
+  std::atomic<quint64> m_head{0};
+  QVector<Sink> m_sinks;
+  bool m_notifyPending = false;
+  bool m_synchronous = false;
+  // Wakes the event loop without allocating, unlike a queued call or a timer.
+  int m_wakeFd = -1;
+  QSocketNotifier *m_wakeNotifier = nullptr;
+};
+
+Q_DECLARE_METATYPE(SampleBus::Sample)
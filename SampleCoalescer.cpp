@@ -0,0 +1,51 @@
+#include "SampleCoalescer.h"
+#include "Logging.h"
+
+SampleCoalescer::SampleCoalescer(QObject *parent) : QObject(parent) {
+  m_flushTimer.setSingleShot(true);
+  connect(&m_flushTimer, &QTimer::timeout, this, &SampleCoalescer::flush);
+}
+
+void SampleCoalescer::push(uint8_t hr, uint16_t steps) {
+  m_hr = hr;
+  m_steps = steps;
+
+  const bool changed = !m_hasSent || hr != m_sentHr || steps != m_sentSteps;
+  if (!changed && m_lastSent.elapsed() < m_maxStaleness) {
+    m_suppressed++;
+    return;
+  }
+
+  if (m_hasSent && m_lastSent.elapsed() < m_minInterval) {
+    // A newer value replaces the pending one, so the earlier one never reaches the bus.
+    if (m_pending)
+      m_suppressed++;
+    m_pending = true;
+    if (!m_flushTimer.isActive())
+      m_flushTimer.start(static_cast<int>(m_minInterval - m_lastSent.elapsed()));
+    return;
+  }
+
+  m_pending = true;
+  flush();
+}
+
+void SampleCoalescer::flush() {
+  if (!m_pending)
+    return;
+  m_pending = false;
+  m_flushTimer.stop();
+  // The pending pair may have gone back to what the ESP32 already has.
+  if (m_hasSent && m_hr == m_sentHr && m_steps == m_sentSteps && m_lastSent.elapsed() < m_maxStaleness) {
+    m_suppressed++;
+    return;
+  }
+  m_sentHr = m_hr;
+  m_sentSteps = m_steps;
+  m_hasSent = true;
+  m_lastSent.start();
+  m_forwarded++;
+  if (m_forwarded % 100 == 0)
+    qCDebug(lcData) << "Coalescer: forwarded" << m_forwarded << "suppressed" << m_suppressed;
+  emit dataChanged(m_sentHr, m_sentSteps);
+}
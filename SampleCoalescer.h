@@ -0,0 +1,40 @@
+#pragma once
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+
+// Keeps only the latest HR/steps pair and forwards it when it changed or got stale,
+// never faster than the configured minimum interval.
+class SampleCoalescer : public QObject {
+  Q_OBJECT
+public:
+  SampleCoalescer(QObject *parent = nullptr);
+
+  void setMinInterval(int ms) { m_minInterval = ms; }
+  void setMaxStaleness(int ms) { m_maxStaleness = ms; }
+  quint64 forwarded() const { return m_forwarded; }
+  quint64 suppressed() const { return m_suppressed; }
+
+public slots:
+  void push(uint8_t hr, uint16_t steps);
+
+signals:
+  void dataChanged(uint8_t hr, uint16_t steps);
+
+private slots:
+  void flush();
+
+private:
+  int m_minInterval{1000};
+  int m_maxStaleness{30000};
+  QTimer m_flushTimer;
+  QElapsedTimer m_lastSent;
+  bool m_pending = false;
+  bool m_hasSent = false;
+  uint8_t m_hr{};
+  uint16_t m_steps{};
+  uint8_t m_sentHr{};
+  uint16_t m_sentSteps{};
+  quint64 m_forwarded{};
+  quint64 m_suppressed{};
+};
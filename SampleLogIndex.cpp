@@ -0,0 +1,141 @@
+#include "SampleLogIndex.h"
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+
+static constexpr int ReadChunk = 64 * 1024;
+
+static bool parseNumber(const char *&p, const char *end, qint64 &v) {
+  const char *start = p;
+  v = 0;
+  while (p < end && *p >= '0' && *p <= '9')
+    v = v * 10 + (*p++ - '0');
+  return p != start;
+}
+
+bool parseSampleLine(const char *line, const char *end, SampleBus::Sample &sample) {
+  qint64 timestamp, band, hr, steps;
+  const char *p = line;
+  if (!parseNumber(p, end, timestamp) || p == end || *p++ != ';' || !parseNumber(p, end, band) || p == end || *p++ != ';' || !parseNumber(p, end, hr) ||
+      p == end || *p++ != ';' || !parseNumber(p, end, steps))
+    return false;
+  sample = SampleBus::Sample{timestamp, SampleBus::SampleType::HeartRate, static_cast<uint8_t>(band), static_cast<uint8_t>(hr), static_cast<uint16_t>(steps)};
+  return true;
+}
+
+SampleLogIndex::SampleLogIndex(const QString &logFile) : m_logFile(logFile), m_sidecar(logFile + ".idx") {
+  // A torn write leaves a partial entry; appending after it would misalign every later one.
+  bool whole = false;
+  if (m_sidecar.open(QIODevice::ReadOnly)) {
+    const QByteArray data = m_sidecar.readAll();
+    m_sidecar.close();
+    whole = data.size() % static_cast<int>(sizeof(Entry)) == 0;
+    m_entries.resize(data.size() / static_cast<int>(sizeof(Entry)));
+    memcpy(m_entries.data(), data.constData(), m_entries.size() * sizeof(Entry));
+  }
+  const bool ordered = std::adjacent_find(m_entries.cbegin(), m_entries.cend(), [](const Entry &a, const Entry &b) { return b.offset <= a.offset; }) == m_entries.cend();
+  // Trust the saved index only if its last entry still points at the line it recorded.
+  QFile log(m_logFile);
+  bool valid = whole && ordered && !m_entries.isEmpty() && log.open(QIODevice::ReadOnly) && m_entries.last().offset < log.size();
+  if (valid) {
+    log.seek(m_entries.last().offset);
+    const QByteArray line = log.readLine(64);
+    SampleBus::Sample s;
+    valid = parseSampleLine(line.constData(), line.constData() + line.size(), s) && s.timestamp == m_entries.last().timestamp;
+  }
+  if (valid)
+    m_indexed = m_entries.last().offset;
+  else
+    reset();
+  m_sidecar.open(QIODevice::WriteOnly | QIODevice::Append);
+}
+
+void SampleLogIndex::reset() {
+  m_entries.clear();
+  m_indexed = 0;
+  if (m_sidecar.isOpen())
+    m_sidecar.close();
+  m_sidecar.open(QIODevice::WriteOnly | QIODevice::Truncate);
+  m_sidecar.close();
+}
+
+void SampleLogIndex::update() {
+  QFile log(m_logFile);
+  if (!log.open(QIODevice::ReadOnly))
+    return;
+  if (log.size() < m_indexed) {
+    qWarning() << "Sample log" << m_logFile << "shrank, rebuilding its index";
+    reset();
+    m_sidecar.open(QIODevice::WriteOnly | QIODevice::Append);
+  }
+  if (!log.seek(m_indexed))
+    return;
+
+  const int before = m_entries.size();
+  QByteArray chunk;
+  while (!(chunk = log.read(ReadChunk)).isEmpty()) {
+    const char *data = chunk.constData();
+    const char *end = data + chunk.size();
+    const char *line = data;
+    while (const char *nl = static_cast<const char *>(memchr(line, '\n', end - line))) {
+      const qint64 offset = m_indexed + (line - data);
+      SampleBus::Sample s;
+      if ((m_entries.isEmpty() || offset - m_entries.last().offset >= Stride) && parseSampleLine(line, nl, s))
+        m_entries.append(Entry{s.timestamp, offset});
+      line = nl + 1;
+    }
+    // A partial last line is read again next time.
+    m_indexed += line - data;
+    if (line == data)
+      break;
+    log.seek(m_indexed);
+  }
+  if (m_entries.size() > before) {
+    m_sidecar.write(reinterpret_cast<const char *>(m_entries.constData() + before), (m_entries.size() - before) * static_cast<int>(sizeof(Entry)));
+    m_sidecar.flush();
+  }
+}
+
+qint64 SampleLogIndex::seek(qint64 timestamp) const {
+  // Last entry before t, one more back for lines written out of order around it.
+  auto it = std::lower_bound(m_entries.begin(), m_entries.end(), timestamp - ReorderSlackMs, [](const Entry &e, qint64 t) { return e.timestamp < t; });
+  const int i = static_cast<int>(it - m_entries.begin()) - 1;
+  return i > 0 ? m_entries[i - 1].offset : 0;
+}
+
+SampleLogIndex::Cursor::Cursor(const SampleLogIndex &index, qint64 from, qint64 to, int band) : m_file(index.logFile()), m_from(from), m_to(to), m_band(band) {
+  m_done = from >= to || !m_file.open(QIODevice::ReadOnly) || !m_file.seek(index.seek(from));
+}
+
+bool SampleLogIndex::Cursor::fill() {
+  m_buffer.remove(0, m_pos);
+  m_pos = 0;
+  const QByteArray more = m_file.read(ReadChunk);
+  m_buffer.append(more);
+  return !more.isEmpty();
+}
+
+int SampleLogIndex::Cursor::read(SampleBus::Sample *out, int max) {
+  int n = 0;
+  while (!m_done && n < max) {
+    const char *data = m_buffer.constData();
+    const char *nl = static_cast<const char *>(memchr(data + m_pos, '\n', m_buffer.size() - m_pos));
+    if (!nl) {
+      if (!fill())
+        m_done = true;
+      continue;
+    }
+    SampleBus::Sample s;
+    const bool ok = parseSampleLine(data + m_pos, nl, s);
+    m_pos = static_cast<int>(nl - data) + 1;
+    if (!ok)
+      continue;
+    if (s.timestamp >= m_to + ReorderSlackMs) {
+      m_done = true;
+      break;
+    }
+    if (s.timestamp >= m_from && s.timestamp < m_to && (m_band < 0 || s.band == m_band))
+      out[n++] = s;
+  }
+  return n;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "SampleBus.h"
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+// Sparse timestamp index over a SampleLogSink file: the timestamp and offset of the first
+// line in every Stride bytes, so range reads seek instead of scanning from the start.
+// Saved next to the log as "<log>.idx" and extended with the lines appended since.
+class SampleLogIndex {
+public:
+  static constexpr qint64 Stride = 4096;
+  // Samples from concurrent sessions can hit the log a little out of order.
+  static constexpr qint64 ReorderSlackMs = 1000;
+
+  explicit SampleLogIndex(const QString &logFile);
+
+  // Indexes the lines appended since the last call.
+  void update();
+  // Offset to start reading at so that no line with a timestamp >= t is skipped.
+  qint64 seek(qint64 timestamp) const;
+  QString logFile() const { return m_logFile; }
+  int entries() const { return m_entries.size(); }
+
+  // Reads the samples of one band, or all with band -1, with timestamps in [from, to).
+  class Cursor {
+  public:
+    Cursor(const SampleLogIndex &index, qint64 from, qint64 to, int band = -1);
+    // Returns up to max samples, 0 once the range is exhausted.
+    int read(SampleBus::Sample *out, int max);
+
+  private:
+    bool fill();
+
+    QFile m_file;
+    QByteArray m_buffer;
+    int m_pos = 0;
+    qint64 m_from, m_to;
+    int m_band;
+    bool m_done = false;
+  };
+
+private:
+  struct Entry {
+    qint64 timestamp;
+    qint64 offset;
+  };
+  void reset();
+
+  QString m_logFile;
+  QFile m_sidecar;
+  QVector<Entry> m_entries;
+  qint64 m_indexed = 0; // end of the last complete line seen
+};
+
+// Parses a "timestamp;band;hr;steps" line; false if it is malformed.
+bool parseSampleLine(const char *line, const char *end, SampleBus::Sample &sample);
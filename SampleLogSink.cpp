@@ -0,0 +1,21 @@
+#include "SampleLogSink.h"
+#include <QDebug>
+
+SampleLogSink::SampleLogSink(SampleBus *bus, const QString &fileName, QObject *parent) : QObject(parent), m_bus(bus), m_file(fileName) {
+  m_sink = m_bus->subscribe(SampleBus::DropOldest);
+  if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+    qCritical() << "Could not open sample log" << fileName << ':' << m_file.errorString();
+    return;
+  }
+  connect(m_bus, &SampleBus::samplesAvailable, this, &SampleLogSink::drain);
+}
+
+void SampleLogSink::drain() {
+  char line[64];
+  while (const SampleBus::Sample *s = m_bus->peek(m_sink)) {
+    auto len = snprintf(line, sizeof(line), "%lld;%hhu;%hhu;%hu\n", static_cast<long long>(s->timestamp), s->band, s->hr, s->steps);
+    m_bus->consume(m_sink);
+    m_file.write(line, len);
+  }
+  m_file.flush();
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include "SampleBus.h"
+#include <QFile>
+#include <QObject>
+
+// Appends every sample on the bus as a "timestamp;band;hr;steps" line to a file.
+class SampleLogSink : public QObject {
+  Q_OBJECT
+public:
+  SampleLogSink(SampleBus *bus, const QString &fileName, QObject *parent = nullptr);
+
+private slots:
+  void drain();
+
+private:
+  SampleBus *m_bus;
+  int m_sink;
+  QFile m_file;
+};
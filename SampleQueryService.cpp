@@ -0,0 +1,242 @@
+#include "SampleQueryService.h"
+#include <QDebug>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static constexpr int MaxConnections = 8;
+static constexpr int MaxRequestLine = 256;
+// Pipelined requests buffered before reading pauses until answers go out.
+static constexpr int MaxPendingInput = 4 * MaxRequestLine;
+// Output kept ready per connection before waiting for the client to read.
+static constexpr int OutputHighWater = 64 * 1024;
+
+struct SampleQueryService::Connection {
+  int fd = -1;
+  QSocketNotifier *readNotifier = nullptr;
+  QSocketNotifier *writeNotifier = nullptr;
+  QByteArray in;
+  QByteArray out;
+  std::unique_ptr<SampleLogIndex::Cursor> cursor;
+  quint64 rows = 0;
+  // The client shut down its side; closed once everything asked for is sent.
+  bool eof = false;
+};
+
+SampleQueryService::SampleQueryService(const QString &socketPath, SampleLogIndex *index, SampleRollups *rollups, QObject *parent)
+    : QObject(parent), m_path(socketPath), m_index(index), m_rollups(rollups) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  const QByteArray path = m_path.toLocal8Bit();
+  if (path.size() >= static_cast<int>(sizeof(addr.sun_path))) {
+    qCritical() << "Query socket path too long:" << m_path;
+    return;
+  }
+  memcpy(addr.sun_path, path.constData(), path.size());
+  unlink(path.constData());
+  m_listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (m_listenFd < 0 || bind(m_listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || listen(m_listenFd, MaxConnections) < 0) {
+    perror("Could not listen on query socket");
+    if (m_listenFd >= 0)
+      close(m_listenFd);
+    m_listenFd = -1;
+    return;
+  }
+  m_listenNotifier = new QSocketNotifier(m_listenFd, QSocketNotifier::Read, this);
+  connect(m_listenNotifier, &QSocketNotifier::activated, this, &SampleQueryService::acceptConnection);
+  qDebug() << "Answering sample queries on" << m_path;
+}
+
+SampleQueryService::~SampleQueryService() {
+  for (auto &c : m_connections)
+    close(c->fd);
+  if (m_listenFd >= 0) {
+    close(m_listenFd);
+    unlink(m_path.toLocal8Bit().constData());
+  }
+}
+
+void SampleQueryService::acceptConnection() {
+  const int fd = accept4(m_listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (fd >= 0)
+    adopt(fd);
+}
+
+bool SampleQueryService::adopt(int fd) {
+  if (static_cast<int>(m_connections.size()) >= MaxConnections) {
+    static const char busy[] = "ERR busy\n";
+    (void)send(fd, busy, sizeof(busy) - 1, MSG_NOSIGNAL);
+    close(fd);
+    return false;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  m_connections.emplace_back(new Connection);
+  Connection *c = m_connections.back().get();
+  c->fd = fd;
+  c->readNotifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+  c->writeNotifier = new QSocketNotifier(fd, QSocketNotifier::Write, this);
+  c->writeNotifier->setEnabled(false);
+  connect(c->readNotifier, &QSocketNotifier::activated, this, [this, c]() { readRequests(c); });
+  connect(c->writeNotifier, &QSocketNotifier::activated, this, [this, c]() { pump(c); });
+  return true;
+}
+
+void SampleQueryService::readRequests(Connection *c) {
+  char buffer[1024];
+  const ssize_t n = recv(c->fd, buffer, sizeof(buffer), 0);
+  if (n < 0 && errno != EAGAIN && errno != EINTR) {
+    drop(c);
+    return;
+  }
+  if (n == 0) {
+    c->eof = true;
+    c->readNotifier->setEnabled(false);
+  }
+  if (n > 0)
+    c->in.append(buffer, static_cast<int>(n));
+  // The line being received, after any complete ones still waiting.
+  if (c->in.size() - (c->in.lastIndexOf('\n') + 1) > MaxRequestLine) {
+    drop(c);
+    return;
+  }
+  pump(c);
+}
+
+void SampleQueryService::handle(Connection *c, const QByteArray &request) {
+  const QList<QByteArray> args = request.simplified().split(' ');
+  const QByteArray &verb = args.first();
+  bool ok = true;
+  auto number = [&args, &ok](int i) {
+    bool valid = false;
+    const qint64 v = args.value(i).toLongLong(&valid);
+    ok = ok && valid;
+    return v;
+  };
+  c->rows = 0;
+
+  if (verb == "RANGE" && args.size() == 4) {
+    const int band = args[1] == "*" ? -1 : static_cast<int>(number(1));
+    const qint64 from = number(2), to = number(3);
+    if (!ok || !m_index) {
+      c->out.append(m_index ? "ERR bad request\n" : "ERR no sample log\n");
+      return;
+    }
+    m_index->update();
+    c->cursor.reset(new SampleLogIndex::Cursor(*m_index, from, to, band));
+  } else if (verb == "POINT" && args.size() == 3) {
+    const int band = static_cast<int>(number(1));
+    const qint64 t = number(2);
+    if (!ok || !m_index) {
+      c->out.append(m_index ? "ERR bad request\n" : "ERR no sample log\n");
+      return;
+    }
+    m_index->update();
+    // Widening windows, so a busy band answers from the last block or two.
+    SampleBus::Sample last{}, batch[256];
+    bool found = false;
+    for (qint64 window : {60'000LL, 3'600'000LL, 86'400'000LL}) {
+      SampleLogIndex::Cursor cursor(*m_index, t - window, t + 1, band);
+      while (int n = cursor.read(batch, 256)) {
+        for (int i = 0; i < n; ++i) {
+          if (!found || batch[i].timestamp >= last.timestamp)
+            last = batch[i];
+          found = true;
+        }
+      }
+      if (found)
+        break;
+    }
+    if (found)
+      c->out.append(QByteArray::number(last.timestamp) + ';' + QByteArray::number(last.band) + ';' + QByteArray::number(last.hr) + ';' +
+                    QByteArray::number(last.steps) + '\n');
+    c->out.append("END " + QByteArray::number(found ? 1 : 0) + '\n');
+  } else if (verb == "AGG" && (args.size() == 4 || args.size() == 5)) {
+    const quint8 band = static_cast<quint8>(number(1));
+    const qint64 from = number(2), to = number(3);
+    static const QList<QByteArray> names = {"1m", "15m", "1h", "1d"};
+    const int named = args.size() == 5 ? names.indexOf(args[4]) : -1;
+    if (!ok || !m_rollups || (args.size() == 5 && named < 0)) {
+      c->out.append(m_rollups ? "ERR bad request\n" : "ERR no rollups\n");
+      return;
+    }
+    const auto resolution = named >= 0 ? static_cast<SampleRollups::Resolution>(named) : SampleRollups::resolutionFor(to - from);
+    const QVector<SampleRollups::Row> rows = m_rollups->query(resolution, band, from, to);
+    char line[96];
+    for (const SampleRollups::Row &r : rows) {
+      const int len = snprintf(line, sizeof(line), "%lld;%u;%.1f;%u;%u;%u\n", static_cast<long long>(r.start), r.count, r.hrMean(), r.count ? r.hrMin : 0u,
+                               static_cast<unsigned>(r.hrMax), r.steps);
+      c->out.append(line, len);
+    }
+    c->out.append("END " + QByteArray::number(rows.size()) + '\n');
+  } else {
+    c->out.append("ERR bad request\n");
+  }
+}
+
+void SampleQueryService::pump(Connection *c) {
+  for (;;) {
+    // Next request once the previous answer is fully generated.
+    while (!c->cursor && c->out.size() < OutputHighWater) {
+      const int nl = c->in.indexOf('\n');
+      if (nl < 0)
+        break;
+      const QByteArray request = c->in.left(nl);
+      c->in.remove(0, nl + 1);
+      handle(c, request);
+    }
+    if (c->cursor) {
+      SampleBus::Sample batch[256];
+      char line[64];
+      while (c->out.size() < OutputHighWater) {
+        const int n = c->cursor->read(batch, 256);
+        if (n == 0) {
+          c->cursor.reset();
+          c->out.append("END " + QByteArray::number(c->rows) + '\n');
+          break;
+        }
+        for (int i = 0; i < n; ++i) {
+          const SampleBus::Sample &s = batch[i];
+          const int len = snprintf(line, sizeof(line), "%lld;%hhu;%hhu;%hu\n", static_cast<long long>(s.timestamp), s.band, s.hr, s.steps);
+          c->out.append(line, len);
+        }
+        c->rows += n;
+      }
+    }
+
+    if (c->out.isEmpty())
+      break;
+    const ssize_t sent = send(c->fd, c->out.constData(), c->out.size(), MSG_NOSIGNAL);
+    if (sent < 0 && errno != EAGAIN && errno != EINTR) {
+      drop(c);
+      return;
+    }
+    if (sent > 0)
+      c->out.remove(0, static_cast<int>(sent));
+    // The socket is full; carry on when the client has read some.
+    if (!c->out.isEmpty())
+      break;
+  }
+  c->writeNotifier->setEnabled(!c->out.isEmpty());
+  if (c->eof && c->out.isEmpty() && !c->cursor && c->in.indexOf('\n') < 0) {
+    drop(c);
+    return;
+  }
+  c->readNotifier->setEnabled(!c->eof && c->in.size() < MaxPendingInput);
+}
+
+void SampleQueryService::drop(Connection *c) {
+  c->readNotifier->setEnabled(false);
+  c->writeNotifier->setEnabled(false);
+  c->readNotifier->deleteLater();
+  c->writeNotifier->deleteLater();
+  close(c->fd);
+  for (auto it = m_connections.begin(); it != m_connections.end(); ++it) {
+    if (it->get() == c) {
+      m_connections.erase(it);
+      break;
+    }
+  }
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "SampleLogIndex.h"
+#include "SampleRollups.h"
+#include <QObject>
+#include <QSocketNotifier>
+#include <memory>
+#include <vector>
+
+// Answers queries over past samples on a Unix stream socket, one request line at a time:
+//
+//   RANGE <band|*> <from> <to>       samples as "timestamp;band;hr;steps" lines
+//   POINT <band> <t>                 the last sample at or before t, within a day
+//   AGG <band> <from> <to> [1m|15m|1h|1d]
+//                                    rollups as "start;count;mean;min;max;steps" lines,
+//                                    at the finest resolution under 500 rows if omitted
+//
+// Times are ms since epoch, ranges are [from, to). Every answer ends with "END <rows>" or is
+// a single "ERR <reason>" line. Ranges are streamed as the client reads, never buffered whole,
+// and requests are read only as fast as they are answered. A client that shuts down its
+// write side still gets every answer before the connection closes.
+class SampleQueryService : public QObject {
+  Q_OBJECT
+public:
+  // index or rollups may be null, their queries then fail.
+  SampleQueryService(const QString &socketPath, SampleLogIndex *index, SampleRollups *rollups, QObject *parent = nullptr);
+  ~SampleQueryService();
+
+  // Serves an already connected stream socket, e.g. one end of a socketpair; takes the fd.
+  // Returns false, and closes it, when MaxConnections are open.
+  bool adopt(int fd);
+
+private slots:
+  void acceptConnection();
+
+private:
+  struct Connection;
+  void readRequests(Connection *c);
+  void handle(Connection *c, const QByteArray &request);
+  // Fills the output from the open cursor and writes as much as the socket takes.
+  void pump(Connection *c);
+  void drop(Connection *c);
+
+  QString m_path;
+  int m_listenFd = -1;
+  QSocketNotifier *m_listenNotifier = nullptr;
+  SampleLogIndex *m_index;
+  SampleRollups *m_rollups;
+  std::vector<std::unique_ptr<Connection>> m_connections;
+};
@@ -0,0 +1,245 @@
+#include "SampleRollups.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+const qint64 SampleRollups::ResolutionMs[ResolutionCount] = {60'000, 900'000, 3'600'000, 86'400'000};
+const int SampleRollups::RetentionDays[ResolutionCount] = {14, 180, 1095, 0};
+
+static const char *const ResolutionNames[SampleRollups::ResolutionCount] = {"1m", "15m", "1h", "1d"};
+// "MB3R", uint8 version, 3 bytes padding so rows stay 8-byte aligned.
+static const char FileHeader[8] = {'M', 'B', '3', 'R', 1, 0, 0, 0};
+
+static SampleRollups::Row emptyRow(qint64 start, quint8 band) {
+  SampleRollups::Row row;
+  memset(&row, 0, sizeof(row));
+  row.start = start;
+  row.band = band;
+  row.hrMin = 255;
+  return row;
+}
+
+SampleRollups::SampleRollups(SampleBus *bus, const QString &directory, QObject *parent) : QObject(parent), m_bus(bus), m_directory(directory) {
+  if (!QDir().mkpath(m_directory))
+    qCritical() << "Could not create rollup directory" << m_directory;
+  load();
+  if (m_bus) {
+    m_sink = m_bus->subscribe(SampleBus::DropOldest);
+    connect(m_bus, &SampleBus::samplesAvailable, this, &SampleRollups::drain);
+  }
+}
+
+SampleRollups::~SampleRollups() {
+  // Resumed by load() if the next sample falls into the same minute.
+  for (auto it = m_series.begin(); it != m_series.end(); ++it) {
+    if (!it->hasOpen[Minute])
+      continue;
+    Row row = it->open[Minute];
+    row.flags |= Partial;
+    persist(Minute, row);
+  }
+}
+
+QString SampleRollups::fileName(Resolution resolution) const {
+  return QDir(m_directory).filePath(QString("rollups-%1.bin").arg(ResolutionNames[resolution]));
+}
+
+void SampleRollups::drain() {
+  while (const SampleBus::Sample *s = m_bus->peek(m_sink)) {
+    add(*s);
+    m_bus->consume(m_sink);
+  }
+}
+
+void SampleRollups::add(const SampleBus::Sample &sample) {
+  Series &series = m_series[sample.band];
+  const qint64 start = sample.timestamp - sample.timestamp % ResolutionMs[Minute];
+  // A sample from before the open minute (host clock stepped back) stays in that minute.
+  if (series.hasOpen[Minute] && start > series.open[Minute].start)
+    close(series, Minute, true);
+  if (!series.hasOpen[Minute]) {
+    series.open[Minute] = emptyRow(start, sample.band);
+    series.hasOpen[Minute] = true;
+  }
+
+  Row &row = series.open[Minute];
+  if (sample.hr) {
+    row.count++;
+    row.hrSum += sample.hr;
+    row.hrMin = std::min(row.hrMin, sample.hr);
+    row.hrMax = std::max(row.hrMax, sample.hr);
+  }
+  if (sample.steps == 0 && !series.stepsRead)
+    return;
+  series.stepsRead = true;
+  if (series.hasSteps && sample.steps < series.lastSteps) {
+    // The band's counter restarts at midnight; going back within a day is a stale reading.
+    if (QDateTime::fromMSecsSinceEpoch(sample.timestamp).date() == QDateTime::fromMSecsSinceEpoch(series.lastStepsAt).date())
+      return;
+    row.steps += sample.steps;
+  } else if (series.hasSteps) {
+    row.steps += sample.steps - series.lastSteps;
+  }
+  series.hasSteps = true;
+  series.lastSteps = sample.steps;
+  series.lastStepsAt = sample.timestamp;
+  row.lastSteps = sample.steps;
+}
+
+void SampleRollups::merge(Series &series, quint8 band, Resolution resolution, const Row &row, bool cascade) {
+  const qint64 start = row.start - row.start % ResolutionMs[resolution];
+  if (series.hasOpen[resolution] && start > series.open[resolution].start)
+    close(series, resolution, cascade);
+  if (!series.hasOpen[resolution]) {
+    series.open[resolution] = emptyRow(start, band);
+    series.hasOpen[resolution] = true;
+  }
+  Row &open = series.open[resolution];
+  if (row.count) {
+    open.count += row.count;
+    open.hrSum += row.hrSum;
+    open.hrMin = std::min(open.hrMin, row.hrMin);
+    open.hrMax = std::max(open.hrMax, row.hrMax);
+  }
+  open.steps += row.steps;
+  open.lastSteps = row.lastSteps;
+}
+
+void SampleRollups::close(Series &series, Resolution resolution, bool cascade) {
+  Row row = series.open[resolution];
+  row.flags = 0;
+  series.hasOpen[resolution] = false;
+  QVector<Row> &rows = series.rows[resolution];
+  rows.append(row);
+  persist(resolution, row);
+
+  // Expired rows go in bulk about once a day rather than one by one.
+  if (RetentionDays[resolution]) {
+    const qint64 cutoff = row.start - RetentionDays[resolution] * ResolutionMs[Day];
+    if (rows.first().start < cutoff - ResolutionMs[Day]) {
+      auto end = std::lower_bound(rows.begin(), rows.end(), cutoff, [](const Row &r, qint64 t) { return r.start < t; });
+      rows.erase(rows.begin(), end);
+    }
+  }
+  if (cascade && resolution + 1 < ResolutionCount)
+    merge(series, row.band, static_cast<Resolution>(resolution + 1), row, true);
+}
+
+void SampleRollups::persist(Resolution resolution, const Row &row) {
+  QFile &file = m_files[resolution];
+  if (!file.isOpen()) {
+    file.setFileName(fileName(resolution));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+      qCritical() << "Could not open rollups" << file.fileName() << ':' << file.errorString();
+      return;
+    }
+    if (file.size() == 0)
+      file.write(FileHeader, sizeof(FileHeader));
+  }
+  file.write(reinterpret_cast<const char *>(&row), sizeof(row));
+  file.flush();
+}
+
+void SampleRollups::load() {
+  for (int r = 0; r < ResolutionCount; ++r)
+    loadFile(static_cast<Resolution>(r));
+
+  for (auto it = m_series.begin(); it != m_series.end(); ++it) {
+    Series &series = it.value();
+    QVector<Row> &minutes = series.rows[Minute];
+    if (!minutes.isEmpty()) {
+      series.hasSteps = true;
+      series.lastSteps = minutes.last().lastSteps;
+      series.lastStepsAt = minutes.last().start;
+      if (minutes.last().flags & Partial) {
+        series.open[Minute] = minutes.takeLast();
+        series.hasOpen[Minute] = true;
+      }
+    }
+    // Rebuild the open coarser rows from finer ones closed after the last persisted row.
+    // Rows closed while doing so are persisted but not cascaded, the next pass picks them up.
+    for (int r = Quarter; r < ResolutionCount; ++r) {
+      const QVector<Row> &rows = series.rows[r];
+      const QVector<Row> &finer = series.rows[r - 1];
+      const qint64 end = rows.isEmpty() ? std::numeric_limits<qint64>::min() : rows.last().start + ResolutionMs[r];
+      auto first = std::lower_bound(finer.begin(), finer.end(), end, [](const Row &row, qint64 t) { return row.start < t; });
+      for (auto row = first; row != finer.end(); ++row)
+        merge(series, it.key(), static_cast<Resolution>(r), *row, false);
+    }
+  }
+}
+
+void SampleRollups::loadFile(Resolution resolution) {
+  QFile file(fileName(resolution));
+  if (!file.exists())
+    return;
+  if (!file.open(QIODevice::ReadOnly)) {
+    qCritical() << "Could not read rollups" << file.fileName() << ':' << file.errorString();
+    return;
+  }
+  const QByteArray data = file.readAll();
+  file.close();
+  if (data.size() < static_cast<int>(sizeof(FileHeader)) || memcmp(data.constData(), FileHeader, sizeof(FileHeader)) != 0) {
+    qWarning() << "Ignoring rollups in unknown format" << file.fileName();
+    file.rename(file.fileName() + ".bad");
+    return;
+  }
+
+  const qint64 cutoff = RetentionDays[resolution] ? QDateTime::currentMSecsSinceEpoch() - RetentionDays[resolution] * ResolutionMs[Day] : 0;
+  const int count = (data.size() - static_cast<int>(sizeof(FileHeader))) / static_cast<int>(sizeof(Row));
+  int kept = 0;
+  for (int i = 0; i < count; ++i) {
+    Row row;
+    memcpy(&row, data.constData() + sizeof(FileHeader) + i * sizeof(Row), sizeof(Row));
+    if (row.start < cutoff)
+      continue;
+    QVector<Row> &rows = m_series[row.band].rows[resolution];
+    // A resumed partial minute is written again when it closes; the later copy wins.
+    if (!rows.isEmpty() && rows.last().start == row.start) {
+      rows.last() = row;
+      continue;
+    }
+    if (!rows.isEmpty() && rows.last().start > row.start)
+      continue;
+    rows.append(row);
+    kept++;
+  }
+  qDebug() << "Loaded" << kept << ResolutionNames[resolution] << "rollups from" << file.fileName();
+
+  // Compacted once it carries expired or superseded rows, so the file does not grow forever.
+  if (kept == count)
+    return;
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qCritical() << "Could not compact rollups" << file.fileName() << ':' << file.errorString();
+    return;
+  }
+  file.write(FileHeader, sizeof(FileHeader));
+  for (const Series &series : qAsConst(m_series))
+    file.write(reinterpret_cast<const char *>(series.rows[resolution].constData()), series.rows[resolution].size() * static_cast<int>(sizeof(Row)));
+}
+
+QVector<SampleRollups::Row> SampleRollups::query(Resolution resolution, quint8 band, qint64 from, qint64 to) const {
+  QVector<Row> result;
+  auto it = m_series.constFind(band);
+  if (it == m_series.constEnd())
+    return result;
+  const QVector<Row> &rows = it->rows[resolution];
+  auto row = std::lower_bound(rows.begin(), rows.end(), from, [](const Row &r, qint64 t) { return r.start < t; });
+  for (; row != rows.end() && row->start < to; ++row)
+    result.append(*row);
+  if (it->hasOpen[resolution] && it->open[resolution].start >= from && it->open[resolution].start < to)
+    result.append(it->open[resolution]);
+  return result;
+}
+
+SampleRollups::Resolution SampleRollups::resolutionFor(qint64 span, int maxRows) {
+  for (int r = 0; r < ResolutionCount; ++r) {
+    if (span / ResolutionMs[r] <= maxRows)
+      return static_cast<Resolution>(r);
+  }
+  return Day;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "SampleBus.h"
+#include <QFile>
+#include <QHash>
+#include <QObject>
+#include <QString>
+#include <QVector>
+
+// Per-band HR and step summaries at 1 min, 15 min, 1 h and 1 day, kept up to date from
+// the sample bus. Only minutes see samples; each closed row is merged into the next
+// coarser one, so a sample costs one row update no matter how many resolutions exist.
+//
+// Closed rows are appended to one file per resolution in the given directory and loaded
+// at startup. Coarser rows still open at shutdown are rebuilt from the finer closed rows
+// after their last persisted one; the open minute is written as a partial row and resumed.
+class SampleRollups : public QObject {
+  Q_OBJECT
+public:
+  enum Resolution { Minute, Quarter, Hour, Day, ResolutionCount };
+  static const qint64 ResolutionMs[ResolutionCount];
+  // How long rows are kept, in days; 0 keeps them forever.
+  static const int RetentionDays[ResolutionCount];
+
+  struct Row {
+    qint64 start; // ms since epoch, aligned to the resolution
+    quint32 count; // HR readings, not worn (hr 0) excluded
+    quint32 hrSum;
+    quint32 steps; // steps taken within the row
+    quint16 lastSteps; // band step counter at the last sample, to continue deltas
+    quint8 band;
+    quint8 hrMin;
+    quint8 hrMax;
+    quint8 flags;
+    quint8 reserved[6];
+    double hrMean() const { return count ? double(hrSum) / count : 0.0; }
+  };
+  static_assert(sizeof(Row) == 32, "rows are stored as is");
+  enum RowFlag : quint8 { Partial = 1 };
+
+  SampleRollups(SampleBus *bus, const QString &directory, QObject *parent = nullptr);
+  ~SampleRollups();
+
+  void add(const SampleBus::Sample &sample);
+  // Rows of the band starting in [from, to), including the open one.
+  QVector<Row> query(Resolution resolution, quint8 band, qint64 from, qint64 to) const;
+  // Finest resolution that covers the span in at most maxRows rows.
+  static Resolution resolutionFor(qint64 span, int maxRows = 500);
+
+private slots:
+  void drain();
+
+private:
+  struct Series {
+    QVector<Row> rows[ResolutionCount];
+    Row open[ResolutionCount];
+    bool hasOpen[ResolutionCount]{};
+    bool hasSteps = false;
+    quint16 lastSteps = 0;
+    qint64 lastStepsAt = 0;
+    // A non-zero counter arrived since startup; before the band's counter is first read,
+    // HR samples carry 0 steps.
+    bool stepsRead = false;
+  };
+  QString fileName(Resolution resolution) const;
+  void load();
+  void loadFile(Resolution resolution);
+  // Folds a closed row of the next finer resolution into the open row of resolution.
+  void merge(Series &series, quint8 band, Resolution resolution, const Row &row, bool cascade);
+  void close(Series &series, Resolution resolution, bool cascade);
+  void persist(Resolution resolution, const Row &row);
+
+  SampleBus *m_bus;
+  int m_sink = -1;
+  QString m_directory;
+  QHash<quint8, Series> m_series;
+  QFile m_files[ResolutionCount];
+};
@@ -0,0 +1,421 @@
+#include "SampleSegment.h"
+#include <QDebug>
+#include <QtEndian>
+#include <cstring>
+
+static const char Magic[4] = {'M', 'B', '3', 'S'};
+static constexpr quint8 Version = 1;
+static constexpr int HeaderSize = 8;
+static constexpr int IndexEntrySize = 24;
+static constexpr int TrailerSize = 8;
+
+namespace {
+
+// MSB-first bit packing into a byte array.
+class BitWriter {
+public:
+  explicit BitWriter(QByteArray &out) : m_out(out) {}
+  // n <= 32
+  void write(quint32 v, int n) {
+    m_acc = (m_acc << n) | (n == 32 ? v : v & ((1u << n) - 1));
+    m_bits += n;
+    while (m_bits >= 8) {
+      m_bits -= 8;
+      m_out.append(static_cast<char>(m_acc >> m_bits));
+    }
+  }
+  void flush() {
+    if (m_bits)
+      m_out.append(static_cast<char>(m_acc << (8 - m_bits)));
+    m_bits = 0;
+  }
+
+private:
+  QByteArray &m_out;
+  quint64 m_acc = 0;
+  int m_bits = 0;
+};
+
+class BitReader {
+public:
+  BitReader(const uchar *data, int size) : m_data(data), m_size(size) {}
+  // n <= 32; reads zeros past the end.
+  quint32 read(int n) {
+    if (n <= 0)
+      return 0;
+    const int byte = m_pos >> 3;
+    quint64 window;
+    if (byte + 8 <= m_size) {
+      window = qFromBigEndian<quint64>(m_data + byte);
+    } else {
+      uchar tail[8] = {};
+      if (byte < m_size)
+        memcpy(tail, m_data + byte, m_size - byte);
+      window = qFromBigEndian<quint64>(tail);
+    }
+    const quint32 v = static_cast<quint32>((window << (m_pos & 7)) >> (64 - n));
+    m_pos += n;
+    return v;
+  }
+  bool bit() { return read(1); }
+
+private:
+  const uchar *m_data;
+  int m_size;
+  int m_pos = 0;
+};
+
+template <int Width> struct XorEncoder {
+  static constexpr int WindowBits = Width == 8 ? 3 : 4;
+  quint32 previous = 0;
+  int lead = -1;
+  int trail = 0;
+  // Cleared by decode() on a window that does not fit the width, i.e. a corrupt column.
+  bool ok = true;
+
+  void encode(BitWriter &w, quint32 v) {
+    const quint32 x = v ^ previous;
+    previous = v;
+    if (!x) {
+      w.write(0, 1);
+      return;
+    }
+    const int l = __builtin_clz(x) - (32 - Width);
+    const int t = __builtin_ctz(x);
+    if (lead >= 0 && l >= lead && t >= trail) {
+      w.write(0b10, 2);
+      w.write(x >> trail, Width - lead - trail);
+      return;
+    }
+    lead = l;
+    trail = t;
+    const int len = Width - l - t;
+    w.write(0b11, 2);
+    w.write(static_cast<quint32>(l), WindowBits);
+    w.write(static_cast<quint32>(len - 1), WindowBits);
+    w.write(x >> t, len);
+  }
+  quint32 decode(BitReader &r) {
+    if (!r.bit())
+      return previous;
+    if (r.bit()) {
+      lead = static_cast<int>(r.read(WindowBits));
+      const int len = static_cast<int>(r.read(WindowBits)) + 1;
+      trail = Width - lead - len;
+    }
+    if (lead < 0 || trail < 0) {
+      ok = false;
+      return previous;
+    }
+    previous ^= r.read(Width - lead - trail) << trail;
+    return previous;
+  }
+};
+
+void putLe32(QByteArray &out, quint32 v) {
+  uchar b[4];
+  qToLittleEndian(v, b);
+  out.append(reinterpret_cast<const char *>(b), 4);
+}
+
+void putLe64(QByteArray &out, qint64 v) {
+  uchar b[8];
+  qToLittleEndian(v, b);
+  out.append(reinterpret_cast<const char *>(b), 8);
+}
+
+void putColumn(QByteArray &out, const QByteArray &column) {
+  putLe32(out, static_cast<quint32>(column.size()));
+  out.append(column);
+}
+
+} // namespace
+
+SegmentEncoder::SegmentEncoder() {
+  m_block.reserve(BlockSamples);
+  m_data.append(Magic, 4);
+  m_data.append(static_cast<char>(Version));
+  m_data.append(3, '\0');
+}
+
+bool SegmentEncoder::append(const SegmentSample &sample) {
+  if (m_count && sample.timestamp < m_last)
+    return false;
+  // Delta-of-delta is stored in at most 32 bits; a wider gap starts a new block.
+  if (!m_block.isEmpty()) {
+    const qint64 delta = sample.timestamp - m_block.last().timestamp;
+    if (m_block.size() == BlockSamples || delta > 0x3fffffff)
+      flushBlock();
+  }
+  if (!m_count)
+    m_first = sample.timestamp;
+  m_last = sample.timestamp;
+  m_block.append(sample);
+  m_count++;
+  return true;
+}
+
+void SegmentEncoder::flushBlock() {
+  if (m_block.isEmpty())
+    return;
+  QByteArray timestamps, hr, steps, rr;
+  BitWriter tw(timestamps), hw(hr), sw(steps), rw(rr);
+  XorEncoder<8> hrXor;
+  XorEncoder<16> rrXor;
+  qint64 previous = m_block.first().timestamp;
+  qint64 previousDelta = 0;
+  quint16 previousSteps = 0;
+  for (const SegmentSample &s : qAsConst(m_block)) {
+    const qint64 delta = s.timestamp - previous;
+    const qint64 dod = delta - previousDelta;
+    previous = s.timestamp;
+    previousDelta = delta;
+    if (dod == 0) {
+      tw.write(0, 1);
+    } else if (dod >= -63 && dod <= 64) {
+      tw.write(0b10, 2);
+      tw.write(static_cast<quint32>(dod + 63), 7);
+    } else if (dod >= -255 && dod <= 256) {
+      tw.write(0b110, 3);
+      tw.write(static_cast<quint32>(dod + 255), 9);
+    } else if (dod >= -2047 && dod <= 2048) {
+      tw.write(0b1110, 4);
+      tw.write(static_cast<quint32>(dod + 2047), 12);
+    } else {
+      tw.write(0b1111, 4);
+      tw.write(static_cast<quint32>(static_cast<qint32>(dod)), 32);
+    }
+
+    hrXor.encode(hw, s.hr);
+    rrXor.encode(rw, s.rr);
+
+    const qint32 d = static_cast<qint32>(s.steps) - previousSteps;
+    const quint32 zigzag = (static_cast<quint32>(d) << 1) ^ static_cast<quint32>(d >> 31);
+    previousSteps = s.steps;
+    if (zigzag == 0) {
+      sw.write(0, 1);
+    } else if (zigzag < 16) {
+      sw.write(0b10, 2);
+      sw.write(zigzag, 4);
+    } else if (zigzag < 256) {
+      sw.write(0b110, 3);
+      sw.write(zigzag, 8);
+    } else {
+      sw.write(0b111, 3);
+      sw.write(zigzag, 17);
+    }
+  }
+  tw.flush();
+  hw.flush();
+  sw.flush();
+  rw.flush();
+
+  const quint32 offset = static_cast<quint32>(m_data.size());
+  uchar count[2];
+  qToLittleEndian(static_cast<quint16>(m_block.size()), count);
+  m_data.append(reinterpret_cast<const char *>(count), 2);
+  putLe64(m_data, m_block.first().timestamp);
+  putColumn(m_data, timestamps);
+  putColumn(m_data, hr);
+  putColumn(m_data, steps);
+  putColumn(m_data, rr);
+
+  putLe64(m_index, m_block.first().timestamp);
+  putLe64(m_index, m_block.last().timestamp);
+  putLe32(m_index, offset);
+  putLe32(m_index, static_cast<quint32>(m_block.size()));
+  m_blocks++;
+  m_block.clear();
+}
+
+QByteArray SegmentEncoder::seal() {
+  flushBlock();
+  QByteArray segment;
+  segment.swap(m_data);
+  segment.append(m_index);
+  putLe32(segment, static_cast<quint32>(m_blocks));
+  segment.append(Magic, 4);
+
+  m_index.clear();
+  m_blocks = 0;
+  m_count = 0;
+  m_data.append(Magic, 4);
+  m_data.append(static_cast<char>(Version));
+  m_data.append(3, '\0');
+  return segment;
+}
+
+QByteArray SegmentEncoder::sealPartial(const QByteArray &partial) {
+  const uchar *data = reinterpret_cast<const uchar *>(partial.constData());
+  const qint64 size = partial.size();
+  if (size < HeaderSize || memcmp(data, Magic, 4) != 0 || data[4] != Version)
+    return QByteArray();
+
+  // Walk the blocks; the last one may be torn.
+  QVector<SegmentReader::Block> blocks;
+  qint64 end = HeaderSize;
+  for (;;) {
+    qint64 p = end + 10;
+    for (int c = 0; c < 4 && p <= size; ++c)
+      p = size - p < 4 ? size + 1 : p + 4 + qFromLittleEndian<quint32>(data + p);
+    const int count = size - end >= 10 ? qFromLittleEndian<quint16>(data + end) : 0;
+    if (p > size || count < 1 || count > BlockSamples)
+      break;
+    const qint64 first = qFromLittleEndian<qint64>(data + end + 2);
+    blocks.append(SegmentReader::Block{first, first, static_cast<quint32>(end), static_cast<quint32>(count)});
+    end = p;
+  }
+
+  auto build = [&partial](const QVector<SegmentReader::Block> &index, qint64 end) {
+    QByteArray segment = partial.left(static_cast<int>(end));
+    for (const SegmentReader::Block &b : index) {
+      putLe64(segment, b.first);
+      putLe64(segment, b.last);
+      putLe32(segment, b.offset);
+      putLe32(segment, b.count);
+    }
+    putLe32(segment, static_cast<quint32>(index.size()));
+    segment.append(Magic, 4);
+    return segment;
+  };
+
+  // Only decoding tells a block's last timestamp, and whether it is intact.
+  const QByteArray provisional = build(blocks, end);
+  SegmentReader reader;
+  if (!reader.setData(reinterpret_cast<const uchar *>(provisional.constData()), provisional.size()))
+    return QByteArray();
+  QVector<SegmentSample> out(BlockSamples);
+  for (int i = 0; i < blocks.size(); ++i) {
+    const int count = reader.decodeBlock(i, out.data());
+    if (!count || (i && out[0].timestamp < blocks[i - 1].last)) {
+      end = blocks[i].offset;
+      blocks.resize(i);
+      break;
+    }
+    blocks[i].last = out[count - 1].timestamp;
+  }
+  return build(blocks, end);
+}
+
+bool SegmentReader::open(const QString &fileName) {
+  m_file.setFileName(fileName);
+  if (!m_file.open(QIODevice::ReadOnly)) {
+    qWarning() << "Could not open segment" << fileName << ':' << m_file.errorString();
+    return false;
+  }
+  const qint64 size = m_file.size();
+  const uchar *data = size ? m_file.map(0, size) : nullptr;
+  return data && setData(data, size);
+}
+
+bool SegmentReader::setData(const uchar *data, qint64 size) {
+  m_blocks.clear();
+  if (size < HeaderSize + TrailerSize || memcmp(data, Magic, 4) != 0 || data[4] != Version || memcmp(data + size - 4, Magic, 4) != 0)
+    return false;
+  const quint32 blocks = qFromLittleEndian<quint32>(data + size - TrailerSize);
+  const qint64 indexStart = size - TrailerSize - static_cast<qint64>(blocks) * IndexEntrySize;
+  if (indexStart < HeaderSize)
+    return false;
+  m_blocks.resize(static_cast<int>(blocks));
+  for (quint32 i = 0; i < blocks; ++i) {
+    const uchar *e = data + indexStart + i * IndexEntrySize;
+    Block &b = m_blocks[static_cast<int>(i)];
+    b.first = qFromLittleEndian<qint64>(e);
+    b.last = qFromLittleEndian<qint64>(e + 8);
+    b.offset = qFromLittleEndian<quint32>(e + 16);
+    b.count = qFromLittleEndian<quint32>(e + 20);
+    if (b.offset < HeaderSize || b.offset >= indexStart || b.count > SegmentEncoder::BlockSamples) {
+      m_blocks.clear();
+      return false;
+    }
+  }
+  m_data = data;
+  m_size = indexStart;
+  return true;
+}
+
+int SegmentReader::findBlock(qint64 timestamp) const {
+  int lo = 0, hi = m_blocks.size();
+  while (lo < hi) {
+    const int mid = (lo + hi) / 2;
+    if (m_blocks[mid].last < timestamp)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+int SegmentReader::decodeBlock(int i, SegmentSample *out) const {
+  const Block &b = m_blocks[i];
+  const uchar *p = m_data + b.offset;
+  const uchar *end = m_data + m_size;
+  if (end - p < 10)
+    return 0;
+  const int count = qFromLittleEndian<quint16>(p);
+  if (count != static_cast<int>(b.count))
+    return 0;
+  const qint64 first = qFromLittleEndian<qint64>(p + 2);
+  p += 10;
+  const uchar *columns[4];
+  int sizes[4];
+  for (int c = 0; c < 4; ++c) {
+    if (end - p < 4)
+      return 0;
+    const quint32 size = qFromLittleEndian<quint32>(p);
+    if (size > static_cast<quint64>(end - p - 4))
+      return 0;
+    sizes[c] = static_cast<int>(size);
+    columns[c] = p + 4;
+    p += 4 + size;
+  }
+
+  BitReader tr(columns[0], sizes[0]);
+  // Unsigned, so a corrupt column wraps instead of overflowing.
+  quint64 timestamp = static_cast<quint64>(first), delta = 0;
+  for (int n = 0; n < count; ++n) {
+    qint64 dod;
+    if (!tr.bit())
+      dod = 0;
+    else if (!tr.bit())
+      dod = static_cast<qint64>(tr.read(7)) - 63;
+    else if (!tr.bit())
+      dod = static_cast<qint64>(tr.read(9)) - 255;
+    else if (!tr.bit())
+      dod = static_cast<qint64>(tr.read(12)) - 2047;
+    else
+      dod = static_cast<qint32>(tr.read(32));
+    delta += static_cast<quint64>(dod);
+    timestamp += delta;
+    out[n].timestamp = static_cast<qint64>(timestamp);
+  }
+
+  BitReader hr(columns[1], sizes[1]);
+  XorEncoder<8> hrXor;
+  for (int n = 0; n < count; ++n)
+    out[n].hr = static_cast<quint8>(hrXor.decode(hr));
+  if (!hrXor.ok)
+    return 0;
+
+  BitReader sr(columns[2], sizes[2]);
+  quint16 steps = 0;
+  for (int n = 0; n < count; ++n) {
+    quint32 zigzag;
+    if (!sr.bit())
+      zigzag = 0;
+    else if (!sr.bit())
+      zigzag = sr.read(4);
+    else if (!sr.bit())
+      zigzag = sr.read(8);
+    else
+      zigzag = sr.read(17);
+    steps = static_cast<quint16>(steps + static_cast<qint32>((zigzag >> 1) ^ -(zigzag & 1)));
+    out[n].steps = steps;
+  }
+
+  BitReader rr(columns[3], sizes[3]);
+  XorEncoder<16> rrXor;
+  for (int n = 0; n < count; ++n)
+    out[n].rr = static_cast<quint16>(rrXor.decode(rr));
+  return rrXor.ok ? count : 0;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+// Sealed, compressed storage for one band's samples. Samples are cut into blocks of up
+// to BlockSamples; a block stores each field as its own bit-packed column, so a reader
+// can decode a block with one tight loop per column.
+//
+//   timestamps  delta-of-delta: 0 -> '0', then '10'+7, '110'+9, '1110'+12 or '1111'+32 bits
+//   hr, rr      XOR with the previous value: '0' same, '10' + bits inside the previous
+//               leading/trailing zero window, '11' + new window + bits (as in Gorilla)
+//   steps       zigzag delta: '0', '10'+4, '110'+8 or '111'+17 bits
+//
+// File: "MB3S", uint8 version, 3 bytes padding, blocks, then per block int64 first and
+// last timestamp, uint32 offset and count, and finally uint32 block count and "MB3S".
+// Block: uint16 count, int64 first timestamp, then for each column a uint32 byte length
+// and its bytes. All integers are little endian.
+//
+// Everything before the index is final once a block closes, so a writer can append closed
+// blocks as they come and the index on seal; sealPartial() finishes a file cut short.
+struct SegmentSample {
+  qint64 timestamp; // ms since epoch
+  quint16 rr; // RR interval in 1/1024 s, 0 if the band sent none
+  quint16 steps;
+  quint8 hr;
+};
+
+class SegmentEncoder {
+public:
+  static constexpr int BlockSamples = 1024;
+
+  SegmentEncoder();
+  // Samples must not go back in time, or findBlock() could not bisect the index; an older
+  // sample is refused and false returned. Seal and start a new segment for it instead.
+  bool append(const SegmentSample &sample);
+  int size() const { return m_count; }
+  qint64 firstTimestamp() const { return m_first; }
+  qint64 lastTimestamp() const { return m_last; }
+  // Returns the finished segment and starts a new one.
+  QByteArray seal();
+  // Header and closed blocks so far; seal() returns them unchanged at its start.
+  const QByteArray &closedBlocks() const { return m_data; }
+  // Seals the header and whole, decodable blocks of a segment whose writer stopped before
+  // seal(), e.g. on a crash. Returns an empty array if not even the header is there.
+  static QByteArray sealPartial(const QByteArray &partial);
+
+private:
+  void flushBlock();
+
+  QByteArray m_data;
+  QVector<SegmentSample> m_block;
+  QByteArray m_index;
+  int m_blocks = 0;
+  int m_count = 0;
+  qint64 m_first = 0;
+  qint64 m_last = 0;
+};
+
+class SegmentReader {
+public:
+  struct Block {
+    qint64 first;
+    qint64 last;
+    quint32 offset;
+    quint32 count;
+  };
+
+  // Maps the file for as long as the reader lives.
+  bool open(const QString &fileName);
+  // Reads from memory the caller keeps alive.
+  bool setData(const uchar *data, qint64 size);
+
+  int blockCount() const { return m_blocks.size(); }
+  const Block &block(int i) const { return m_blocks[i]; }
+  // First block that may hold samples at or after t.
+  int findBlock(qint64 timestamp) const;
+  // Decodes block i into out, which must hold SegmentEncoder::BlockSamples; returns the count.
+  int decodeBlock(int i, SegmentSample *out) const;
+
+private:
+  QFile m_file;
+  const uchar *m_data = nullptr;
+  qint64 m_size = 0;
+  QVector<Block> m_blocks;
+};
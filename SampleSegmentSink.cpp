@@ -0,0 +1,99 @@
+#include "SampleSegmentSink.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+
+SampleSegmentSink::SampleSegmentSink(SampleBus *bus, const QString &directory, qint64 sealIntervalMs, QObject *parent)
+    : QObject(parent), m_bus(bus), m_directory(directory), m_sealInterval(sealIntervalMs) {
+  if (!QDir().mkpath(m_directory))
+    qCritical() << "Could not create segment directory" << m_directory;
+  recoverPartFiles();
+  m_sink = m_bus->subscribe(SampleBus::DropOldest);
+  connect(m_bus, &SampleBus::samplesAvailable, this, &SampleSegmentSink::drain);
+}
+
+SampleSegmentSink::~SampleSegmentSink() {
+  for (auto it = m_segments.begin(); it != m_segments.end(); ++it)
+    seal(it.key(), it.value());
+}
+
+QString SampleSegmentSink::fileName(quint8 band, qint64 first) const {
+  return QDir(m_directory).filePath(QString("band%1-%2.seg").arg(band).arg(first));
+}
+
+void SampleSegmentSink::drain() {
+  while (const SampleBus::Sample *s = m_bus->peek(m_sink)) {
+    OpenSegment &segment = m_segments[s->band];
+    SegmentEncoder &encoder = segment.encoder;
+    if (encoder.size() && s->timestamp - encoder.firstTimestamp() >= m_sealInterval)
+      seal(s->band, segment);
+    // The bus carries no RR intervals; the column then costs a bit per sample.
+    const SegmentSample sample{s->timestamp, 0, s->steps, s->hr};
+    if (!encoder.append(sample)) {
+      // The host clock stepped back; the older samples start a segment of their own.
+      seal(s->band, segment);
+      encoder.append(sample);
+    }
+    if (encoder.closedBlocks().size() > segment.written)
+      append(s->band, segment, encoder.closedBlocks().mid(segment.written));
+    m_bus->consume(m_sink);
+  }
+}
+
+bool SampleSegmentSink::append(quint8 band, OpenSegment &segment, const QByteArray &data) {
+  QFile file(fileName(band, segment.encoder.firstTimestamp()) + ".part");
+  const QIODevice::OpenMode mode = segment.written ? QIODevice::Append : QIODevice::Truncate;
+  if (!file.open(QIODevice::WriteOnly | mode) || file.write(data) != data.size()) {
+    qCritical() << "Could not write segment" << file.fileName() << ':' << file.errorString();
+    return false;
+  }
+  segment.written += data.size();
+  return true;
+}
+
+void SampleSegmentSink::seal(quint8 band, OpenSegment &segment) {
+  SegmentEncoder &encoder = segment.encoder;
+  if (!encoder.size())
+    return;
+  const int samples = encoder.size();
+  const QString name = fileName(band, encoder.firstTimestamp());
+  const int written = segment.written;
+  const QByteArray sealed = encoder.seal();
+  const bool complete = append(band, segment, sealed.mid(written));
+  segment.written = 0;
+  // An incomplete part file is sealed from its whole blocks at the next start.
+  if (!complete)
+    return;
+  QFile::remove(name);
+  if (!QFile::rename(name + ".part", name)) {
+    qCritical() << "Could not seal segment" << name;
+    return;
+  }
+  qDebug() << "Sealed" << samples << "samples of band" << band << "into" << sealed.size() << "bytes";
+}
+
+void SampleSegmentSink::recoverPartFiles() {
+  const QDir dir(m_directory);
+  for (const QString &part : dir.entryList({"*.seg.part"}, QDir::Files)) {
+    QFile file(dir.filePath(part));
+    if (!file.open(QIODevice::ReadOnly)) {
+      qCritical() << "Could not read segment" << file.fileName() << ':' << file.errorString();
+      continue;
+    }
+    const QByteArray segment = SegmentEncoder::sealPartial(file.readAll());
+    file.close();
+    if (segment.isEmpty()) {
+      qWarning() << "Ignoring unreadable segment" << file.fileName();
+      file.rename(file.fileName() + ".bad");
+      continue;
+    }
+    QSaveFile sealed(file.fileName().left(file.fileName().size() - 5));
+    if (!sealed.open(QIODevice::WriteOnly) || sealed.write(segment) != segment.size() || !sealed.commit()) {
+      qCritical() << "Could not write segment" << sealed.fileName() << ':' << sealed.errorString();
+      continue;
+    }
+    file.remove();
+    qWarning() << "Sealed" << sealed.fileName() << "left open by an earlier run";
+  }
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "SampleBus.h"
+#include "SampleSegment.h"
+#include <QHash>
+#include <QObject>
+
+// Keeps each band's samples in a SegmentEncoder and seals one segment per interval,
+// "band<N>-<first timestamp>.seg" in the directory. While open, a segment lives in a
+// ".seg.part" file that each block is appended to as it closes; sealing appends the index
+// and renames it. Every byte reaches flash once, in one write per block of
+// SegmentEncoder::BlockSamples samples instead of one per sample, and a crash loses at
+// most the open block. Part files left behind are sealed at startup.
+class SampleSegmentSink : public QObject {
+  Q_OBJECT
+public:
+  SampleSegmentSink(SampleBus *bus, const QString &directory, qint64 sealIntervalMs = 6 * 3600 * 1000, QObject *parent = nullptr);
+  ~SampleSegmentSink();
+
+private slots:
+  void drain();
+
+private:
+  struct OpenSegment {
+    SegmentEncoder encoder;
+    // Bytes of closedBlocks() already in the part file.
+    int written = 0;
+  };
+  QString fileName(quint8 band, qint64 first) const;
+  bool append(quint8 band, OpenSegment &segment, const QByteArray &data);
+  void seal(quint8 band, OpenSegment &segment);
+  void recoverPartFiles();
+
+  SampleBus *m_bus;
+  int m_sink;
+  QString m_directory;
+  qint64 m_sealInterval;
+  QHash<quint8, OpenSegment> m_segments;
+};
@@ -0,0 +1,86 @@
+#include "ScanFilter.h"
+#include "Logging.h"
+#include <QDebug>
+
+// At most one diagnostic line per interval for devices that are not bands.
+static constexpr qint64 LogIntervalMs = 1000;
+
+ScanFilter::ScanFilter(const QBluetoothUuid &service, quint16 manufacturerId) : m_service(service), m_manufacturerId(manufacturerId) {
+  m_seen.reserve(256);
+  m_clock.start();
+}
+
+void ScanFilter::reset() {
+  m_seen.clear();
+  m_unsettled.clear();
+  m_advertisements = 0;
+  m_repeats = 0;
+  m_candidates = 0;
+  m_rejectedByManufacturer = 0;
+  m_lastLog = -1;
+  m_suppressedLogs = 0;
+}
+
+ScanFilter::Verdict ScanFilter::check(const QBluetoothDeviceInfo &device) {
+  m_advertisements++;
+  const quint64 address = device.address().toUInt64();
+  if (m_seen.contains(address)) {
+    m_repeats++;
+    return Repeat;
+  }
+  bool final = false;
+  const Verdict verdict = classify(device, final);
+  const bool recheck = m_unsettled.contains(address);
+  if (final) {
+    m_seen.insert(address);
+    if (recheck)
+      m_unsettled.remove(address);
+  } else if (recheck) {
+    m_repeats++;
+    return verdict;
+  } else {
+    m_unsettled.insert(address);
+  }
+  if (verdict == Candidate) {
+    m_candidates++;
+    qDebug() << "Mi Band found at" << device.address().toString() << device.name();
+  } else if (lcScan().isDebugEnabled()) {
+    qCDebug(lcScan) << "Ignoring" << device.address().toString() << device.name() << device.serviceUuids();
+  } else {
+    const qint64 now = m_clock.elapsed();
+    if (m_lastLog >= 0 && now - m_lastLog < LogIntervalMs) {
+      m_suppressedLogs++;
+    } else {
+      qDebug() << "Ignoring" << device.name() << "and" << m_suppressedLogs << "more devices since the last line";
+      m_lastLog = now;
+      m_suppressedLogs = 0;
+    }
+  }
+  return verdict;
+}
+
+ScanFilter::Verdict ScanFilter::classify(const QBluetoothDeviceInfo &device, bool &final) {
+  if (!(device.coreConfigurations() & QBluetoothDeviceInfo::LowEnergyCoreConfiguration))
+    return Rejected;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+  // Manufacturer data is cheaper to check than the service list, and most devices in a
+  // crowded room announce a maker. Bands that send none still get the service check.
+  const QVector<quint16> manufacturers = device.manufacturerIds();
+  if (!manufacturers.isEmpty() && !manufacturers.contains(m_manufacturerId)) {
+    m_rejectedByManufacturer++;
+    final = true;
+    return Rejected;
+  }
+#endif
+  if (device.serviceUuids().contains(m_service)) {
+    final = true;
+    return Candidate;
+  }
+  final = device.serviceUuidsCompleteness() == QBluetoothDeviceInfo::DataComplete;
+  return Rejected;
+}
+
+void ScanFilter::logSummary() const {
+  qDebug() << "Scan saw" << m_advertisements << "advertisements from" << m_seen.size() << "devices:" << m_candidates << "bands," << m_repeats << "repeats,"
+           << m_rejectedByManufacturer << "dropped by manufacturer";
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <QBluetoothDeviceInfo>
+#include <QBluetoothUuid>
+#include <QElapsedTimer>
+#include <QSet>
+
+// Sorts the advertisements of one scan into bands worth claiming and everything else,
+// cheaply enough for hundreds of advertisements per second.
+//
+// An address is remembered in a hashed seen-set once its verdict cannot change within the
+// scan: it is a band, it announces another maker, or its complete service list lacks the
+// band's service. Repeats of those only bump a counter; devices with a partial service
+// list are checked again on every advertisement, since the next one may carry the rest.
+// Advertisements with manufacturer data from someone other than the band's maker are
+// dropped before the service list is looked at. Diagnostics for rejected devices are
+// rate-limited, logged once per device, with a per-scan summary.
+class ScanFilter {
+public:
+  enum Verdict {
+    Rejected,
+    Candidate,
+    // Seen before in this scan with a final verdict.
+    Repeat,
+  };
+
+  ScanFilter(const QBluetoothUuid &service, quint16 manufacturerId);
+
+  // Forgets the seen-set, at the start of every scan.
+  void reset();
+  Verdict check(const QBluetoothDeviceInfo &device);
+  // Advertisements, distinct devices and candidates since reset().
+  void logSummary() const;
+
+  quint64 advertisements() const { return m_advertisements; }
+  int devices() const { return m_seen.size() + m_unsettled.size(); }
+  int candidates() const { return m_candidates; }
+
+private:
+  // final is set when the verdict holds for the rest of the scan.
+  Verdict classify(const QBluetoothDeviceInfo &device, bool &final);
+
+  QBluetoothUuid m_service;
+  quint16 m_manufacturerId;
+  QSet<quint64> m_seen;
+  // Rejected so far, but their service list was incomplete.
+  QSet<quint64> m_unsettled;
+  quint64 m_advertisements{};
+  quint64 m_repeats{};
+  int m_candidates{};
+  int m_rejectedByManufacturer{};
+  QElapsedTimer m_clock;
+  qint64 m_lastLog{-1};
+  int m_suppressedLogs{};
+};
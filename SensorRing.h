@@ -0,0 +1,33 @@
+#pragma once
+#include <QtGlobal>
+#include <atomic>
+
+// Fixed-size single-producer/single-consumer ring. When full, new samples are dropped and counted.
+template <typename T, int Capacity> class SensorRing {
+  static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+  bool push(const T &v) {
+    const quint64 head = m_head.load(std::memory_order_relaxed);
+    if (head - m_tail.load(std::memory_order_acquire) >= Capacity)
+      return false;
+    m_data[head & (Capacity - 1)] = v;
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+  int read(T *out, int max) {
+    const quint64 tail = m_tail.load(std::memory_order_relaxed);
+    const quint64 available = m_head.load(std::memory_order_acquire) - tail;
+    const int n = static_cast<int>(available < static_cast<quint64>(max) ? available : max);
+    for (int i = 0; i < n; ++i)
+      out[i] = m_data[(tail + i) & (Capacity - 1)];
+    m_tail.store(tail + n, std::memory_order_release);
+    return n;
+  }
+  int size() const { return static_cast<int>(m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire)); }
+
+private:
+  T m_data[Capacity];
+  std::atomic<quint64> m_head{0};
+  std::atomic<quint64> m_tail{0};
+};
@@ -0,0 +1,75 @@
+#include "SessionShards.h"
+#include <QDebug>
+#include <cerrno>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+SessionShards::SessionShards(int threads, SampleBus *bus, QObject *parent) : QObject(parent), m_bus(bus) {
+  m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (m_wakeFd < 0) {
+    perror("Could not create session shard eventfd");
+  } else {
+    m_wakeNotifier = new QSocketNotifier(m_wakeFd, QSocketNotifier::Read, this);
+    connect(m_wakeNotifier, &QSocketNotifier::activated, this, &SessionShards::drain);
+  }
+  for (int i = 0; i < qMax(1, threads); ++i) {
+    m_shards.emplace_back(new Shard);
+    m_shards.back()->thread.setObjectName(QString("band-shard-%1").arg(i));
+    m_shards.back()->thread.start();
+  }
+}
+
+SessionShards::~SessionShards() {
+  stop();
+  if (m_wakeFd >= 0)
+    close(m_wakeFd);
+}
+
+void SessionShards::stop() {
+  for (auto &shard : m_shards) {
+    shard->thread.quit();
+    shard->thread.wait();
+  }
+}
+
+int SessionShards::adopt(QObject *session) {
+  const int shard = m_next++ % threadCount();
+  QThread *thread = &m_shards[shard]->thread;
+  session->moveToThread(thread);
+  connect(thread, &QThread::finished, session, &QObject::deleteLater);
+  return shard;
+}
+
+void SessionShards::publish(int shard, const SampleBus::Sample &sample) {
+  if (!m_shards[shard]->ring.push(sample))
+    m_shards[shard]->dropped.fetch_add(1, std::memory_order_relaxed);
+  if (m_wakeFd >= 0 && !m_wakePending.exchange(true, std::memory_order_acq_rel)) {
+    const quint64 one = 1;
+    if (::write(m_wakeFd, &one, sizeof(one)) < 0)
+      perror("Could not wake session shards");
+  }
+}
+
+quint64 SessionShards::dropped() const {
+  quint64 total = 0;
+  for (const auto &shard : m_shards)
+    total += shard->dropped.load(std::memory_order_relaxed);
+  return total;
+}
+
+void SessionShards::drain() {
+  quint64 count;
+  if (::read(m_wakeFd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+    perror("Could not read session shard eventfd");
+  // Cleared before draining, so a sample pushed meanwhile wakes us again. A plain store
+  // could be ordered after the ring reads below; a worker would then still see the flag
+  // set, skip the wake-up and leave its sample stranded until the next one.
+  m_wakePending.exchange(false, std::memory_order_acq_rel);
+  SampleBus::Sample samples[64];
+  for (auto &shard : m_shards) {
+    while (int n = shard->ring.read(samples, 64)) {
+      for (int i = 0; i < n; ++i)
+        m_bus->publishSample(samples[i]);
+    }
+  }
+}
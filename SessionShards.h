@@ -0,0 +1,52 @@
+#pragma once
+#include "SampleBus.h"
+#include "SensorRing.h"
+#include <QObject>
+#include <QSocketNotifier>
+#include <QThread>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Runs band sessions on a pool of worker threads, each with its own event loop, and
+// merges their samples into the SampleBus on the thread that owns the shards.
+//
+// Every worker publishes into its own single-producer ring, so the merge takes no lock;
+// the owning thread is woken through an eventfd and drains all rings in one pass.
+class SessionShards : public QObject {
+  Q_OBJECT
+public:
+  static constexpr int RingCapacity = 1024;
+
+  SessionShards(int threads, SampleBus *bus, QObject *parent = nullptr);
+  ~SessionShards();
+
+  int threadCount() const { return static_cast<int>(m_shards.size()); }
+  // Moves a parentless session to the next worker, round robin, and returns its shard.
+  // The session is deleted when its worker stops.
+  int adopt(QObject *session);
+  // Called on the worker thread of shard.
+  void publish(int shard, const SampleBus::Sample &sample);
+  quint64 dropped() const;
+
+public slots:
+  // Stops the workers, deleting their sessions. Also done on destruction.
+  void stop();
+
+private slots:
+  void drain();
+
+private:
+  struct Shard {
+    QThread thread;
+    SensorRing<SampleBus::Sample, RingCapacity> ring;
+    std::atomic<quint64> dropped{0};
+  };
+
+  SampleBus *m_bus;
+  std::vector<std::unique_ptr<Shard>> m_shards;
+  int m_next = 0;
+  int m_wakeFd = -1;
+  QSocketNotifier *m_wakeNotifier = nullptr;
+  std::atomic<bool> m_wakePending{false};
+};
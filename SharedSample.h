@@ -0,0 +1,42 @@
+#pragma once
+// Layout of the POSIX shared-memory segment the daemon publishes its readings in.
+// Shared between the daemon and SharedSampleReader, so it must not depend on Qt.
+#include <atomic>
+#include <cstdint>
+
+static constexpr char SharedSampleDefaultName[] = "/miband3";
+static constexpr uint32_t SharedSampleMagic = 0x4d494233; // "MIB3"
+// Bumped on any layout change so readers of another layout refuse to attach.
+// 2: SharedSampleRecord::band took the reserved byte after hr.
+static constexpr uint32_t SharedSampleVersion = 2;
+static constexpr uint32_t SharedSampleHistorySize = 256;
+
+struct SharedSampleRecord {
+  int64_t timestamp; // ms since epoch
+  uint8_t hr;
+  uint8_t band;
+  uint16_t steps;
+  uint32_t reserved2;
+};
+
+struct SharedSampleSegment {
+  uint32_t magic;
+  uint32_t version;
+  // Seqlock: odd while the writer is updating, readers retry if it changed under them.
+  alignas(64) std::atomic<uint32_t> seq;
+  uint64_t count; // total samples ever written, history[(count - 1) % size] is the latest
+  SharedSampleRecord latest;
+  SharedSampleRecord history[SharedSampleHistorySize];
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "seqlock needs a lock-free counter");
+
+inline void sharedSampleWrite(SharedSampleSegment *segment, const SharedSampleRecord &record) {
+  const uint32_t seq = segment->seq.load(std::memory_order_relaxed);
+  segment->seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  segment->latest = record;
+  segment->history[segment->count % SharedSampleHistorySize] = record;
+  segment->count++;
+  segment->seq.store(seq + 2, std::memory_order_release);
+}
@@ -0,0 +1,56 @@
+#include "SharedSampleExport.h"
+#include <QDebug>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SharedSampleExport::SharedSampleExport(SampleBus *bus, const char *name, QObject *parent) : QObject(parent), m_bus(bus), m_name(name) {
+  m_sink = m_bus->subscribe(SampleBus::DropOldest);
+  openSegment();
+  if (m_segment)
+    connect(m_bus, &SampleBus::samplesAvailable, this, &SharedSampleExport::drain);
+}
+
+SharedSampleExport::~SharedSampleExport() { closeSegment(); }
+
+void SharedSampleExport::drain() {
+  while (const SampleBus::Sample *s = m_bus->peek(m_sink)) {
+    sharedSampleWrite(m_segment, SharedSampleRecord{s->timestamp, s->hr, s->band, s->steps, 0});
+    m_bus->consume(m_sink);
+  }
+}
+
+void SharedSampleExport::openSegment() {
+  int fd = shm_open(m_name.constData(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    perror("Could not create shared sample segment");
+    return;
+  }
+  if (ftruncate(fd, sizeof(SharedSampleSegment)) < 0) {
+    perror("Could not resize shared sample segment");
+    close(fd);
+    return;
+  }
+  void *p = mmap(nullptr, sizeof(SharedSampleSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    perror("Could not map shared sample segment");
+    return;
+  }
+  // Readers check magic and version, so publish them last.
+  m_segment = new (p) SharedSampleSegment{};
+  m_segment->version = SharedSampleVersion;
+  std::atomic_thread_fence(std::memory_order_release);
+  m_segment->magic = SharedSampleMagic;
+  qDebug() << "Exporting samples to shared memory" << m_name;
+}
+
+void SharedSampleExport::closeSegment() {
+  if (m_segment) {
+    munmap(m_segment, sizeof(SharedSampleSegment));
+    m_segment = nullptr;
+    shm_unlink(m_name.constData());
+  }
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "SampleBus.h"
+#include "SharedSample.h"
+#include <QObject>
+
+// Bus sink that mirrors the latest sample and a history ring into a POSIX
+// shared-memory segment, for other processes to read with SharedSampleReader.
+class SharedSampleExport : public QObject {
+  Q_OBJECT
+public:
+  SharedSampleExport(SampleBus *bus, const char *name = SharedSampleDefaultName, QObject *parent = nullptr);
+  ~SharedSampleExport();
+
+private slots:
+  void drain();
+
+private:
+  void openSegment();
+  void closeSegment();
+
+  SampleBus *m_bus;
+  int m_sink;
+  QByteArray m_name;
+  SharedSampleSegment *m_segment = nullptr;
+};
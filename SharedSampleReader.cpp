@@ -0,0 +1,80 @@
+#include "SharedSampleReader.h"
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SharedSampleReader::~SharedSampleReader() { close(); }
+
+bool SharedSampleReader::open(const char *name) {
+  close();
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) {
+    perror("Could not open shared sample segment");
+    return false;
+  }
+  void *p = mmap(nullptr, sizeof(SharedSampleSegment), PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    perror("Could not map shared sample segment");
+    return false;
+  }
+  auto segment = static_cast<const SharedSampleSegment *>(p);
+  if (segment->magic != SharedSampleMagic || segment->version != SharedSampleVersion) {
+    fprintf(stderr, "Shared sample segment has unexpected layout (version %u, this reader needs %u)\n", segment->version, SharedSampleVersion);
+    munmap(p, sizeof(SharedSampleSegment));
+    return false;
+  }
+  m_segment = segment;
+  return true;
+}
+
+void SharedSampleReader::close() {
+  if (m_segment) {
+    munmap(const_cast<SharedSampleSegment *>(m_segment), sizeof(SharedSampleSegment));
+    m_segment = nullptr;
+  }
+}
+
+bool SharedSampleReader::latest(SharedSampleRecord &record) const {
+  uint32_t seq;
+  uint64_t count;
+  do {
+    seq = m_segment->seq.load(std::memory_order_acquire);
+    if (seq & 1)
+      continue;
+    count = m_segment->count;
+    record = m_segment->latest;
+    std::atomic_thread_fence(std::memory_order_acquire);
+  } while ((seq & 1) || seq != m_segment->seq.load(std::memory_order_relaxed));
+  return count != 0;
+}
+
+size_t SharedSampleReader::history(SharedSampleRecord *records, size_t maxCount) const {
+  uint32_t seq;
+  size_t n;
+  do {
+    seq = m_segment->seq.load(std::memory_order_acquire);
+    if (seq & 1)
+      continue;
+    const uint64_t count = m_segment->count;
+    n = static_cast<size_t>(std::min<uint64_t>({count, SharedSampleHistorySize, maxCount}));
+    for (size_t i = 0; i < n; ++i)
+      records[i] = m_segment->history[(count - n + i) % SharedSampleHistorySize];
+    std::atomic_thread_fence(std::memory_order_acquire);
+  } while ((seq & 1) || seq != m_segment->seq.load(std::memory_order_relaxed));
+  return n;
+}
+
+uint64_t SharedSampleReader::count() const {
+  uint32_t seq;
+  uint64_t count;
+  do {
+    seq = m_segment->seq.load(std::memory_order_acquire);
+    count = m_segment->count;
+    std::atomic_thread_fence(std::memory_order_acquire);
+  } while ((seq & 1) || seq != m_segment->seq.load(std::memory_order_relaxed));
+  return count;
+}
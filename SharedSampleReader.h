@@ -0,0 +1,26 @@
+#pragma once
+#include "SharedSample.h"
+#include <cstddef>
+
+// Lock-free reader for the segment written by SharedSampleExport.
+// After open() every call is a plain memory read, no syscalls.
+class SharedSampleReader {
+public:
+  SharedSampleReader() = default;
+  ~SharedSampleReader();
+  SharedSampleReader(const SharedSampleReader &) = delete;
+  SharedSampleReader &operator=(const SharedSampleReader &) = delete;
+
+  bool open(const char *name = SharedSampleDefaultName);
+  void close();
+  bool isOpen() const { return m_segment != nullptr; }
+
+  // Returns false if nothing was published yet.
+  bool latest(SharedSampleRecord &record) const;
+  // Copies up to maxCount of the most recent records, oldest first, and returns how many were copied.
+  size_t history(SharedSampleRecord *records, size_t maxCount) const;
+  uint64_t count() const;
+
+private:
+  const SharedSampleSegment *m_segment = nullptr;
+};
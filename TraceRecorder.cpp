@@ -0,0 +1,64 @@
+#include "TraceRecorder.h"
+#include <QDebug>
+
+constexpr char TraceRecorder::Magic[];
+
+bool TraceRecorder::open(const QString &fileName) {
+  m_file.setFileName(fileName);
+  if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qCritical() << "Could not open trace" << fileName << ':' << m_file.errorString();
+    return false;
+  }
+  m_file.write(Magic, 4);
+  m_file.putChar(static_cast<char>(Version));
+  m_clock.start();
+  qDebug() << "Recording characteristic trace to" << fileName;
+  return true;
+}
+
+void TraceRecorder::record(quint8 kind, const QBluetoothUuid &uuid, const QByteArray &value) {
+  if (!m_file.isOpen())
+    return;
+  const qint64 now = m_clock.nsecsElapsed() / 1000;
+  m_buffer.clear();
+  writeVarint(m_buffer, static_cast<quint64>(now - m_lastUs));
+  m_lastUs = now;
+
+  auto it = m_uuids.constFind(uuid);
+  if (it == m_uuids.constEnd()) {
+    const quint32 index = static_cast<quint32>(m_uuids.size());
+    m_uuids.insert(uuid, index);
+    m_buffer.append(static_cast<char>(kind | TraceNewUuid));
+    writeVarint(m_buffer, index);
+    const quint128 raw = uuid.toUInt128();
+    m_buffer.append(reinterpret_cast<const char *>(raw.data), 16);
+  } else {
+    m_buffer.append(static_cast<char>(kind));
+    writeVarint(m_buffer, it.value());
+  }
+  writeVarint(m_buffer, static_cast<quint64>(value.size()));
+  m_buffer.append(value);
+  m_file.write(m_buffer);
+  // Flushed per record so a crash in the field still leaves a usable trace.
+  m_file.flush();
+  m_recorded++;
+}
+
+void TraceRecorder::writeVarint(QByteArray &out, quint64 v) {
+  while (v >= 0x80) {
+    out.append(static_cast<char>((v & 0x7f) | 0x80));
+    v >>= 7;
+  }
+  out.append(static_cast<char>(v));
+}
+
+bool TraceRecorder::readVarint(const char *&p, const char *end, quint64 &v) {
+  v = 0;
+  for (int shift = 0; p < end && shift < 64; shift += 7) {
+    const quint8 b = static_cast<quint8>(*p++);
+    v |= static_cast<quint64>(b & 0x7f) << shift;
+    if (!(b & 0x80))
+      return true;
+  }
+  return false;
+}
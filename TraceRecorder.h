@@ -0,0 +1,35 @@
+#pragma once
+#include <QBluetoothUuid>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+
+// Binary trace of raw characteristic events, replayable with TraceReplayer.
+//
+// File: "MB3T", uint8 version, then records of
+//   varint  microseconds since the previous record
+//   uint8   flags (TraceRead, TraceNewUuid)
+//   varint  uuid index; with TraceNewUuid the 16 uuid bytes follow and define that index
+//   varint  value length, value bytes
+class TraceRecorder {
+public:
+  static constexpr char Magic[] = "MB3T";
+  static constexpr quint8 Version = 1;
+  enum Flags : quint8 { TraceChanged = 0, TraceRead = 1, TraceNewUuid = 2 };
+
+  bool open(const QString &fileName);
+  void record(quint8 kind, const QBluetoothUuid &uuid, const QByteArray &value);
+  quint64 recorded() const { return m_recorded; }
+
+  static void writeVarint(QByteArray &out, quint64 v);
+  static bool readVarint(const char *&p, const char *end, quint64 &v);
+
+private:
+  QFile m_file;
+  QElapsedTimer m_clock;
+  qint64 m_lastUs{};
+  QHash<QBluetoothUuid, quint32> m_uuids;
+  QByteArray m_buffer;
+  quint64 m_recorded{};
+};
@@ -0,0 +1,134 @@
+#include "TraceReplayer.h"
+#include "AllocationCounter.h"
+#include "MiBand3.h"
+#include "TraceRecorder.h"
+#include <QDebug>
+#include <QFile>
+#include <cstring>
+
+TraceReplayer::TraceReplayer(MiBand3 *miBand3, QObject *parent) : QObject(parent), m_miBand3(miBand3) {
+  m_timer.setSingleShot(true);
+  m_timer.setTimerType(Qt::PreciseTimer);
+  connect(&m_timer, &QTimer::timeout, this, &TraceReplayer::replayNext);
+}
+
+bool TraceReplayer::load(const QString &fileName) {
+  QFile file(fileName);
+  if (!file.open(QIODevice::ReadOnly)) {
+    qCritical() << "Could not open trace" << fileName << ':' << file.errorString();
+    return false;
+  }
+  const QByteArray data = file.readAll();
+  m_uuids.clear();
+  m_events.clear();
+  m_next = 0;
+
+  if (data.size() < 5 || !data.startsWith(TraceRecorder::Magic) || static_cast<quint8>(data[4]) != TraceRecorder::Version) {
+    qCritical() << "Not a characteristic trace:" << fileName;
+    return false;
+  }
+  const char *p = data.constData() + 5;
+  const char *end = data.constData() + data.size();
+  qint64 timeUs = 0;
+  while (p < end) {
+    quint64 delta, index, size;
+    if (!TraceRecorder::readVarint(p, end, delta) || p >= end)
+      break;
+    const quint8 flags = static_cast<quint8>(*p++);
+    if (!TraceRecorder::readVarint(p, end, index))
+      break;
+    if (flags & TraceRecorder::TraceNewUuid) {
+      if (end - p < 16 || index != static_cast<quint64>(m_uuids.size()))
+        break;
+      quint128 raw;
+      memcpy(raw.data, p, 16);
+      p += 16;
+      m_uuids.append(QBluetoothUuid(raw));
+    }
+    if (index >= static_cast<quint64>(m_uuids.size()) || !TraceRecorder::readVarint(p, end, size) || size > static_cast<quint64>(end - p))
+      break;
+    timeUs += static_cast<qint64>(delta);
+    // Values are copied out up front, so replaying does not allocate.
+    m_events.append(Event{timeUs, (flags & TraceRecorder::TraceRead) != 0, static_cast<int>(index), QByteArray(p, static_cast<int>(size))});
+    p += size;
+  }
+  if (p != end)
+    qWarning() << "Trace" << fileName << "is truncated, replaying" << m_events.size() << "events";
+  qDebug() << "Loaded trace" << fileName << "with" << m_events.size() << "events";
+  return true;
+}
+
+void TraceReplayer::start() {
+  m_next = 0;
+  m_clock.start();
+  if (m_checkAllocations)
+    checkAllocations();
+  else
+    replayNext();
+}
+
+void TraceReplayer::dispatch(const Event &e) {
+  if (e.read)
+    m_miBand3->handleCharacteristicRead(m_uuids[e.uuid], e.value);
+  else
+    m_miBand3->handleCharacteristicChanged(m_uuids[e.uuid], e.value);
+}
+
+void TraceReplayer::checkAllocations() {
+#ifdef MIBAND3_ALLOCATION_CHECK
+  // The first events take one-time allocations (first use of a sink, stdio buffers, ...).
+  const int warmUp = qMin(m_events.size() / 2, qMax(100, m_events.size() / 10));
+  int allocatingEvents = 0;
+  m_steadyStateAllocations = 0;
+  // Notifications then run the same Streaming path as on a live link, watchdog included.
+  m_miBand3->simulateState(MiBand3::Subscribing);
+  for (int i = 0; i < m_events.size(); ++i) {
+    const quint64 before = AllocationCounter::count();
+    dispatch(m_events[i]);
+    const quint64 allocations = AllocationCounter::count() - before;
+    if (i >= warmUp && allocations) {
+      if (!allocatingEvents++)
+        qCritical() << "Event" << i << "allocated" << allocations << "times";
+      m_steadyStateAllocations += allocations;
+    }
+  }
+  m_miBand3->simulateState(MiBand3::Idle);
+  if (m_steadyStateAllocations)
+    qCritical() << "Allocation check failed:" << m_steadyStateAllocations << "allocations in" << allocatingEvents << "of" << m_events.size() - warmUp
+                << "steady-state events";
+  else
+    qDebug() << "Allocation check passed:" << m_events.size() - warmUp << "steady-state events without allocations";
+#else
+  qCritical() << "Allocation check needs a build with MIBAND3_ALLOCATION_CHECK=ON";
+  m_steadyStateAllocations = 1;
+#endif
+  m_next = m_events.size();
+  emit finished();
+}
+
+void TraceReplayer::replayNext() {
+  // At full speed yield to the event loop every batch, so queued sinks keep up.
+  const int batch = m_speed > 0 ? 1 : 256;
+  for (int i = 0; i < batch && m_next < m_events.size(); ++i) {
+    const Event &e = m_events[m_next];
+    if (m_speed > 0) {
+      const qint64 dueUs = static_cast<qint64>(e.timeUs / m_speed);
+      const qint64 nowUs = m_clock.nsecsElapsed() / 1000;
+      if (dueUs > nowUs) {
+        // Rounded up: a 0 ms timer would spin through the event loop until the event is due.
+        m_timer.start(static_cast<int>((dueUs - nowUs + 999) / 1000));
+        return;
+      }
+    }
+    dispatch(e);
+    m_next++;
+  }
+
+  if (m_next < m_events.size()) {
+    m_timer.start(0);
+    return;
+  }
+  const qint64 ns = m_clock.nsecsElapsed();
+  qDebug() << "Replayed" << m_events.size() << "events in" << ns / 1000000 << "ms," << (ns ? m_events.size() * 1e9 / ns : 0.0) << "events/s";
+  emit finished();
+}
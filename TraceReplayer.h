@@ -0,0 +1,53 @@
+#pragma once
+#include <QBluetoothUuid>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+
+class MiBand3;
+
+// Feeds a trace written by TraceRecorder back through the MiBand3 characteristic handlers.
+class TraceReplayer : public QObject {
+  Q_OBJECT
+public:
+  TraceReplayer(MiBand3 *miBand3, QObject *parent = nullptr);
+
+  bool load(const QString &fileName);
+  // 1.0 replays in real time, 0 as fast as possible.
+  void setSpeed(double speed) { m_speed = speed; }
+  // Replays synchronously with the session in Streaming and counts heap allocations per
+  // event after a warm-up. Needs a build with MIBAND3_ALLOCATION_CHECK.
+  void setCheckAllocations(bool check) { m_checkAllocations = check; }
+  quint64 steadyStateAllocations() const { return m_steadyStateAllocations; }
+
+public slots:
+  void start();
+
+signals:
+  void finished();
+
+private slots:
+  void replayNext();
+
+private:
+  struct Event {
+    qint64 timeUs; // since trace start
+    bool read;
+    int uuid;
+    QByteArray value;
+  };
+  void dispatch(const Event &e);
+  void checkAllocations();
+
+  MiBand3 *m_miBand3;
+  QVector<QBluetoothUuid> m_uuids;
+  QVector<Event> m_events;
+  int m_next{};
+  double m_speed{1.0};
+  bool m_checkAllocations = false;
+  quint64 m_steadyStateAllocations{};
+  QElapsedTimer m_clock;
+  QTimer m_timer;
+};
@@ -0,0 +1,268 @@
+#include "ESP32SPI.h"
+#include "MiBand3.h"
+#include "SampleBus.h"
+#include "SampleCoalescer.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QDBusMessage>
+#include <QDBusMetaType>
+#include <QDBusObjectPath>
+#include <QDBusReply>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QLoggingCategory>
+#include <QTimer>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// End-to-end numbers through the real MiBand3, SampleBus, SampleCoalescer and ESP32SPI
+// classes, with a simulated ESP32 behind ESP32SPI that answers every transfer with its clock:
+//
+//   time to first sample  from process start, and from each forced disconnect, until the
+//                         first HR frame goes out over SPI, split into session phases.
+//                         Needs a band on the system bus, i.e. tools/FakeBluez:
+//                           tools/fake-bluez.sh -d EndToEndBench <build dir>
+//   stream rate           HR frames per second the band delivers through Qt's BlueZ
+//                         backend; FakeBluez --notify-interval 1 finds its ceiling.
+//   throughput ceiling    notifications per second the characteristic handler -> bus ->
+//                         coalescer -> SPI path sustains, with a synchronous bus and with
+//                         the event loop between batches. Runs without D-Bus.
+
+typedef QMap<QString, QVariantMap> InterfaceList;
+typedef QMap<QDBusObjectPath, InterfaceList> ManagedObjectList;
+Q_DECLARE_METATYPE(InterfaceList)
+Q_DECLARE_METATYPE(ManagedObjectList)
+
+static QElapsedTimer processClock;
+
+static double nowMs() { return processClock.nsecsElapsed() / 1e6; }
+
+struct SimulatedEsp32 {
+  quint64 frames = 0;
+  quint64 hrFrames = 0;
+  double firstHrFrame = -1;
+  bool armed = false;
+
+  ESP32SPI::Transfer transfer() {
+    return [this](const char *tx, char *rx, size_t len) {
+      static const char time[] = "2026-01-01T00:00:00";
+      memset(rx, 0, len);
+      memcpy(rx, time, qMin(len, sizeof(time)));
+      frames++;
+      if (memcmp(tx, "hr=", 3) == 0) {
+        hrFrames++;
+        if (armed) {
+          armed = false;
+          firstHrFrame = nowMs();
+        }
+      }
+      return static_cast<int>(len);
+    };
+  }
+};
+
+// Same wiring as the daemon's band 0.
+static void connectPipeline(MiBand3 *band, SampleBus *bus, SampleCoalescer *coalescer, ESP32SPI *esp32) {
+  QObject::connect(band, &MiBand3::dataChanged, bus, [bus](uint8_t hr, uint16_t steps) { bus->publishFromBand(0, hr, steps); });
+  const int sink = bus->subscribe(SampleBus::DropOldest);
+  QObject::connect(bus, &SampleBus::samplesAvailable, coalescer, [bus, coalescer, sink]() {
+    SampleBus::Sample s;
+    while (bus->read(sink, s))
+      coalescer->push(s.hr, s.steps);
+  });
+  QObject::connect(coalescer, &SampleCoalescer::dataChanged, esp32, &ESP32SPI::sendData);
+}
+
+// Latest entry into each state since the last reset.
+struct PhaseClock {
+  double at[MiBand3::StateCount];
+  double start = 0;
+
+  void reset() {
+    std::fill(std::begin(at), std::end(at), -1.0);
+    start = nowMs();
+  }
+  double span(MiBand3::State from, MiBand3::State to) const { return at[from] >= 0 && at[to] >= 0 ? at[to] - at[from] : -1; }
+};
+
+static void printPhases(const char *label, const PhaseClock &phases, double firstFrame) {
+  auto column = [](double ms) {
+    if (ms < 0)
+      printf(" %9s", "-");
+    else
+      printf(" %9.1f", ms);
+  };
+  printf("%-12s", label);
+  column(phases.at[MiBand3::Scanning] >= 0 ? phases.at[MiBand3::Scanning] - phases.start : -1);
+  column(phases.span(MiBand3::Scanning, MiBand3::Connecting));
+  column(phases.span(MiBand3::Connecting, MiBand3::Discovering));
+  column(phases.span(MiBand3::Discovering, MiBand3::Authenticating));
+  column(phases.span(MiBand3::Authenticating, MiBand3::Subscribing));
+  column(phases.span(MiBand3::Subscribing, MiBand3::Streaming));
+  column(firstFrame >= 0 && phases.at[MiBand3::Streaming] >= 0 ? firstFrame - phases.at[MiBand3::Streaming] : -1);
+  column(firstFrame >= 0 ? firstFrame - phases.start : -1);
+  printf("\n");
+}
+
+// Runs the event loop until the simulated ESP32 saw an HR frame or timeoutMs passed.
+static bool waitForFirstFrame(SimulatedEsp32 &esp32, int timeoutMs) {
+  esp32.firstHrFrame = -1;
+  QEventLoop loop;
+  QTimer poll;
+  QObject::connect(&poll, &QTimer::timeout, &loop, [&loop, &esp32]() {
+    if (esp32.firstHrFrame >= 0)
+      loop.quit();
+  });
+  poll.start(1);
+  QTimer::singleShot(timeoutMs, &loop, &QEventLoop::quit);
+  loop.exec();
+  return esp32.firstHrFrame >= 0;
+}
+
+// Drops the band's link the way a radio loss would, from the BlueZ side.
+static bool disconnectBand() {
+  QDBusConnection bus = QDBusConnection::systemBus();
+  QDBusMessage call = QDBusMessage::createMethodCall("org.bluez", "/", "org.freedesktop.DBus.ObjectManager", "GetManagedObjects");
+  QDBusReply<ManagedObjectList> objects = bus.call(call);
+  if (!objects.isValid())
+    return false;
+  for (auto it = objects.value().constBegin(); it != objects.value().constEnd(); ++it) {
+    const QVariantMap device = it.value().value("org.bluez.Device1");
+    if (device.value("Connected").toBool()) {
+      bus.call(QDBusMessage::createMethodCall("org.bluez", it.key().path(), "org.bluez.Device1", "Disconnect"));
+      return true;
+    }
+  }
+  return false;
+}
+
+static void runTimeToFirstSample(int reconnects, int timeoutMs, int streamMs, int scanWindowMs) {
+  SimulatedEsp32 esp32;
+  SampleBus bus(1024);
+  SampleCoalescer coalescer;
+  ESP32SPI spi(esp32.transfer());
+  MiBand3 band;
+  if (scanWindowMs > 0)
+    band.setStateDeadline(MiBand3::Scanning, scanWindowMs);
+  connectPipeline(&band, &bus, &coalescer, &spi);
+
+  // The first run counts from process start.
+  PhaseClock phases;
+  phases.reset();
+  phases.start = 0;
+  // Frames still flushed from the previous link must not count, so the ESP32 only
+  // watches for the first one once the new session subscribes.
+  QObject::connect(&band, &MiBand3::stateChanged, [&phases, &esp32](MiBand3::State state) {
+    phases.at[state] = nowMs();
+    if (state == MiBand3::Subscribing)
+      esp32.armed = true;
+  });
+
+  printf("time to first sample (ms)\n%-12s %9s %9s %9s %9s %9s %9s %9s %9s\n", "", "to scan", "scan", "connect", "discover", "auth", "subscribe", "sample",
+         "total");
+  band.startSearch();
+  if (!waitForFirstFrame(esp32, timeoutMs)) {
+    printPhases("start", phases, -1);
+    printf("no sample within %d ms\n", timeoutMs);
+    return;
+  }
+  printPhases("start", phases, esp32.firstHrFrame);
+
+  for (int i = 0; i < reconnects; ++i) {
+    // Let the session settle into streaming before pulling the link.
+    QEventLoop settle;
+    QTimer::singleShot(1000, &settle, &QEventLoop::quit);
+    settle.exec();
+    phases.reset();
+    esp32.armed = false;
+    if (!disconnectBand()) {
+      printf("no connected band to disconnect\n");
+      return;
+    }
+    const QByteArray label = QByteArray("reconnect ") + QByteArray::number(i + 1);
+    if (!waitForFirstFrame(esp32, timeoutMs)) {
+      printPhases(label.constData(), phases, -1);
+      printf("no sample within %d ms\n", timeoutMs);
+      return;
+    }
+    printPhases(label.constData(), phases, esp32.firstHrFrame);
+  }
+
+  quint64 notifications = 0;
+  QObject::connect(&band, &MiBand3::dataChanged, [&notifications]() { notifications++; });
+  const quint64 frames = esp32.hrFrames;
+  QEventLoop stream;
+  QTimer::singleShot(streamMs, &stream, &QEventLoop::quit);
+  stream.exec();
+  printf("stream rate: %.1f notifications/s, %.1f SPI frames/s over %d ms\n", notifications * 1000.0 / streamMs, (esp32.hrFrames - frames) * 1000.0 / streamMs,
+         streamMs);
+}
+
+static void runThroughput(bool synchronous, int durationMs) {
+  SimulatedEsp32 esp32;
+  SampleBus bus(1024);
+  bus.setSynchronous(synchronous);
+  SampleCoalescer coalescer;
+  coalescer.setMinInterval(0);
+  ESP32SPI spi(esp32.transfer());
+  MiBand3 band;
+  connectPipeline(&band, &bus, &coalescer, &spi);
+
+  // Every notification carries a new HR so the coalescer forwards each one.
+  QByteArray hr(2, 0);
+  const int batch = 64;
+  quint64 notifications = 0;
+  QElapsedTimer timer;
+  timer.start();
+  while (timer.elapsed() < durationMs) {
+    for (int i = 0; i < batch; ++i) {
+      hr[1] = static_cast<char>(60 + notifications++ % 40);
+      band.handleCharacteristicChanged(QBluetoothUuid::HeartRateMeasurement, hr);
+    }
+    if (!synchronous)
+      QCoreApplication::processEvents();
+  }
+  QCoreApplication::processEvents();
+  const double seconds = timer.nsecsElapsed() / 1e9;
+  printf("%-12s %10.0f notifications/s %10.0f SPI frames/s %8.0f ns/notification\n", synchronous ? "synchronous" : "event loop", notifications / seconds,
+         esp32.hrFrames / seconds, seconds * 1e9 / notifications);
+}
+
+int main(int argc, char *argv[]) {
+  processClock.start();
+  QCoreApplication a(argc, argv);
+  QCommandLineParser parser;
+  parser.addHelpOption();
+  QCommandLineOption reconnectsOption("reconnects", "Forced disconnects after the first sample.", "count", "3");
+  parser.addOption(reconnectsOption);
+  QCommandLineOption timeoutOption("timeout", "Give up waiting for a sample after <ms>.", "ms", "60000");
+  parser.addOption(timeoutOption);
+  QCommandLineOption streamOption("stream", "Measure the band's stream rate over <ms>.", "ms", "5000");
+  parser.addOption(streamOption);
+  QCommandLineOption scanWindowOption("scan-window", "End scans after <ms> instead of the daemon's default.", "ms", "0");
+  parser.addOption(scanWindowOption);
+  QCommandLineOption throughputOption("throughput", "Run each throughput variant for <ms>.", "ms", "3000");
+  parser.addOption(throughputOption);
+  parser.process(a);
+
+  QLoggingCategory::setFilterRules("*.debug=false\n*.warning=false");
+  qDBusRegisterMetaType<InterfaceList>();
+  qDBusRegisterMetaType<ManagedObjectList>();
+
+  QDBusConnectionInterface *busInterface = QDBusConnection::systemBus().interface();
+  if (busInterface && busInterface->isServiceRegistered("org.bluez")) {
+    runTimeToFirstSample(parser.value(reconnectsOption).toInt(), parser.value(timeoutOption).toInt(), qMax(1, parser.value(streamOption).toInt()),
+                         parser.value(scanWindowOption).toInt());
+  } else {
+    printf("time to first sample: skipped, no org.bluez on the system bus (run through tools/fake-bluez.sh -d EndToEndBench)\n");
+  }
+
+  printf("throughput ceiling\n");
+  const int durationMs = qMax(100, parser.value(throughputOption).toInt());
+  runThroughput(true, durationMs);
+  runThroughput(false, durationMs);
+  return 0;
+}
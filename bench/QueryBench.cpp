@@ -0,0 +1,172 @@
+#include "SampleLogIndex.h"
+#include "SampleQueryService.h"
+#include "SampleRollups.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// Sends one request and reads up to its END/ERR line; returns the number of rows.
+static long query(int fd, const std::string &request, std::string &buffer) {
+  std::string line = request + '\n';
+  if (send(fd, line.data(), line.size(), 0) < 0)
+    return -1;
+  long rows = 0;
+  for (;;) {
+    size_t nl;
+    while ((nl = buffer.find('\n')) != std::string::npos) {
+      const bool end = buffer.compare(0, 4, "END ") == 0 || buffer.compare(0, 4, "ERR ") == 0;
+      buffer.erase(0, nl + 1);
+      if (end)
+        return rows;
+      rows++;
+    }
+    char chunk[65536];
+    const ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0)
+      return -1;
+    buffer.append(chunk, n);
+  }
+}
+
+struct Case {
+  const char *name;
+  int runs;
+  std::string (*make)(std::mt19937_64 &rng, qint64 begin, qint64 end);
+};
+
+// Latency of point, range and rollup queries through SampleQueryService over months of
+// samples, next to a full scan of the log for the same kind of range.
+int main(int argc, char *argv[]) {
+  QCoreApplication a(argc, argv);
+  QTextStream out(stdout);
+  const int days = argc > 1 ? atoi(argv[1]) : 90;
+  const int bands = 2;
+  const qint64 intervalMs = 10'000;
+  const qint64 begin = 1'600'000'000'000LL;
+  const qint64 end = begin + days * 86'400'000LL;
+
+  QTemporaryDir dir;
+  const QString logFile = dir.filePath("samples.log");
+  SampleRollups rollups(nullptr, dir.filePath("rollups"));
+  {
+    QFile log(logFile);
+    log.open(QIODevice::WriteOnly);
+    std::mt19937 rng(1);
+    char line[64];
+    QByteArray chunk;
+    for (qint64 t = begin; t < end; t += intervalMs) {
+      for (int b = 0; b < bands; ++b) {
+        const SampleBus::Sample s{t + b, SampleBus::SampleType::HeartRate, static_cast<uint8_t>(b), static_cast<uint8_t>(60 + rng() % 60),
+                                  static_cast<uint16_t>((t % 86'400'000LL) / 8640)};
+        chunk.append(line, snprintf(line, sizeof(line), "%lld;%hhu;%hhu;%hu\n", static_cast<long long>(s.timestamp), s.band, s.hr, s.steps));
+        rollups.add(s);
+      }
+      if (chunk.size() > (1 << 20)) {
+        log.write(chunk);
+        chunk.clear();
+      }
+    }
+    log.write(chunk);
+    out << "log: " << days << " days, " << bands << " bands, " << log.size() / (1 << 20) << " MiB\n";
+  }
+
+  QElapsedTimer timer;
+  timer.start();
+  SampleLogIndex index(logFile);
+  index.update();
+  out << "index build: " << timer.elapsed() << " ms, " << index.entries() << " entries\n";
+  timer.restart();
+  SampleLogIndex reloaded(logFile);
+  reloaded.update();
+  out << "index reload: " << timer.elapsed() << " ms\n";
+
+  // Baseline: what a range query costs without the index.
+  timer.restart();
+  {
+    SampleBus::Sample batch[256];
+    long rows = 0;
+    QFile log(logFile);
+    log.open(QIODevice::ReadOnly);
+    const qint64 from = begin + (end - begin) / 2, to = from + 86'400'000LL;
+    while (!log.atEnd()) {
+      const QByteArray l = log.readLine();
+      if (parseSampleLine(l.constData(), l.constData() + l.size(), batch[0]) && batch[0].timestamp >= from && batch[0].timestamp < to)
+        rows++;
+    }
+    out << "full scan, 1 day range: " << timer.elapsed() << " ms, " << rows << " rows\n";
+  }
+  out.flush();
+
+  const QString socketPath = dir.filePath("query.sock");
+  SampleQueryService service(socketPath, &index, &rollups);
+
+  const Case cases[] = {
+      {"POINT", 1000, [](std::mt19937_64 &rng, qint64 b, qint64 e) { return "POINT " + std::to_string(rng() % 2) + ' ' + std::to_string(b + rng() % (e - b)); }},
+      {"RANGE 1 h", 200,
+       [](std::mt19937_64 &rng, qint64 b, qint64 e) {
+         const qint64 t = b + rng() % (e - b - 3'600'000);
+         return "RANGE " + std::to_string(rng() % 2) + ' ' + std::to_string(t) + ' ' + std::to_string(t + 3'600'000);
+       }},
+      {"RANGE 1 day, all bands", 20,
+       [](std::mt19937_64 &rng, qint64 b, qint64 e) {
+         const qint64 t = b + rng() % (e - b - 86'400'000);
+         return "RANGE * " + std::to_string(t) + ' ' + std::to_string(t + 86'400'000);
+       }},
+      {"AGG 1 week", 200,
+       [](std::mt19937_64 &rng, qint64 b, qint64 e) {
+         const qint64 t = b + rng() % (e - b - 604'800'000);
+         return "AGG " + std::to_string(rng() % 2) + ' ' + std::to_string(t) + ' ' + std::to_string(t + 604'800'000);
+       }},
+      {"AGG 30 days 15m", 50,
+       [](std::mt19937_64 &rng, qint64 b, qint64 e) {
+         const qint64 t = b + rng() % (e - b - 2'592'000'000LL);
+         return "AGG " + std::to_string(rng() % 2) + ' ' + std::to_string(t) + ' ' + std::to_string(t + 2'592'000'000LL) + " 15m";
+       }},
+  };
+
+  std::thread client([&]() {
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath.toLocal8Bit().constData(), sizeof(addr.sun_path) - 1);
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+      perror("Could not connect to query socket");
+      QMetaObject::invokeMethod(&a, "quit", Qt::QueuedConnection);
+      return;
+    }
+    std::mt19937_64 rng(2);
+    std::string buffer;
+    for (const Case &c : cases) {
+      std::vector<double> us;
+      long rows = 0;
+      for (int i = 0; i < c.runs; ++i) {
+        const std::string request = c.make(rng, begin, end);
+        const auto start = Clock::now();
+        rows += query(fd, request, buffer);
+        us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+      }
+      std::sort(us.begin(), us.end());
+      printf("%-24s p50 %8.0f us  p99 %8.0f us  %7ld rows/query\n", c.name, us[us.size() / 2], us[us.size() * 99 / 100], rows / c.runs);
+      fflush(stdout);
+    }
+    close(fd);
+    QMetaObject::invokeMethod(&a, "quit", Qt::QueuedConnection);
+  });
+  a.exec();
+  client.join();
+  return 0;
+}
@@ -0,0 +1,40 @@
+#include "SampleBus.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTextStream>
+
+// Fan-out throughput of SampleBus: one writer, N sinks draining in place after every batch.
+int main(int argc, char *argv[]) {
+  QCoreApplication a(argc, argv);
+  QTextStream out(stdout);
+  const int samples = 10'000'000;
+  const int batch = 64;
+
+  for (int sinkCount : {1, 2, 4, 8}) {
+    SampleBus bus(1024);
+    QVector<int> sinks;
+    for (int i = 0; i < sinkCount; ++i)
+      sinks.append(bus.subscribe(i % 2 ? SampleBus::SkipToLatest : SampleBus::DropOldest));
+
+    quint64 checksum = 0;
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < samples; i += batch) {
+      for (int j = 0; j < batch; ++j)
+        bus.publishSample(SampleBus::Sample{i + j, SampleBus::SampleType::HeartRate, 0, static_cast<uint8_t>(j), static_cast<uint16_t>(i)});
+      for (int sink : sinks) {
+        while (const SampleBus::Sample *s = bus.peek(sink)) {
+          checksum += s->hr;
+          bus.consume(sink);
+        }
+      }
+    }
+    const qint64 ns = timer.nsecsElapsed();
+    quint64 dropped = 0;
+    for (int sink : sinks)
+      dropped += bus.dropped(sink);
+    out << "sinks=" << sinkCount << " publish+fanout " << (samples * 1e9 / ns) / 1e6 << " M samples/s, " << (samples * double(sinkCount) * 1e9 / ns) / 1e6
+        << " M deliveries/s, dropped=" << dropped << " checksum=" << checksum << '\n';
+  }
+  return 0;
+}
@@ -0,0 +1,120 @@
+#include "MiBand3.h"
+#include "ScanFilter.h"
+#include <QBluetoothDeviceInfo>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// Replays synthetic advertisements from a crowded room through the scan path: the old
+// per-advertisement handling (two service list copies, a linear contains and two debug
+// lines each time) against ScanFilter. Log output is discarded, its formatting is not.
+//
+// Most devices announce a maker (phones, laptops, headsets), the rest only services; a few
+// are Mi Bands. Every scan window the seen-set starts over, like a new scan would.
+
+static void discardMessages(QtMsgType, const QMessageLogContext &, const QString &) {}
+
+// What MiBand3::addDevice did for every advertisement.
+static bool legacyAddDevice(const QBluetoothDeviceInfo &device, const QBluetoothUuid &service) {
+  bool found = false;
+  if (device.coreConfigurations() & QBluetoothDeviceInfo::LowEnergyCoreConfiguration) {
+    auto services = device.serviceUuids();
+    found = services.contains(service);
+    qDebug() << "Low Energy device found" << device.name() << ". Scanning more...";
+    qDebug() << "Services:" << device.serviceUuids();
+  }
+  return found;
+}
+
+int main(int argc, char *argv[]) {
+  QCoreApplication a(argc, argv);
+  QCommandLineParser parser;
+  parser.addHelpOption();
+  QCommandLineOption devicesOption("devices", "Distinct advertisers in range.", "count", "2000");
+  parser.addOption(devicesOption);
+  QCommandLineOption bandsOption("bands", "Mi Bands among them.", "count", "3");
+  parser.addOption(bandsOption);
+  QCommandLineOption advertisementsOption("advertisements", "Advertisements to replay.", "count", "200000");
+  parser.addOption(advertisementsOption);
+  QCommandLineOption rateOption("rate", "Advertisements per second in the room, sets the scan window size and the CPU share.", "count", "500");
+  parser.addOption(rateOption);
+  parser.process(a);
+  const int deviceCount = qMax(1, parser.value(devicesOption).toInt());
+  const int bandCount = qBound(0, parser.value(bandsOption).toInt(), deviceCount);
+  const int advertisements = qMax(1, parser.value(advertisementsOption).toInt());
+  const int rate = qMax(1, parser.value(rateOption).toInt());
+  // The daemon scans for 15 s at a time.
+  const int window = rate * 15;
+
+  const QBluetoothUuid miBand0{QString(MiBand3::ServiceMiBand0Uuid)};
+  const QBluetoothUuid miBand1{QString(MiBand3::ServiceMiBand1Uuid)};
+  const quint16 otherMakers[] = {0x004c, 0x0006, 0x0075, 0x00e0, 0x0059};
+  const QBluetoothUuid otherServices[] = {QBluetoothUuid(QBluetoothUuid::BatteryService), QBluetoothUuid(QBluetoothUuid::DeviceInformation),
+                                          QBluetoothUuid(QBluetoothUuid::HumanInterfaceDevice), QBluetoothUuid(QString("0000fe9f-0000-1000-8000-00805f9b34fb")),
+                                          QBluetoothUuid(QString("0000fd6f-0000-1000-8000-00805f9b34fb")), QBluetoothUuid(QBluetoothUuid::HeartRate)};
+
+  std::mt19937 rng(42);
+  std::vector<QBluetoothDeviceInfo> devices;
+  devices.reserve(deviceCount);
+  for (int i = 0; i < deviceCount; ++i) {
+    const bool band = i < bandCount;
+    QBluetoothDeviceInfo device(QBluetoothAddress(0xC80F10000000ull + i), band ? "Mi Band 3" : QString("device-%1").arg(i), 0);
+    device.setCoreConfigurations(QBluetoothDeviceInfo::LowEnergyCoreConfiguration);
+    QList<QBluetoothUuid> services;
+    if (band) {
+      services << miBand0 << miBand1;
+    } else {
+      for (int s = rng() % 7; s > 0; --s)
+        services << otherServices[rng() % 6];
+    }
+    device.setServiceUuids(services, QBluetoothDeviceInfo::DataComplete);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+    if (band)
+      device.setManufacturerData(MiBand3::ManufacturerId, QByteArray(8, 0));
+    else if (rng() % 10 < 6)
+      device.setManufacturerData(otherMakers[rng() % 5], QByteArray(16, 0));
+#endif
+    devices.push_back(device);
+  }
+
+  // Busy advertisers repeat far more often than quiet ones.
+  std::vector<int> sequence(advertisements);
+  std::geometric_distribution<int> pick(3.0 / deviceCount);
+  for (int &index : sequence)
+    index = pick(rng) % deviceCount;
+
+  qInstallMessageHandler(discardMessages);
+
+  QElapsedTimer timer;
+  int legacyFound = 0;
+  timer.start();
+  for (int index : sequence)
+    legacyFound += legacyAddDevice(devices[index], miBand0);
+  const double legacyNs = timer.nsecsElapsed() / double(advertisements);
+
+  ScanFilter filter(miBand0, MiBand3::ManufacturerId);
+  int candidates = 0;
+  int distinct = 0;
+  timer.restart();
+  for (int i = 0; i < advertisements; ++i) {
+    if (i % window == 0) {
+      distinct += filter.devices();
+      filter.reset();
+    }
+    candidates += filter.check(devices[sequence[i]]) == ScanFilter::Candidate;
+  }
+  const double filterNs = timer.nsecsElapsed() / double(advertisements);
+  distinct += filter.devices();
+
+  qInstallMessageHandler(nullptr);
+  printf("%d advertisements from %d devices (%d bands), %d distinct per scan window of %d\n", advertisements, deviceCount, bandCount,
+         distinct / ((advertisements + window - 1) / window), window);
+  printf("%-8s %10.0f ns/advertisement %12.0f advertisements/s %6.2f%% CPU at %d/s, %d band hits\n", "legacy", legacyNs, 1e9 / legacyNs,
+         legacyNs * rate / 1e7, rate, legacyFound);
+  printf("%-8s %10.0f ns/advertisement %12.0f advertisements/s %6.2f%% CPU at %d/s, %d band hits\n", "filter", filterNs, 1e9 / filterNs,
+         filterNs * rate / 1e7, rate, candidates);
+  return 0;
+}
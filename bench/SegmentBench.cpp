@@ -0,0 +1,167 @@
+#include "SampleLogIndex.h"
+#include "SampleSegment.h"
+#include <QFile>
+#include <QUuid>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static std::vector<SegmentSample> synthetic(int count) {
+  std::mt19937 rng(7);
+  std::vector<SegmentSample> samples;
+  qint64 t = 1'600'000'000'000LL;
+  int hr = 70;
+  quint16 steps = 0;
+  for (int i = 0; i < count; ++i) {
+    t += 1000 + static_cast<int>(rng() % 41) - 20;
+    if (rng() % 4 == 0)
+      hr = std::max(40, std::min(190, hr + static_cast<int>(rng() % 5) - 2));
+    if (rng() % 3 == 0)
+      steps += rng() % 3;
+    samples.push_back(SegmentSample{t, 0, steps, static_cast<quint8>(hr)});
+  }
+  return samples;
+}
+
+static bool readVarint(const char *&p, const char *end, quint64 &v) {
+  v = 0;
+  for (int shift = 0; p < end && shift < 64; shift += 7) {
+    const quint8 b = static_cast<quint8>(*p++);
+    v |= static_cast<quint64>(b & 0x7f) << shift;
+    if (!(b & 0x80))
+      return true;
+  }
+  return false;
+}
+
+// Samples a recorded trace (see TraceRecorder.h) produces: one per HR notification, with
+// the steps of the last read, as MiBand3 publishes them. The trace clock starts at 2020-09-13.
+static bool readTrace(const QByteArray &trace, std::vector<SegmentSample> &samples, qint64 &textBytes) {
+  static const QUuid hrUuid("00002a37-0000-1000-8000-00805f9b34fb");
+  static const QUuid stepsUuid("00000007-0000-3512-2118-0009af100700");
+  std::vector<QUuid> uuids;
+  const char *p = trace.constData() + 5;
+  const char *end = trace.constData() + trace.size();
+  qint64 us = 0;
+  quint16 steps = 0;
+  while (p < end) {
+    quint64 delta, index, length;
+    if (!readVarint(p, end, delta) || p == end)
+      return false;
+    const quint8 flags = static_cast<quint8>(*p++);
+    if (!readVarint(p, end, index))
+      return false;
+    if (flags & 2) {
+      if (end - p < 16)
+        return false;
+      uuids.resize(std::max<size_t>(uuids.size(), index + 1));
+      uuids[index] = QUuid::fromRfc4122(QByteArray(p, 16));
+      p += 16;
+    }
+    if (!readVarint(p, end, length) || static_cast<quint64>(end - p) < length || index >= uuids.size())
+      return false;
+    us += static_cast<qint64>(delta);
+    const QByteArray value(p, static_cast<int>(length));
+    p += length;
+    if ((flags & 1) && uuids[index] == stepsUuid && value.size() >= 2) {
+      steps = static_cast<quint16>(static_cast<quint8>(value[0]) << 8 | static_cast<quint8>(value[1]));
+    } else if (!(flags & 1) && uuids[index] == hrUuid && value.size() >= 2) {
+      const SegmentSample s{1'600'000'000'000LL + us / 1000, 0, steps, static_cast<quint8>(value[1])};
+      samples.push_back(s);
+      char line[64];
+      textBytes += snprintf(line, sizeof(line), "%lld;%hhu;%hhu;%hu\n", static_cast<long long>(s.timestamp), 0, s.hr, s.steps);
+    }
+  }
+  return true;
+}
+
+// Compression ratio, flash writes and encode/decode throughput of SampleSegment. Real
+// input is a recorded trace (.mb3t, e.g. tests/hr-stream.mb3t) or a sample log, such as
+// one written by replaying traces with --replay <trace> --log <file>; only band 0 is used.
+// Without an argument a synthetic 1 Hz day is used.
+int main(int argc, char *argv[]) {
+  std::vector<SegmentSample> samples;
+  qint64 textBytes = 0;
+  if (argc > 1) {
+    QFile log(argv[1]);
+    if (!log.open(QIODevice::ReadOnly)) {
+      fprintf(stderr, "Could not open %s\n", argv[1]);
+      return 1;
+    }
+    if (log.peek(4) == "MB3T" && !readTrace(log.readAll(), samples, textBytes)) {
+      fprintf(stderr, "Trace %s is cut short\n", argv[1]);
+      return 1;
+    }
+    while (!log.atEnd()) {
+      const QByteArray line = log.readLine();
+      SampleBus::Sample s;
+      if (parseSampleLine(line.constData(), line.constData() + line.size(), s) && s.band == 0) {
+        samples.push_back(SegmentSample{s.timestamp, 0, s.steps, s.hr});
+        textBytes += line.size();
+      }
+    }
+  } else {
+    samples = synthetic(86400);
+    textBytes = static_cast<qint64>(samples.size()) * 25;
+  }
+  if (samples.empty()) {
+    fprintf(stderr, "No samples\n");
+    return 1;
+  }
+  const double n = static_cast<double>(samples.size());
+
+  SegmentEncoder encoder;
+  const auto encodeStart = Clock::now();
+  for (const SegmentSample &s : samples)
+    encoder.append(s);
+  const QByteArray segment = encoder.seal();
+  const double encodeS = std::chrono::duration<double>(Clock::now() - encodeStart).count();
+
+  SegmentReader reader;
+  if (!reader.setData(reinterpret_cast<const uchar *>(segment.constData()), segment.size())) {
+    fprintf(stderr, "Segment does not parse\n");
+    return 1;
+  }
+  SegmentSample block[SegmentEncoder::BlockSamples];
+  quint64 checksum = 0;
+  int decoded = 0;
+  const int rounds = std::max(1, static_cast<int>(20'000'000 / n));
+  const auto decodeStart = Clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    for (int b = 0; b < reader.blockCount(); ++b) {
+      const int count = reader.decodeBlock(b, block);
+      for (int i = 0; i < count; ++i)
+        checksum += block[i].hr + block[i].steps;
+      decoded += count;
+    }
+  }
+  const double decodeS = std::chrono::duration<double>(Clock::now() - decodeStart).count();
+
+  // Round trip check against the input.
+  size_t k = 0;
+  for (int b = 0; b < reader.blockCount(); ++b) {
+    const int count = reader.decodeBlock(b, block);
+    for (int i = 0; i < count; ++i, ++k) {
+      const SegmentSample &a = samples[k];
+      if (a.timestamp != block[i].timestamp || a.hr != block[i].hr || a.steps != block[i].steps) {
+        fprintf(stderr, "Mismatch at sample %zu\n", k);
+        return 1;
+      }
+    }
+  }
+
+  printf("%.0f samples in %d blocks\n", n, reader.blockCount());
+  printf("text log      %8.2f bytes/sample\n", textBytes / n);
+  printf("raw struct    %8.2f bytes/sample\n", static_cast<double>(sizeof(SegmentSample)));
+  printf("segment       %8.2f bytes/sample, %.1fx smaller than the text log\n", segment.size() / n, textBytes / static_cast<double>(segment.size()));
+  // SampleSegmentSink appends each block once it closes, the last one with the index on
+  // seal; SampleLogSink flushes a line per sample at the band's 1 Hz.
+  printf("flash writes  %8d for the segment, %.0f for the text log\n", reader.blockCount(), n);
+  printf("encode        %8.1f M samples/s\n", n / encodeS / 1e6);
+  printf("decode        %8.1f M samples/s (checksum %llu)\n", decoded / decodeS / 1e6, static_cast<unsigned long long>(checksum));
+  return 0;
+}
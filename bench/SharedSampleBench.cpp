@@ -0,0 +1,76 @@
+#include "SharedSampleReader.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Reader latency of the shared sample seqlock while a writer thread updates continuously.
+int main() {
+  const char *name = "/miband3-bench";
+  int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+  if (fd < 0 || ftruncate(fd, sizeof(SharedSampleSegment)) < 0) {
+    perror("Could not create bench segment");
+    return 1;
+  }
+  void *p = mmap(nullptr, sizeof(SharedSampleSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    perror("Could not map bench segment");
+    return 1;
+  }
+  auto segment = new (p) SharedSampleSegment{};
+  segment->magic = SharedSampleMagic;
+  segment->version = SharedSampleVersion;
+
+  std::atomic<bool> running{true};
+  std::atomic<uint64_t> writes{0};
+  std::thread writer([&]() {
+    int64_t t = 0;
+    while (running.load(std::memory_order_relaxed)) {
+      sharedSampleWrite(segment, SharedSampleRecord{t, static_cast<uint8_t>(t), 0, static_cast<uint16_t>(t), 0});
+      ++t;
+      writes.store(t, std::memory_order_relaxed);
+    }
+  });
+
+  SharedSampleReader reader;
+  if (!reader.open(name))
+    return 1;
+
+  using Clock = std::chrono::steady_clock;
+  const int iterations = 1'000'000;
+  std::vector<uint32_t> latencies(iterations);
+  SharedSampleRecord record{};
+  uint64_t torn = 0;
+  for (int i = 0; i < iterations; ++i) {
+    auto start = Clock::now();
+    reader.latest(record);
+    latencies[i] = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    if (record.hr != static_cast<uint8_t>(record.timestamp) || record.steps != static_cast<uint16_t>(record.timestamp))
+      ++torn;
+  }
+  SharedSampleRecord history[SharedSampleHistorySize];
+  auto start = Clock::now();
+  const int historyReads = 10'000;
+  for (int i = 0; i < historyReads; ++i)
+    reader.history(history, SharedSampleHistorySize);
+  auto historyNs = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count() / historyReads;
+
+  running = false;
+  writer.join();
+  std::sort(latencies.begin(), latencies.end());
+  printf("latest(): p50 %u ns, p99 %u ns, p99.9 %u ns, max %u ns, torn reads %llu\n", latencies[iterations / 2], latencies[iterations * 99 / 100],
+         latencies[iterations * 999 / 1000], latencies.back(), static_cast<unsigned long long>(torn));
+  printf("history(%u): %lld ns per read, writer did %llu updates\n", SharedSampleHistorySize, static_cast<long long>(historyNs),
+         static_cast<unsigned long long>(writes.load()));
+
+  reader.close();
+  munmap(segment, sizeof(SharedSampleSegment));
+  shm_unlink(name);
+  return 0;
+}
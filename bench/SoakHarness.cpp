@@ -0,0 +1,165 @@
+#include "MiBand3.h"
+#include "ProcessStats.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QDBusMessage>
+#include <QDBusMetaType>
+#include <QDBusObjectPath>
+#include <QDBusReply>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QLoggingCategory>
+#include <QTimer>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+// Drives a MiBand3 session through hundreds of scan, connect, discover, authenticate,
+// stream and disconnect cycles and fails if memory, fds or QObjects keep growing.
+//
+// The band is tools/FakeBluez on a private system bus, so every cycle goes through Qt's
+// BlueZ backend: the controller, the services, auth and the HR subscription are created
+// and torn down for real. Each cycle waits for Streaming and a few HR notifications, then
+// drops the link from the BlueZ side the way a radio loss would.
+//   tools/fake-bluez.sh -t 3600 -f "--notify-interval 20" -d SoakHarness <build dir>
+
+typedef QMap<QString, QVariantMap> InterfaceList;
+typedef QMap<QDBusObjectPath, InterfaceList> ManagedObjectList;
+Q_DECLARE_METATYPE(InterfaceList)
+Q_DECLARE_METATYPE(ManagedObjectList)
+
+// Runs the event loop until done() holds or timeoutMs passed.
+static bool waitFor(const std::function<bool()> &done, int timeoutMs) {
+  if (done())
+    return true;
+  QEventLoop loop;
+  QTimer poll;
+  QObject::connect(&poll, &QTimer::timeout, &loop, [&loop, &done]() {
+    if (done())
+      loop.quit();
+  });
+  poll.start(1);
+  QTimer::singleShot(timeoutMs, &loop, &QEventLoop::quit);
+  loop.exec();
+  return done();
+}
+
+static bool disconnectBand() {
+  QDBusConnection bus = QDBusConnection::systemBus();
+  QDBusMessage call = QDBusMessage::createMethodCall("org.bluez", "/", "org.freedesktop.DBus.ObjectManager", "GetManagedObjects");
+  QDBusReply<ManagedObjectList> objects = bus.call(call);
+  if (!objects.isValid())
+    return false;
+  for (auto it = objects.value().constBegin(); it != objects.value().constEnd(); ++it) {
+    const QVariantMap device = it.value().value("org.bluez.Device1");
+    if (device.value("Connected").toBool()) {
+      bus.call(QDBusMessage::createMethodCall("org.bluez", it.key().path(), "org.bluez.Device1", "Disconnect"));
+      return true;
+    }
+  }
+  return false;
+}
+
+int main(int argc, char *argv[]) {
+  QCoreApplication a(argc, argv);
+  QCommandLineParser parser;
+  parser.addHelpOption();
+  QCommandLineOption cyclesOption("cycles", "Connect/disconnect cycles to run.", "count", "1000");
+  parser.addOption(cyclesOption);
+  QCommandLineOption streamOption("stream", "HR notifications per cycle.", "count", "5");
+  parser.addOption(streamOption);
+  QCommandLineOption sampleOption("sample-every", "Cycles between resource samples.", "count", "25");
+  parser.addOption(sampleOption);
+  QCommandLineOption scanWindowOption("scan-window", "End scans after <ms> instead of the daemon's default.", "ms", "300");
+  parser.addOption(scanWindowOption);
+  QCommandLineOption timeoutOption("timeout", "Fail a cycle that does not stream within <ms>.", "ms", "30000");
+  parser.addOption(timeoutOption);
+  parser.process(a);
+  const int sampleEvery = qMax(1, parser.value(sampleOption).toInt());
+  // At least two samples per quarter of the run.
+  const int cycles = qMax(8 * sampleEvery, parser.value(cyclesOption).toInt());
+  const int stream = qMax(1, parser.value(streamOption).toInt());
+  const int timeoutMs = parser.value(timeoutOption).toInt();
+
+  QLoggingCategory::setFilterRules("*.debug=false\n*.warning=false\n*.critical=false");
+  qDBusRegisterMetaType<InterfaceList>();
+  qDBusRegisterMetaType<ManagedObjectList>();
+  QDBusConnectionInterface *busInterface = QDBusConnection::systemBus().interface();
+  if (!busInterface || !busInterface->isServiceRegistered("org.bluez")) {
+    printf("no org.bluez on the system bus, run through tools/fake-bluez.sh -d SoakHarness\n");
+    return 2;
+  }
+
+  MiBand3 *band = new MiBand3(&a);
+  band->setStateDeadline(MiBand3::Scanning, qMax(1, parser.value(scanWindowOption).toInt()));
+  MiBand3::State state = MiBand3::Idle;
+  int notifications = 0;
+  QObject::connect(band, &MiBand3::stateChanged, [&state](MiBand3::State s) { state = s; });
+  QObject::connect(band, &MiBand3::dataChanged, [&notifications]() { notifications++; });
+
+  std::vector<ProcessStats> samples;
+  QElapsedTimer timer;
+  timer.start();
+  band->startSearch();
+  for (int cycle = 1; cycle <= cycles; ++cycle) {
+    notifications = 0;
+    if (!waitFor([&]() { return state == MiBand3::Streaming && notifications >= stream; }, timeoutMs)) {
+      printf("cycle %d: stuck in state %d with %d notifications\nFAIL\n", cycle, state, notifications);
+      return 1;
+    }
+    if (!disconnectBand()) {
+      printf("cycle %d: no connected band to disconnect\nFAIL\n", cycle);
+      return 1;
+    }
+    // The session tears down and starts the next scan on its own.
+    if (!waitFor([&]() { return state != MiBand3::Streaming; }, timeoutMs)) {
+      printf("cycle %d: disconnect not noticed\nFAIL\n", cycle);
+      return 1;
+    }
+    QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+    if (cycle % sampleEvery == 0)
+      samples.push_back(ProcessStats::sample({&a}));
+  }
+  const double seconds = timer.elapsed() / 1000.0;
+
+  // Growth per 1000 cycles between the second quarter and the last quarter of the run;
+  // the first quarter is warm-up (allocator pools, lazily created Qt internals).
+  const size_t q = samples.size() / 4;
+  auto average = [&samples](size_t from, size_t to, qint64 ProcessStats::*field) {
+    double sum = 0;
+    for (size_t i = from; i < to; ++i)
+      sum += samples[i].*field;
+    return sum / (to - from);
+  };
+  auto averageInt = [&samples](size_t from, size_t to, int ProcessStats::*field) {
+    double sum = 0;
+    for (size_t i = from; i < to; ++i)
+      sum += samples[i].*field;
+    return sum / (to - from);
+  };
+  const double span = (samples.size() - q - q) * static_cast<double>(sampleEvery) / 1000.0;
+  struct Check {
+    const char *name;
+    double early, late, limit;
+  };
+  const Check checks[] = {
+      {"rss kB", average(q, 2 * q, &ProcessStats::rssKb), average(samples.size() - q, samples.size(), &ProcessStats::rssKb), 256},
+      {"heap kB", average(q, 2 * q, &ProcessStats::heapBytes) / 1024, average(samples.size() - q, samples.size(), &ProcessStats::heapBytes) / 1024, 64},
+      {"open fds", averageInt(q, 2 * q, &ProcessStats::openFds), averageInt(samples.size() - q, samples.size(), &ProcessStats::openFds), 0.5},
+      {"qobjects", averageInt(q, 2 * q, &ProcessStats::liveObjects), averageInt(samples.size() - q, samples.size(), &ProcessStats::liveObjects), 0.5},
+      {"timers", averageInt(q, 2 * q, &ProcessStats::timers), averageInt(samples.size() - q, samples.size(), &ProcessStats::timers), 0.5},
+  };
+
+  printf("%d cycles in %.1f s, %.0f cycles/s\n", cycles, seconds, cycles / seconds);
+  bool ok = true;
+  for (const Check &c : checks) {
+    const double growth = (c.late - c.early) / span;
+    const bool grows = growth > c.limit;
+    ok = ok && !grows;
+    printf("%-9s %12.1f -> %12.1f  %+9.2f per 1000 cycles (limit %.1f)%s\n", c.name, c.early, c.late, growth, c.limit, grows ? "  GROWING" : "");
+  }
+  printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
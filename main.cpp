@@ -1,22 +1,319 @@
+#include "ActivityDetector.h"
+#include "BandPlacement.h"
+#include "BluetoothAdapter.h"
+#include "CommandChannel.h"
+#include "DataReadyLine.h"
 #include "ESP32SPI.h"
 #include "MiBand3.h"
+#include "SampleBus.h"
+#include "SampleCoalescer.h"
+#include "SampleLogIndex.h"
+#include "SampleLogSink.h"
+#include "SampleQueryService.h"
+#include "SampleRollups.h"
+#include "SampleSegmentSink.h"
+#include "SessionShards.h"
+#include "SharedSampleExport.h"
+#include "TraceRecorder.h"
+#include "TraceReplayer.h"
+#include <QCommandLineParser>
 #include <QDateTime>
-#include <QProcess>
+#include <QElapsedTimer>
 #include <QStringList>
+#include <QSocketNotifier>
 #include <QtCore>
+#include <csignal>
+#include <memory>
+#include <vector>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static int signalFds[2];
+
+// Turns SIGINT/SIGTERM into a clean event loop exit, so destructors run and PGO profiles get written.
+static void installQuitHandler(QCoreApplication *app) {
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, signalFds) < 0) {
+    perror("Could not create signal socket pair");
+    return;
+  }
+  QSocketNotifier *notifier = new QSocketNotifier(signalFds[1], QSocketNotifier::Read, app);
+  QObject::connect(notifier, &QSocketNotifier::activated, app, &QCoreApplication::quit);
+  auto handler = [](int) {
+    char c = 1;
+    (void)::write(signalFds[0], &c, 1);
+  };
+  std::signal(SIGINT, handler);
+  std::signal(SIGTERM, handler);
+}
+
+// ESP32 commands address a band by the first payload byte. Handlers run on the band's
+// thread and post their response back to the channel's.
+static void installBandCommands(CommandChannel *channel, const QVector<MiBand3 *> &bands) {
+  auto band = [bands](const QByteArray &payload) -> MiBand3 * {
+    const int i = payload.isEmpty() ? 0 : static_cast<uchar>(payload[0]);
+    return i < bands.size() ? bands[i] : nullptr;
+  };
+  auto respond = [channel](quint8 id, CommandChannel::Status status, const QByteArray &reply = QByteArray()) {
+    QMetaObject::invokeMethod(channel, [channel, id, status, reply]() { channel->respond(id, status, reply); });
+  };
+  channel->setHandler(CommandChannel::GetLatest, [channel, band, respond](quint8 id, const QByteArray &payload) {
+    MiBand3 *b = band(payload);
+    if (!b)
+      return channel->respond(id, CommandChannel::BadRequest);
+    QMetaObject::invokeMethod(b, [b, id, respond]() {
+      const char reply[] = {static_cast<char>(b->hr()), static_cast<char>(b->steps() >> 8), static_cast<char>(b->steps() & 0xff)};
+      respond(id, CommandChannel::Ok, QByteArray(reply, sizeof(reply)));
+    });
+  });
+  // Payload: band, uint16 big endian seconds.
+  channel->setHandler(CommandChannel::SetMeasureInterval, [channel, band, respond](quint8 id, const QByteArray &payload) {
+    MiBand3 *b = band(payload);
+    const int seconds = payload.size() >= 3 ? qFromBigEndian<quint16>(payload.constData() + 1) : 0;
+    if (!b || seconds < 1)
+      return channel->respond(id, CommandChannel::BadRequest);
+    QMetaObject::invokeMethod(b, [b, id, seconds, respond]() {
+      b->setMeasureInterval(seconds * 1000);
+      respond(id, CommandChannel::Ok);
+    });
+  });
+  // Payload: band, alert level. Answered once the band acknowledged the write, so other
+  // requests usually overtake it. alert() returns a token that alertFinished echoes, so
+  // rule alerts and other writes to the same band are told apart. The token is mapped to
+  // the id before alertFinished can arrive, as both are posted to the channel's thread in
+  // that order. The band fails its tokens on a lost link or a missing ack; an id the
+  // channel expired first is dropped, so a late answer cannot reach a reused id.
+  auto pending = std::make_shared<QHash<MiBand3 *, QHash<quint32, quint8>>>();
+  for (MiBand3 *b : bands) {
+    QObject::connect(b, &MiBand3::alertFinished, channel, [channel, pending, b](quint32 token, bool ok) {
+      QHash<quint32, quint8> &ids = (*pending)[b];
+      auto it = ids.find(token);
+      if (it == ids.end())
+        return;
+      channel->respond(it.value(), ok ? CommandChannel::Ok : CommandChannel::Failed);
+      ids.erase(it);
+    });
+  }
+  QObject::connect(channel, &CommandChannel::requestExpired, channel, [pending](quint8 id) {
+    for (QHash<quint32, quint8> &ids : *pending) {
+      for (auto it = ids.begin(); it != ids.end();) {
+        if (it.value() == id)
+          it = ids.erase(it);
+        else
+          ++it;
+      }
+    }
+  });
+  channel->setHandler(CommandChannel::Vibrate, [channel, band, pending](quint8 id, const QByteArray &payload) {
+    MiBand3 *b = band(payload);
+    if (!b || payload.size() < 2)
+      return channel->respond(id, CommandChannel::BadRequest);
+    const quint8 level = static_cast<quint8>(payload[1]);
+    QMetaObject::invokeMethod(b, [channel, pending, b, id, level]() {
+      const quint32 token = b->alert(level);
+      QMetaObject::invokeMethod(channel, [channel, pending, b, id, token]() {
+        if (token)
+          (*pending)[b].insert(token, id);
+        else
+          channel->respond(id, CommandChannel::Failed);
+      });
+    });
+  });
+}
 
 int main(int argc, char *argv[]) {
+  QElapsedTimer startup;
+  startup.start();
   QCoreApplication a(argc, argv);
 
-  QProcess::execute("sudo hciconfig", QStringList{"hci0", "reset"});
+  QCommandLineParser parser;
+  parser.addHelpOption();
+  QCommandLineOption logOption("log", "Append every sample to <file>.", "file");
+  parser.addOption(logOption);
+  QCommandLineOption recordOption("record", "Record every characteristic event to the trace <file>.", "file");
+  parser.addOption(recordOption);
+  QCommandLineOption replayOption("replay", "Replay the trace <file> instead of connecting to a band, then quit.", "file");
+  parser.addOption(replayOption);
+  QCommandLineOption speedOption("replay-speed", "Replay speed factor, 0 replays as fast as possible.", "factor", "1");
+  parser.addOption(speedOption);
+  QCommandLineOption checkAllocationsOption("check-allocations", "With --replay, fail if steady-state notifications allocate.");
+  parser.addOption(checkAllocationsOption);
+  QCommandLineOption bandsOption("bands", "Number of bands to serve at once.", "count", "1");
+  parser.addOption(bandsOption);
+  QCommandLineOption linksOption("links-per-adapter", "Concurrent band links per local adapter.", "count", "4");
+  parser.addOption(linksOption);
+  QCommandLineOption rawSensorOption("raw-sensor", "Stream raw accelerometer and PPG data from the bands.");
+  parser.addOption(rawSensorOption);
+  QCommandLineOption spiCalibrateOption("spi-calibrate", "Probe the fastest reliable SPI clock at startup (needs firmware with probe echo).");
+  parser.addOption(spiCalibrateOption);
+  QCommandLineOption commandsOption("esp32-commands", "Serve ESP32 requests, polling the SPI link every <ms>, 0 for data-ready only (needs firmware with command frames).", "ms");
+  parser.addOption(commandsOption);
+  QCommandLineOption dataReadyOption("data-ready", "Clock out ESP32 replies when it raises this GPIO line.", "gpiochipN:line");
+  parser.addOption(dataReadyOption);
+  QCommandLineOption threadsOption("band-threads", "Run band sessions on this many worker threads, 0 keeps them on the main thread.", "count", "0");
+  parser.addOption(threadsOption);
+  QCommandLineOption rollupsOption("rollups", "Keep 1 min to 1 day HR/step rollups in this directory.", "directory");
+  parser.addOption(rollupsOption);
+  QCommandLineOption querySocketOption("query-socket", "Answer range, point and rollup queries on this Unix socket (ranges need --log).", "path");
+  parser.addOption(querySocketOption);
+  QCommandLineOption segmentsOption("segments", "Store samples as compressed segments in this directory, sealed every 6 h. Blocks of 1024 samples are written as they fill, so a crash loses at most the last 1024.", "directory");
+  parser.addOption(segmentsOption);
+  QCommandLineOption adaptiveHrOption("adaptive-hr", "Drop to periodic or suspended HR measurement when still, asleep or off-wrist.");
+  parser.addOption(adaptiveHrOption);
+  QCommandLineOption hrAlertsOption("hr-alerts", "Vibrate the band when HR rules fire, e.g. \"above=150!,below=40@30s,rise=30@10s\".", "rules");
+  parser.addOption(hrAlertsOption);
+  parser.process(a);
+  installQuitHandler(&a);
+
+  HrAlertRules alertRules;
+  QString alertRulesError;
+  if (parser.isSet(hrAlertsOption) && !alertRules.parse(parser.value(hrAlertsOption), &alertRulesError)) {
+    qCritical() << "Invalid --hr-alerts rule" << alertRulesError;
+    return 1;
+  }
 
-  MiBand3 *miBand3 = new MiBand3(&a);
-  QObject::connect(miBand3, SIGNAL(finished()), &a, SLOT(quit()));
-  QTimer::singleShot(0, miBand3, SLOT(startSearch()));
+  // Band 0 also feeds the ESP32 and is the one traces are recorded from and replayed into.
+  // Replay drives band 0 from this thread, so it keeps every band here.
+  const int bandThreads = parser.isSet(replayOption) ? 0 : qBound(0, parser.value(threadsOption).toInt(), 64);
+  QVector<MiBand3 *> bands;
+  for (int i = 0; i < qBound(1, parser.value(bandsOption).toInt(), 255); ++i) {
+    MiBand3 *band = new MiBand3(bandThreads ? nullptr : &a);
+    QObject::connect(band, SIGNAL(finished()), &a, SLOT(quit()));
+    band->setRawSensorEnabled(parser.isSet(rawSensorOption));
+    band->setAdaptiveSampling(parser.isSet(adaptiveHrOption));
+    band->setAlertRules(alertRules);
+    bands.append(band);
+  }
+  MiBand3 *miBand3 = bands.first();
+
+  std::vector<std::unique_ptr<ActivityDetector>> detectors;
+  if (parser.isSet(rawSensorOption)) {
+    qDebug() << "Activity detection uses" << ActivityDetector::simdPath() << "kernels.";
+    for (int i = 0; i < bands.size(); ++i) {
+      detectors.emplace_back(new ActivityDetector);
+      ActivityDetector *detector = detectors.back().get();
+      MiBand3 *band = bands[i];
+      QObject::connect(band, &MiBand3::rawSensorDataAvailable, band, [band, detector, i]() {
+        RawSensorStream::AccelSample samples[ActivityDetector::BlockSize];
+        const ActivityDetector::Activity before = detector->activity();
+        while (int n = band->rawSensorStream().readAccel(samples, ActivityDetector::BlockSize))
+          detector->process(&samples[0].x, n);
+        if (detector->activity() != ActivityDetector::Still)
+          band->noteMotion();
+        if (detector->activity() != before)
+          qDebug() << "Band" << i << "is" << ActivityDetector::activityName(detector->activity()) << "at" << detector->cadence() << "steps/min,"
+                   << detector->steps() << "steps";
+      });
+    }
+  }
+
+  TraceRecorder recorder;
+  if (parser.isSet(recordOption) && recorder.open(parser.value(recordOption)))
+    miBand3->setTraceRecorder(&recorder);
+
+  if (parser.isSet(replayOption)) {
+    TraceReplayer *replayer = new TraceReplayer(miBand3, &a);
+    if (!replayer->load(parser.value(replayOption)))
+      return 1;
+    replayer->setSpeed(parser.value(speedOption).toDouble());
+    replayer->setCheckAllocations(parser.isSet(checkAllocationsOption));
+    QObject::connect(
+        replayer, &TraceReplayer::finished, &a, [&a, replayer]() { a.exit(replayer->steadyStateAllocations() ? 1 : 0); }, Qt::QueuedConnection);
+    QTimer::singleShot(0, replayer, &TraceReplayer::start);
+  } else {
+    // Power cycles run while the rest is set up; scanning starts once every adapter is back.
+    BandPlacement *placement = new BandPlacement(&a);
+    for (MiBand3 *band : bands)
+      band->setPlacement(placement);
+    const QStringList adapterNames = BluetoothAdapter::adapterNames();
+    const int maxLinks = qMax(1, parser.value(linksOption).toInt());
+    auto pendingAdapters = std::make_shared<int>(adapterNames.size());
+    for (const QString &name : adapterNames) {
+      BluetoothAdapter *adapter = new BluetoothAdapter(name, &a);
+      QObject::connect(adapter, &BluetoothAdapter::poweredChanged, placement, &BandPlacement::setAdapterUp);
+      QObject::connect(adapter, &BluetoothAdapter::ready, placement, [adapter, placement, maxLinks, pendingAdapters, bands, &startup]() {
+        if (!adapter->address().isEmpty())
+          placement->addAdapter(adapter->address(), maxLinks);
+        if (--*pendingAdapters > 0)
+          return;
+        qDebug() << "Time to first scan:" << startup.elapsed() << "ms";
+        for (MiBand3 *band : bands)
+          QMetaObject::invokeMethod(band, &MiBand3::startSearch);
+      });
+      adapter->powerCycle();
+    }
+  }
+
+  SampleBus *bus = new SampleBus(1024, &a);
+  if (bandThreads) {
+    SessionShards *shards = new SessionShards(bandThreads, bus, &a);
+    // Sessions use the detectors and the recorder, which go out of scope after exec().
+    QObject::connect(&a, &QCoreApplication::aboutToQuit, shards, &SessionShards::stop);
+    for (int i = 0; i < bands.size(); ++i) {
+      const int shard = shards->adopt(bands[i]);
+      QObject::connect(bands[i], &MiBand3::dataChanged, bands[i], [shards, shard, i](uint8_t hr, uint16_t steps) {
+        shards->publish(shard, SampleBus::Sample{QDateTime::currentMSecsSinceEpoch(), SampleBus::SampleType::HeartRate, static_cast<uint8_t>(i), hr, steps});
+      });
+    }
+    qDebug() << "Band sessions run on" << shards->threadCount() << "threads.";
+  } else {
+    for (int i = 0; i < bands.size(); ++i)
+      QObject::connect(bands[i], &MiBand3::dataChanged, bus, [bus, i](uint8_t hr, uint16_t steps) { bus->publishFromBand(static_cast<uint8_t>(i), hr, steps); });
+  }
+  bool firstSample = true;
+  QObject::connect(bus, &SampleBus::samplesAvailable, [&firstSample, &startup]() {
+    if (firstSample) {
+      firstSample = false;
+      qDebug() << "Time to first sample:" << startup.elapsed() << "ms";
+    }
+  });
 
   ESP32SPI *esp32 = new ESP32SPI(&a);
-  QObject::connect(esp32, SIGNAL(timeReceived(QDateTime)), miBand3, SLOT(setTime(QDateTime)));
-  QObject::connect(miBand3, SIGNAL(dataChanged(uint8_t, uint16_t)), esp32, SLOT(sendData(uint8_t, uint16_t)));
+  if (parser.isSet(spiCalibrateOption))
+    QTimer::singleShot(0, esp32, &ESP32SPI::calibrate);
+  for (MiBand3 *band : bands)
+    QObject::connect(esp32, SIGNAL(timeReceived(QDateTime)), band, SLOT(setTime(QDateTime)));
+  if (parser.isSet(commandsOption)) {
+    CommandChannel *commands = new CommandChannel(&a);
+    installBandCommands(commands, bands);
+    esp32->setCommandChannel(commands, qMax(0, parser.value(commandsOption).toInt()));
+  }
+  if (parser.isSet(dataReadyOption)) {
+    const QStringList line = parser.value(dataReadyOption).split(':');
+    DataReadyLine *dataReady = new DataReadyLine(line.first(), line.value(1).toInt(), esp32);
+    if (dataReady->isValid())
+      esp32->setDataReadyLine(dataReady);
+  }
+
+  SampleCoalescer *coalescer = new SampleCoalescer(&a);
+  if (parser.isSet(checkAllocationsOption)) {
+    // Run every sample through to sendData() inside the checked call.
+    bus->setSynchronous(true);
+    coalescer->setMinInterval(0);
+  }
+  const int spiSink = bus->subscribe(SampleBus::DropOldest);
+  QObject::connect(bus, &SampleBus::samplesAvailable, coalescer, [bus, coalescer, spiSink]() {
+    SampleBus::Sample s;
+    while (bus->read(spiSink, s)) {
+      if (s.band == 0)
+        coalescer->push(s.hr, s.steps);
+    }
+  });
+  QObject::connect(coalescer, SIGNAL(dataChanged(uint8_t, uint16_t)), esp32, SLOT(sendData(uint8_t, uint16_t)));
+
+  new SharedSampleExport(bus, SharedSampleDefaultName, &a);
+  if (parser.isSet(logOption))
+    new SampleLogSink(bus, parser.value(logOption), &a);
+  if (parser.isSet(segmentsOption))
+    new SampleSegmentSink(bus, parser.value(segmentsOption), 6 * 3600 * 1000, &a);
+  SampleRollups *rollups = parser.isSet(rollupsOption) ? new SampleRollups(bus, parser.value(rollupsOption), &a) : nullptr;
+  std::unique_ptr<SampleLogIndex> logIndex;
+  if (parser.isSet(querySocketOption)) {
+    if (parser.isSet(logOption)) {
+      logIndex.reset(new SampleLogIndex(parser.value(logOption)));
+      logIndex->update();
+    }
+    new SampleQueryService(parser.value(querySocketOption), logIndex.get(), rollups, &a);
+  }
 
   //  QTimer *timer = new QTimer(&a);
   //  timer->start(5000);
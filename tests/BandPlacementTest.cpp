@@ -0,0 +1,134 @@
+#include "BandPlacement.h"
+#include <QSignalSpy>
+#include <QtTest>
+#include <memory>
+
+// Stands in for BluetoothAdapter: reports power changes the way BlueZ would, wired to the
+// placement like the daemon does.
+class FakeAdapter : public QObject {
+  Q_OBJECT
+public:
+  FakeAdapter(const QString &address, BandPlacement *placement) : m_address(address) {
+    connect(this, &FakeAdapter::poweredChanged, placement, &BandPlacement::setAdapterUp);
+  }
+  void setPowered(bool powered) { emit poweredChanged(m_address, powered); }
+
+signals:
+  void poweredChanged(const QString &address, bool powered);
+
+private:
+  QString m_address;
+};
+
+class BandPlacementTest : public QObject {
+  Q_OBJECT
+private slots:
+  void spreadsByRelativeLoad();
+  void keepsSessionOnItsAdapter();
+  void claimsEachBandOnce();
+  void movesSessionsWhenAdapterGoesDown();
+  void reportsNoAdapterWhenAllAreFull();
+  void releasesDestroyedSessions();
+};
+
+void BandPlacementTest::spreadsByRelativeLoad() {
+  BandPlacement placement;
+  placement.addAdapter("A", 2);
+  placement.addAdapter("B", 4);
+  QObject sessions[6];
+  for (QObject &session : sessions)
+    QVERIFY(!placement.acquire(&session).isEmpty());
+  QCOMPARE(placement.load("A"), 2);
+  QCOMPARE(placement.load("B"), 4);
+  QObject extra;
+  QVERIFY(placement.acquire(&extra).isEmpty());
+}
+
+void BandPlacementTest::keepsSessionOnItsAdapter() {
+  BandPlacement placement;
+  placement.addAdapter("A", 4);
+  placement.addAdapter("B", 4);
+  QObject session;
+  const QString adapter = placement.acquire(&session);
+  QCOMPARE(placement.acquire(&session), adapter);
+  QCOMPARE(placement.adapterOf(&session), adapter);
+  QCOMPARE(placement.load("A") + placement.load("B"), 1);
+}
+
+void BandPlacementTest::claimsEachBandOnce() {
+  BandPlacement placement;
+  QObject first, second;
+  QVERIFY(placement.claimDevice(&first, "C8:0F:10:00:00:01"));
+  QVERIFY(placement.claimDevice(&first, "C8:0F:10:00:00:01"));
+  QVERIFY(!placement.claimDevice(&second, "C8:0F:10:00:00:01"));
+  // Claiming another band drops the previous claim.
+  QVERIFY(placement.claimDevice(&first, "C8:0F:10:00:00:02"));
+  QVERIFY(placement.claimDevice(&second, "C8:0F:10:00:00:01"));
+  placement.releaseDevice(&first);
+  QVERIFY(placement.claimDevice(&second, "C8:0F:10:00:00:02"));
+}
+
+void BandPlacementTest::movesSessionsWhenAdapterGoesDown() {
+  BandPlacement placement;
+  placement.addAdapter("A", 2);
+  placement.addAdapter("B", 2);
+  FakeAdapter a("A", &placement);
+  FakeAdapter b("B", &placement);
+  QObject sessions[2];
+  for (QObject &session : sessions)
+    placement.acquire(&session);
+  QCOMPARE(placement.load("A"), 1);
+  QObject *onA = placement.adapterOf(&sessions[0]) == "A" ? &sessions[0] : &sessions[1];
+
+  QSignalSpy moved(&placement, &BandPlacement::sessionMoved);
+  a.setPowered(false);
+  QCOMPARE(moved.count(), 1);
+  QCOMPARE(moved.at(0).at(0).value<QObject *>(), onA);
+  QCOMPARE(moved.at(0).at(1).toString(), QString("B"));
+  QCOMPARE(placement.load("A"), 0);
+  QCOMPARE(placement.load("B"), 2);
+  QCOMPARE(placement.acquire(onA), QString("B"));
+
+  // Back up, new sessions go to the emptier adapter again; the moved one stays put.
+  a.setPowered(true);
+  QObject late;
+  QCOMPARE(placement.acquire(&late), QString("A"));
+  QCOMPARE(placement.adapterOf(onA), QString("B"));
+}
+
+void BandPlacementTest::reportsNoAdapterWhenAllAreFull() {
+  BandPlacement placement;
+  placement.addAdapter("A", 1);
+  placement.addAdapter("B", 1);
+  FakeAdapter a("A", &placement);
+  QObject first, second;
+  placement.acquire(&first);
+  placement.acquire(&second);
+  QObject *onA = placement.adapterOf(&first) == "A" ? &first : &second;
+
+  QSignalSpy moved(&placement, &BandPlacement::sessionMoved);
+  a.setPowered(false);
+  QCOMPARE(moved.count(), 1);
+  QCOMPARE(moved.at(0).at(0).value<QObject *>(), onA);
+  QVERIFY(moved.at(0).at(1).toString().isEmpty());
+  QVERIFY(placement.adapterOf(onA).isEmpty());
+  // Power changes that are no change do not move anything.
+  a.setPowered(false);
+  QCOMPARE(moved.count(), 1);
+}
+
+void BandPlacementTest::releasesDestroyedSessions() {
+  BandPlacement placement;
+  placement.addAdapter("A", 1);
+  std::unique_ptr<QObject> session(new QObject);
+  QCOMPARE(placement.acquire(session.get()), QString("A"));
+  QVERIFY(placement.claimDevice(session.get(), "C8:0F:10:00:00:01"));
+  session.reset();
+  QCOMPARE(placement.load("A"), 0);
+  QObject next;
+  QCOMPARE(placement.acquire(&next), QString("A"));
+  QVERIFY(placement.claimDevice(&next, "C8:0F:10:00:00:01"));
+}
+
+QTEST_GUILESS_MAIN(BandPlacementTest)
+#include "BandPlacementTest.moc"
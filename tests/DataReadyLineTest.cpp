@@ -0,0 +1,122 @@
+#include "DataReadyLine.h"
+#include <QSignalSpy>
+#include <QtTest>
+#include <ctime>
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <unistd.h>
+
+// The line fed edge records through a pipe: one asserted() per pile of edges, and none lost
+// when an edge lands while the previous one is being served.
+class DataReadyLineTest : public QObject {
+  Q_OBJECT
+private slots:
+  void init();
+  void cleanup();
+  void oneSignalPerBatch();
+  void batchLargerThanReadBuffer();
+  void edgeDuringDrainIsNotLost();
+  void writerGoneStopsWatching();
+
+private:
+  // Writes edges 1 us apart, the first at firstNs, in a single write.
+  bool publish(int edges, qint64 firstNs);
+
+  int m_writeFd = -1;
+  DataReadyLine *m_line = nullptr;
+};
+
+static qint64 monotonicNs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<qint64>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Gives the notifier a few passes at what the pipe holds.
+static void settle() {
+  for (int i = 0; i < 5; ++i)
+    QCoreApplication::processEvents();
+}
+
+bool DataReadyLineTest::publish(int edges, qint64 firstNs) {
+  QVector<gpioevent_data> events(edges);
+  for (int i = 0; i < edges; ++i) {
+    events[i].timestamp = static_cast<__u64>(firstNs + i * 1000);
+    events[i].id = GPIOEVENT_EVENT_RISING_EDGE;
+  }
+  const ssize_t size = edges * static_cast<ssize_t>(sizeof(gpioevent_data));
+  return write(m_writeFd, events.constData(), size) == size;
+}
+
+void DataReadyLineTest::init() {
+  int fds[2];
+  QCOMPARE(pipe2(fds, O_CLOEXEC), 0);
+  m_line = new DataReadyLine(fds[0]);
+  m_writeFd = fds[1];
+  QVERIFY(m_line->isValid());
+  QVERIFY(!m_line->isAsserted());
+}
+
+void DataReadyLineTest::cleanup() {
+  delete m_line;
+  m_line = nullptr;
+  if (m_writeFd >= 0)
+    close(m_writeFd);
+  m_writeFd = -1;
+}
+
+void DataReadyLineTest::oneSignalPerBatch() {
+  QSignalSpy spy(m_line, &DataReadyLine::asserted);
+  const qint64 first = monotonicNs();
+  QVERIFY(publish(3, first));
+  settle();
+  QCOMPARE(spy.count(), 1);
+  // The oldest edge of the pile, already on the monotonic clock.
+  QCOMPARE(spy.at(0).at(0).toLongLong(), first);
+
+  settle();
+  QCOMPARE(spy.count(), 1);
+  QVERIFY(publish(1, first + 1000000));
+  settle();
+  QCOMPARE(spy.count(), 2);
+  QCOMPARE(spy.at(1).at(0).toLongLong(), first + 1000000);
+}
+
+void DataReadyLineTest::batchLargerThanReadBuffer() {
+  QSignalSpy spy(m_line, &DataReadyLine::asserted);
+  const qint64 first = monotonicNs();
+  QVERIFY(publish(40, first));
+  settle();
+  QCOMPARE(spy.count(), 1);
+  QCOMPARE(spy.at(0).at(0).toLongLong(), first);
+}
+
+void DataReadyLineTest::edgeDuringDrainIsNotLost() {
+  QSignalSpy spy(m_line, &DataReadyLine::asserted);
+  const qint64 first = monotonicNs();
+  // The ESP32 raises the line again while the host is still polling for the last edge.
+  int served = 0;
+  connect(m_line, &DataReadyLine::asserted, this, [this, &served, first]() {
+    if (served++ == 0)
+      QVERIFY(publish(2, first + 5000000));
+  });
+  QVERIFY(publish(1, first));
+  settle();
+  QCOMPARE(spy.count(), 2);
+  QCOMPARE(spy.at(0).at(0).toLongLong(), first);
+  QCOMPARE(spy.at(1).at(0).toLongLong(), first + 5000000);
+}
+
+void DataReadyLineTest::writerGoneStopsWatching() {
+  QSignalSpy spy(m_line, &DataReadyLine::asserted);
+  QVERIFY(publish(1, monotonicNs()));
+  close(m_writeFd);
+  m_writeFd = -1;
+  settle();
+  QCOMPARE(spy.count(), 1);
+  settle();
+  QCOMPARE(spy.count(), 1);
+}
+
+QTEST_GUILESS_MAIN(DataReadyLineTest)
+#include "DataReadyLineTest.moc"
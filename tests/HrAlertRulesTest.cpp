@@ -0,0 +1,198 @@
+#include "HrAlertRules.h"
+#include <QtTest>
+
+// Rules fed one sample per second unless a test needs otherwise; evaluate() returns the
+// alert level, 0 when nothing fired.
+class HrAlertRulesTest : public QObject {
+  Q_OBJECT
+private slots:
+  void rejectsBadSpecs();
+  void describesRules();
+  void aboveFiresOnceUntilRearmed();
+  void belowFires();
+  void sustainRestartsOnDip();
+  void riseAndFallLookBackOverWindow();
+  void mostUrgentRuleWins();
+  void ignoresNoContact();
+  void acksAnswerOldestWrite();
+  void lateAckAfterTimeoutIsSwallowed();
+  void lostAckDoesNotSwallowLaterOnes();
+};
+
+static HrAlertRules parsed(const QString &spec) {
+  HrAlertRules rules;
+  QString error;
+  if (!rules.parse(spec, &error))
+    qWarning() << error;
+  return rules;
+}
+
+void HrAlertRulesTest::rejectsBadSpecs() {
+  HrAlertRules rules;
+  QString error;
+  QVERIFY(rules.parse("above=150!, below=40@30s,,rise=30@10s~5", &error));
+  QVERIFY(!rules.isEmpty());
+  QVERIFY(rules.parse(""));
+  QVERIFY(rules.isEmpty());
+  for (const char *spec : {"above", "above=0", "above=256", "over=100", "rise=30", "rise=30@61s", "fall=10@0s", "below=40@86401s"}) {
+    QVERIFY2(!rules.parse(spec, &error), spec);
+    QVERIFY(!error.isEmpty());
+  }
+  QString many;
+  for (int i = 0; i <= HrAlertRules::MaxRules; ++i)
+    many += QString("above=%1,").arg(100 + i);
+  QVERIFY(!rules.parse(many, &error));
+}
+
+void HrAlertRulesTest::describesRules() {
+  HrAlertRules rules = parsed("above=150@10s!,fall=20@5s");
+  QCOMPARE(rules.describe(0), QString("above=150@10s!"));
+  QCOMPARE(rules.describe(1), QString("fall=20@5s"));
+  QCOMPARE(rules.describe(2), QString());
+}
+
+void HrAlertRulesTest::aboveFiresOnceUntilRearmed() {
+  HrAlertRules rules = parsed("above=150");
+  QCOMPARE(rules.evaluate(0, 149), 0);
+  QCOMPARE(rules.evaluate(1000, 150), 1);
+  QCOMPARE(rules.evaluate(2000, 160), 0);
+  // Within the default 3 bpm of hysteresis the rule stays fired.
+  QCOMPARE(rules.evaluate(3000, 147), 0);
+  QCOMPARE(rules.evaluate(4000, 151), 0);
+  QCOMPARE(rules.evaluate(5000, 146), 0);
+  QCOMPARE(rules.evaluate(6000, 150), 1);
+
+  HrAlertRules wide = parsed("above=150~10");
+  QCOMPARE(wide.evaluate(0, 150), 1);
+  QCOMPARE(wide.evaluate(1000, 141), 0);
+  QCOMPARE(wide.evaluate(2000, 150), 0);
+  QCOMPARE(wide.evaluate(3000, 139), 0);
+  QCOMPARE(wide.evaluate(4000, 150), 1);
+}
+
+void HrAlertRulesTest::belowFires() {
+  HrAlertRules rules = parsed("below=40!");
+  QCOMPARE(rules.evaluate(0, 41), 0);
+  QCOMPARE(rules.evaluate(1000, 40), 2);
+  QCOMPARE(rules.evaluate(2000, 38), 0);
+  QCOMPARE(rules.evaluate(3000, 44), 0);
+  QCOMPARE(rules.evaluate(4000, 39), 2);
+}
+
+void HrAlertRulesTest::sustainRestartsOnDip() {
+  HrAlertRules rules = parsed("above=120@10s");
+  QCOMPARE(rules.evaluate(0, 125), 0);
+  QCOMPARE(rules.evaluate(5000, 125), 0);
+  // One sample under the threshold, though within the hysteresis, restarts the duration.
+  QCOMPARE(rules.evaluate(6000, 119), 0);
+  QCOMPARE(rules.evaluate(7000, 125), 0);
+  QCOMPARE(rules.evaluate(12000, 125), 0);
+  QCOMPARE(rules.evaluate(16000, 125), 0);
+  QCOMPARE(rules.evaluate(17000, 125), 1);
+  QCOMPARE(rules.evaluate(30000, 125), 0);
+}
+
+void HrAlertRulesTest::riseAndFallLookBackOverWindow() {
+  HrAlertRules rise = parsed("rise=30@10s");
+  QCOMPARE(rise.evaluate(0, 60), 0);
+  QCOMPARE(rise.evaluate(5000, 80), 0);
+  QCOMPARE(rise.evaluate(9000, 90), 1);
+  QCOMPARE(rise.evaluate(10000, 95), 0);
+  // 60 has left the window; the rise from 95 is 0, well past the hysteresis.
+  QCOMPARE(rise.evaluate(25000, 95), 0);
+  QCOMPARE(rise.evaluate(30000, 130), 1);
+
+  // A slow climb never rises 30 bpm within 10 s.
+  HrAlertRules slow = parsed("rise=30@10s");
+  for (int i = 0; i < 60; ++i)
+    QCOMPARE(slow.evaluate(i * 1000, static_cast<quint8>(60 + i * 2)), 0);
+
+  HrAlertRules fall = parsed("fall=20@5s!");
+  QCOMPARE(fall.evaluate(0, 100), 0);
+  QCOMPARE(fall.evaluate(3000, 81), 0);
+  QCOMPARE(fall.evaluate(4000, 80), 2);
+  QCOMPARE(fall.evaluate(5000, 78), 0);
+}
+
+void HrAlertRulesTest::mostUrgentRuleWins() {
+  HrAlertRules rules = parsed("above=100,above=120!,below=50");
+  int rule = -1;
+  QCOMPARE(rules.evaluate(0, 110, &rule), 1);
+  QCOMPARE(rule, 0);
+  QCOMPARE(rules.evaluate(1000, 125, &rule), 2);
+  QCOMPARE(rule, 1);
+}
+
+void HrAlertRulesTest::ignoresNoContact() {
+  HrAlertRules rules = parsed("below=40,above=120@5s");
+  QCOMPARE(rules.evaluate(0, 0), 0);
+  QCOMPARE(rules.evaluate(1000, 130), 0);
+  // Gaps without contact neither fire below nor interrupt the sustain.
+  QCOMPARE(rules.evaluate(3000, 0), 0);
+  QCOMPARE(rules.evaluate(6000, 130), 1);
+}
+
+// Acks as MiBand3 feeds them, with a 5 s timeout and as much grace for late ones.
+void HrAlertRulesTest::acksAnswerOldestWrite() {
+  AlertAckQueue acks(5000);
+  QCOMPARE(acks.acknowledge(0), 0u);
+  acks.push(1);
+  acks.push(2);
+  QCOMPARE(acks.acknowledge(100), 1u);
+  QCOMPARE(acks.acknowledge(200), 2u);
+  QVERIFY(acks.isEmpty());
+  QCOMPARE(acks.timeOut(300), 0u);
+
+  acks.push(3);
+  acks.push(4);
+  QCOMPARE(acks.clear(), QVector<quint32>({3, 4}));
+  QVERIFY(acks.isEmpty());
+}
+
+void HrAlertRulesTest::lateAckAfterTimeoutIsSwallowed() {
+  AlertAckQueue acks(5000);
+  acks.push(1);
+  acks.push(2);
+  QCOMPARE(acks.timeOut(5000), 1u);
+  // Write 1's ack comes after all, ahead of write 2's.
+  QCOMPARE(acks.acknowledge(6000), 0u);
+  QCOMPARE(acks.acknowledge(6100), 2u);
+  QVERIFY(acks.isEmpty());
+
+  // A timeout followed by a successful alert, the late ack in between.
+  acks.push(3);
+  QCOMPARE(acks.timeOut(20000), 3u);
+  acks.push(4);
+  QCOMPARE(acks.acknowledge(21000), 0u);
+  QCOMPARE(acks.acknowledge(21100), 4u);
+}
+
+void HrAlertRulesTest::lostAckDoesNotSwallowLaterOnes() {
+  AlertAckQueue acks(5000);
+  acks.push(1);
+  QCOMPARE(acks.timeOut(5000), 1u);
+  // Write 1's ack never comes; one for a write after the grace is genuine.
+  acks.push(2);
+  QCOMPARE(acks.acknowledge(10000), 2u);
+  acks.push(3);
+  QCOMPARE(acks.acknowledge(10100), 3u);
+
+  // Nor does a run of timeouts pile up debts: each starts the grace again, none outlives it.
+  for (quint32 token = 4; token < 14; ++token) {
+    acks.push(token);
+    QCOMPARE(acks.timeOut(token * 5000), token);
+  }
+  acks.push(14);
+  QCOMPARE(acks.acknowledge(13 * 5000 + 5000), 14u);
+  QVERIFY(acks.isEmpty());
+
+  // The link dropping forgets late acks too.
+  acks.push(15);
+  QCOMPARE(acks.timeOut(100000), 15u);
+  QVERIFY(acks.clear().isEmpty());
+  acks.push(16);
+  QCOMPARE(acks.acknowledge(100100), 16u);
+}
+
+QTEST_GUILESS_MAIN(HrAlertRulesTest)
+#include "HrAlertRulesTest.moc"
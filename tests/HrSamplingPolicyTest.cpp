@@ -0,0 +1,174 @@
+#include "HrSamplingPolicy.h"
+#include <QtTest>
+
+// Mode changes driven by hand-picked times; minutes of day are noon unless a test is about
+// the night.
+class HrSamplingPolicyTest : public QObject {
+  Q_OBJECT
+private slots:
+  void stillWearerDropsToPeriodic();
+  void motionSwitchesBackAtOnce();
+  void suspendWaitsOutDwell();
+  void offWristNeedsStillness();
+  void wristReturnLeavesSuspended();
+  void intervalsFollowModeAndNight();
+  void nightWindowMayWrapMidnight();
+  void reportSharesAndRates();
+};
+
+static constexpr qint64 Minute = 60 * 1000;
+static constexpr int Noon = 12 * 60;
+static constexpr int Midnight = 0;
+
+// A policy that has just dropped to Periodic at 30 minutes, without any motion.
+static HrSamplingPolicy periodic() {
+  HrSamplingPolicy policy;
+  policy.evaluate(30 * Minute, Noon);
+  return policy;
+}
+
+void HrSamplingPolicyTest::stillWearerDropsToPeriodic() {
+  HrSamplingPolicy policy;
+  QCOMPARE(policy.mode(), HrSamplingPolicy::Continuous);
+  QVERIFY(!policy.evaluate(29 * Minute, Noon));
+  QVERIFY(!policy.noteHr(30 * Minute - 1, 70, Noon));
+  QCOMPARE(policy.mode(), HrSamplingPolicy::Continuous);
+  QVERIFY(policy.noteHr(30 * Minute, 70, Noon));
+  QCOMPARE(policy.mode(), HrSamplingPolicy::Periodic);
+  QVERIFY(!policy.evaluate(31 * Minute, Noon));
+}
+
+void HrSamplingPolicyTest::motionSwitchesBackAtOnce() {
+  HrSamplingPolicy policy = periodic();
+  // Within the dwell of the last change: motion does not wait.
+  QVERIFY(policy.noteMotion(30 * Minute + 1000));
+  QCOMPARE(policy.mode(), HrSamplingPolicy::Continuous);
+  QVERIFY(!policy.noteMotion(31 * Minute));
+
+  // Stillness counts from the last motion, not from the change.
+  QVERIFY(!policy.evaluate(60 * Minute, Noon));
+  QVERIFY(!policy.noteMotion(60 * Minute));
+  QVERIFY(!policy.evaluate(90 * Minute - 1, Noon));
+  QVERIFY(policy.evaluate(90 * Minute, Noon));
+  QCOMPARE(policy.mode(), HrSamplingPolicy::Periodic);
+}
+
+void HrSamplingPolicyTest::suspendWaitsOutDwell() {
+  HrSamplingPolicy policy = periodic();
+  // Off-wrist readings right after a change leave the mode alone until the dwell is over.
+  QVERIFY(!policy.noteHr(30 * Minute + 10'000, 0, Noon));
+  QVERIFY(!policy.noteHr(30 * Minute + 20'000, 0, Noon));
+  QVERIFY(!policy.noteHr(30 * Minute + 30'000, 0, Noon));
+  QVERIFY(!policy.evaluate(32 * Minute - 1, Noon));
+  QCOMPARE(policy.mode(), HrSamplingPolicy::Periodic);
+  QVERIFY(policy.evaluate(32 * Minute, Noon));
+  QCOMPARE(policy.mode(), HrSamplingPolicy::Suspended);
+
+  // A valid reading in between starts the count again.
+  policy = periodic();
+  policy.noteHr(33 * Minute, 0, Noon);
+  policy.noteHr(34 * Minute, 0, Noon);
+  policy.noteHr(35 * Minute, 72, Noon);
+  QVERIFY(!policy.noteHr(36 * Minute, 0, Noon));
+  QVERIFY(!policy.noteHr(37 * Minute, 0, Noon));
+  QCOMPARE(policy.mode(), HrSamplingPolicy::Periodic);
+  QVERIFY(policy.noteHr(38 * Minute, 0, Noon));
+  QCOMPARE(policy.mode(), HrSamplingPolicy::Suspended);
+}
+
+void HrSamplingPolicyTest::offWristNeedsStillness() {
+  HrSamplingPolicy policy;
+  policy.noteMotion(0);
+  // HR 0 while moving is a bad read, not an empty wrist.
+  for (qint64 t = 3 * Minute; t < 10 * Minute; t += Minute)
+    QVERIFY(!policy.noteHr(t, 0, Noon));
+  QCOMPARE(policy.mode(), HrSamplingPolicy::Continuous);
+  QVERIFY(policy.evaluate(10 * Minute, Noon));
+  QCOMPARE(policy.mode(), HrSamplingPolicy::Suspended);
+
+  // Motion wakes it straight into Continuous and clears the zero run.
+  QVERIFY(policy.noteMotion(10 * Minute + 1000));
+  QCOMPARE(policy.mode(), HrSamplingPolicy::Continuous);
+  QVERIFY(!policy.noteHr(21 * Minute, 0, Noon));
+  QVERIFY(!policy.noteHr(22 * Minute, 0, Noon));
+  QCOMPARE(policy.mode(), HrSamplingPolicy::Continuous);
+}
+
+void HrSamplingPolicyTest::wristReturnLeavesSuspended() {
+  HrSamplingPolicy policy = periodic();
+  for (qint64 t = 33 * Minute; t < 36 * Minute; t += Minute)
+    policy.noteHr(t, 0, Noon);
+  QCOMPARE(policy.mode(), HrSamplingPolicy::Suspended);
+  QVERIFY(!policy.noteHr(36 * Minute, 0, Noon));
+  // The probe finds a pulse: straight to Periodic, without waiting out the dwell.
+  QVERIFY(policy.noteHr(36 * Minute + 1000, 65, Noon));
+  QCOMPARE(policy.mode(), HrSamplingPolicy::Periodic);
+}
+
+void HrSamplingPolicyTest::intervalsFollowModeAndNight() {
+  HrSamplingPolicy policy;
+  policy.setKeepAliveInterval(12'000);
+  QCOMPARE(policy.hrInterval(), 12'000);
+  QCOMPARE(policy.stepPollInterval(), 60'000);
+
+  policy = periodic();
+  QCOMPARE(policy.hrInterval(), 5 * 60'000);
+  QCOMPARE(policy.stepPollInterval(), 5 * 60'000);
+  policy.evaluate(31 * Minute, 23 * 60 + 30);
+  QCOMPARE(policy.hrInterval(), 10 * 60'000);
+  policy.evaluate(32 * Minute, 7 * 60);
+  QCOMPARE(policy.hrInterval(), 5 * 60'000);
+
+  for (qint64 t = 33 * Minute; t < 36 * Minute; t += Minute)
+    policy.noteHr(t, 0, Noon);
+  QCOMPARE(policy.mode(), HrSamplingPolicy::Suspended);
+  QCOMPARE(policy.hrInterval(), 30 * 60'000);
+  QCOMPARE(policy.stepPollInterval(), 15 * 60'000);
+
+  // At night a still wearer counts as still after 15 minutes instead of 30.
+  HrSamplingPolicy night;
+  QVERIFY(!night.evaluate(15 * Minute - 1, Midnight));
+  QVERIFY(night.evaluate(15 * Minute, Midnight));
+  QCOMPARE(night.hrInterval(), 10 * 60'000);
+}
+
+void HrSamplingPolicyTest::nightWindowMayWrapMidnight() {
+  HrSamplingPolicy policy = periodic();
+  policy.setNight(22 * 60, 6 * 60);
+  const int minutes[] = {21 * 60 + 59, 22 * 60, Midnight, 5 * 60 + 59, 6 * 60};
+  const int intervals[] = {5, 10, 10, 10, 5};
+  for (int i = 0; i < 5; ++i) {
+    policy.evaluate(31 * Minute, minutes[i]);
+    QCOMPARE(policy.hrInterval(), intervals[i] * 60'000);
+  }
+
+  policy.setNight(60, 5 * 60);
+  policy.evaluate(31 * Minute, Midnight);
+  QCOMPARE(policy.hrInterval(), 5 * 60'000);
+  policy.evaluate(31 * Minute, 60);
+  QCOMPARE(policy.hrInterval(), 10 * 60'000);
+}
+
+void HrSamplingPolicyTest::reportSharesAndRates() {
+  // Half an hour of Continuous, then half an hour of Periodic.
+  HrSamplingPolicy policy = periodic();
+  for (int i = 0; i < 120; ++i)
+    policy.countWakeup();
+  for (int i = 0; i < 60; ++i)
+    policy.countRadioOp();
+  policy.evaluate(60 * Minute - 1, Noon);
+  // 1800 s of sensor, 6 one-shots of 20 s and 60 radio ops: 1923 mAs in an hour.
+  QTest::ignoreMessage(QtInfoMsg,
+                       "HR sampling: continuous 50%, periodic 50%, suspended 0%, 120 wakeups/h, 60 radio ops/h, ~12.8 mAh/day of the band's 110 mAh");
+  policy.report(60 * Minute);
+
+  // Counters start over; the next hour is all Periodic.
+  QTest::ignoreMessage(QtInfoMsg, "HR sampling: continuous 0%, periodic 100%, suspended 0%, 0 wakeups/h, 0 radio ops/h, ~1.6 mAh/day of the band's 110 mAh");
+  policy.report(120 * Minute);
+
+  // Nothing to report for an empty period.
+  policy.report(120 * Minute);
+}
+
+QTEST_GUILESS_MAIN(HrSamplingPolicyTest)
+#include "HrSamplingPolicyTest.moc"
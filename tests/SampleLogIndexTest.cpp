@@ -0,0 +1,211 @@
+#include "SampleLogIndex.h"
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <QtTest>
+
+// Range reads around the index's stride boundaries checked against a full scan, and saved
+// sidecars that no longer match their log.
+class SampleLogIndexTest : public QObject {
+  Q_OBJECT
+private slots:
+  void initTestCase();
+  void rangesMatchFullScanAtStrideBoundaries();
+  void seekNeverSkipsLaterLines();
+  void sidecarIsReused();
+  void staleSidecarIsRebuilt();
+  void truncatedSidecarIsRebuilt();
+  void shrunkLogIsReindexed();
+
+private:
+  QString logPath() const { return m_dir.filePath(QString::fromLatin1(QTest::currentTestFunction()) + ".log"); }
+
+  QTemporaryDir m_dir;
+};
+
+static const qint64 Start = 1'600'000'000'000LL;
+
+struct Line {
+  qint64 offset;
+  SampleBus::Sample sample;
+};
+
+// Two bands every 500 ms, every 50th pair written in the wrong order as concurrent sessions
+// do. Line lengths vary with the HR so entries do not land on a fixed pattern.
+static QVector<Line> writeLog(const QString &path, int count, qint64 start = Start) {
+  QVector<Line> lines;
+  QFile f(path);
+  if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    return lines;
+  for (int i = 0; i < count; ++i) {
+    const int order = i % 50 == 0 && i + 1 < count ? i + 1 : i % 50 == 1 ? i - 1 : i;
+    const SampleBus::Sample s{start + order * 500LL, SampleBus::SampleType::HeartRate, static_cast<uint8_t>(i % 2), static_cast<uint8_t>(60 + i % 90),
+                              static_cast<uint16_t>(i)};
+    lines.append(Line{f.pos(), s});
+    f.write(QByteArray::number(s.timestamp) + ';' + QByteArray::number(s.band) + ';' + QByteArray::number(s.hr) + ';' + QByteArray::number(s.steps) + '\n');
+  }
+  return lines;
+}
+
+// The lines the index should pick: the first in every Stride bytes.
+static QVector<Line> strideLines(const QVector<Line> &lines) {
+  QVector<Line> entries;
+  for (const Line &l : lines) {
+    if (entries.isEmpty() || l.offset - entries.last().offset >= SampleLogIndex::Stride)
+      entries.append(l);
+  }
+  return entries;
+}
+
+static QVector<SampleBus::Sample> scan(const QVector<Line> &lines, qint64 from, qint64 to, int band) {
+  QVector<SampleBus::Sample> samples;
+  for (const Line &l : lines) {
+    if (l.sample.timestamp >= from && l.sample.timestamp < to && (band < 0 || l.sample.band == band))
+      samples.append(l.sample);
+  }
+  return samples;
+}
+
+static QVector<SampleBus::Sample> read(const SampleLogIndex &index, qint64 from, qint64 to, int band) {
+  QVector<SampleBus::Sample> samples;
+  SampleLogIndex::Cursor cursor(index, from, to, band);
+  SampleBus::Sample batch[7];
+  while (int n = cursor.read(batch, 7)) {
+    for (int i = 0; i < n; ++i)
+      samples.append(batch[i]);
+  }
+  return samples;
+}
+
+static void compareRange(const SampleLogIndex &index, const QVector<Line> &lines, qint64 from, qint64 to, int band) {
+  const QVector<SampleBus::Sample> actual = read(index, from, to, band), expected = scan(lines, from, to, band);
+  QCOMPARE(actual.size(), expected.size());
+  for (int i = 0; i < expected.size(); ++i) {
+    QCOMPARE(actual[i].timestamp, expected[i].timestamp);
+    QCOMPARE(actual[i].band, expected[i].band);
+    QCOMPARE(actual[i].hr, expected[i].hr);
+    QCOMPARE(actual[i].steps, expected[i].steps);
+  }
+}
+
+static const qint64 Nudges[] = {-SampleLogIndex::ReorderSlackMs - 1, -SampleLogIndex::ReorderSlackMs, -501, -500, -1, 0, 1, 500, 501, SampleLogIndex::ReorderSlackMs};
+
+void SampleLogIndexTest::initTestCase() {
+  QVERIFY(m_dir.isValid());
+}
+
+void SampleLogIndexTest::rangesMatchFullScanAtStrideBoundaries() {
+  const QVector<Line> lines = writeLog(logPath(), 3000);
+  SampleLogIndex index(logPath());
+  index.update();
+  const QVector<Line> entries = strideLines(lines);
+  QCOMPARE(index.entries(), entries.size());
+  QVERIFY(index.entries() > 10);
+
+  for (const Line &e : entries) {
+    for (qint64 nudge : Nudges) {
+      const qint64 from = e.sample.timestamp + nudge;
+      compareRange(index, lines, from, from + 1, -1);
+      compareRange(index, lines, from, from + 2000, -1);
+      compareRange(index, lines, from, from + 2000, 1);
+      compareRange(index, lines, from - 3000, from, 0);
+    }
+  }
+  compareRange(index, lines, Start - 1, Start + 3000 * 500, -1);
+  compareRange(index, lines, Start + 3000 * 500, Start + 4000 * 500, -1);
+}
+
+void SampleLogIndexTest::seekNeverSkipsLaterLines() {
+  const QVector<Line> lines = writeLog(logPath(), 3000);
+  SampleLogIndex index(logPath());
+  index.update();
+  QCOMPARE(index.seek(Start - 1), qint64(0));
+  QCOMPARE(index.seek(Start), qint64(0));
+
+  for (const Line &e : strideLines(lines)) {
+    for (qint64 nudge : Nudges) {
+      const qint64 t = e.sample.timestamp + nudge;
+      const qint64 offset = index.seek(t);
+      for (const Line &l : lines) {
+        if (l.offset >= offset)
+          break;
+        QVERIFY2(l.sample.timestamp < t, qPrintable(QString("line at %1 skipped seeking %2").arg(l.offset).arg(t)));
+      }
+    }
+  }
+}
+
+void SampleLogIndexTest::sidecarIsReused() {
+  QVector<Line> lines = writeLog(logPath(), 2000);
+  int saved;
+  {
+    SampleLogIndex index(logPath());
+    index.update();
+    saved = index.entries();
+  }
+  SampleLogIndex index(logPath());
+  QCOMPARE(index.entries(), saved);
+
+  // Lines appended since are indexed after the saved entries.
+  lines = writeLog(logPath(), 3000);
+  index.update();
+  QCOMPARE(index.entries(), strideLines(lines).size());
+  QCOMPARE(QFileInfo(logPath() + ".idx").size(), index.entries() * 16LL);
+  compareRange(index, lines, Start + 1500 * 500, Start + 2500 * 500, -1);
+}
+
+void SampleLogIndexTest::staleSidecarIsRebuilt() {
+  writeLog(logPath(), 3000);
+  {
+    SampleLogIndex index(logPath());
+    index.update();
+  }
+  // Same length lines, so the saved offsets still land on line starts, with other times.
+  const QVector<Line> lines = writeLog(logPath(), 3000, Start + 7);
+  SampleLogIndex index(logPath());
+  QCOMPARE(index.entries(), 0);
+  index.update();
+  QCOMPARE(index.entries(), strideLines(lines).size());
+  compareRange(index, lines, Start + 1000 * 500, Start + 1100 * 500, -1);
+}
+
+void SampleLogIndexTest::truncatedSidecarIsRebuilt() {
+  const QVector<Line> lines = writeLog(logPath(), 3000);
+  int saved;
+  {
+    SampleLogIndex index(logPath());
+    index.update();
+    saved = index.entries();
+  }
+
+  // Cut mid entry: appending after the torn bytes would misalign everything after them.
+  QVERIFY(QFile::resize(logPath() + ".idx", saved * 16 - 5));
+  {
+    SampleLogIndex index(logPath());
+    QCOMPARE(index.entries(), 0);
+    index.update();
+    QCOMPARE(index.entries(), saved);
+  }
+  QCOMPARE(QFileInfo(logPath() + ".idx").size(), saved * 16LL);
+
+  // Cut between entries: what is left is still right, the rest is indexed again.
+  QVERIFY(QFile::resize(logPath() + ".idx", 2 * 16));
+  SampleLogIndex index(logPath());
+  QCOMPARE(index.entries(), 2);
+  index.update();
+  QCOMPARE(index.entries(), saved);
+  QCOMPARE(QFileInfo(logPath() + ".idx").size(), saved * 16LL);
+  compareRange(index, lines, Start + 2000 * 500, Start + 2100 * 500, 1);
+}
+
+void SampleLogIndexTest::shrunkLogIsReindexed() {
+  writeLog(logPath(), 3000);
+  SampleLogIndex index(logPath());
+  index.update();
+  const QVector<Line> lines = writeLog(logPath(), 500);
+  index.update();
+  QCOMPARE(index.entries(), strideLines(lines).size());
+  compareRange(index, lines, Start, Start + 500 * 500, -1);
+}
+
+QTEST_GUILESS_MAIN(SampleLogIndexTest)
+#include "SampleLogIndexTest.moc"
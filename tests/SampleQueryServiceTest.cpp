@@ -0,0 +1,214 @@
+#include "SampleQueryService.h"
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QtTest>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Answers read back over a socketpair, with the client reading slowly, pipelining requests
+// and shutting down its write side early.
+class SampleQueryServiceTest : public QObject {
+  Q_OBJECT
+private slots:
+  void initTestCase();
+  void cleanupTestCase();
+  void init();
+  void cleanup();
+  void rangeAnswersEveryRow();
+  void pointAnswersLastSample();
+  void badRequests();
+  void slowReaderGetsWholeRange();
+  void pipelinedRequestsWaitForAnswers();
+  void halfClosedClientGetsAnswers();
+  void overlongLineDropsConnection();
+
+private:
+  QTemporaryDir m_dir;
+  SampleLogIndex *m_index = nullptr;
+  SampleQueryService *m_service = nullptr;
+  int m_client = -1;
+};
+
+static const qint64 Start = 1'600'000'000'000LL;
+// Two bands at 1 Hz, over a megabyte of answer: far more than the socket and the service's
+// output buffer hold.
+static const int Samples = 48'000;
+
+static QByteArray line(int i) {
+  return QByteArray::number(Start + (i / 2) * 1000LL + i % 2) + ';' + QByteArray::number(i % 2) + ';' + QByteArray::number(60 + i % 90) + ';' +
+         QByteArray::number(i % 65536) + '\n';
+}
+
+// What RANGE should answer, END line included.
+static QByteArray expectedRange(int band, qint64 from, qint64 to) {
+  QByteArray answer;
+  int rows = 0;
+  for (int i = 0; i < Samples; ++i) {
+    const qint64 t = Start + (i / 2) * 1000LL + i % 2;
+    if (t >= from && t < to && (band < 0 || i % 2 == band)) {
+      answer.append(line(i));
+      ++rows;
+    }
+  }
+  return answer + "END " + QByteArray::number(rows) + '\n';
+}
+
+static bool sendAll(int fd, const QByteArray &data) {
+  for (int sent = 0; sent < data.size();) {
+    const ssize_t n = send(fd, data.constData() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n < 0 && errno != EAGAIN && errno != EINTR)
+      return false;
+    if (n > 0)
+      sent += static_cast<int>(n);
+    QCoreApplication::processEvents();
+  }
+  return true;
+}
+
+// Runs the service until answers END or ERR lines came back or it closed the connection.
+static QByteArray readAnswers(int fd, int answers, bool *closed = nullptr) {
+  QByteArray data;
+  int scanned = 0;
+  QElapsedTimer timer;
+  timer.start();
+  if (closed)
+    *closed = false;
+  while (answers > 0 && timer.elapsed() < 10'000) {
+    QCoreApplication::processEvents();
+    char buffer[16 * 1024];
+    const ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+      if (closed)
+        *closed = true;
+      break;
+    }
+    if (n < 0)
+      continue;
+    data.append(buffer, static_cast<int>(n));
+    for (int nl; answers > 0 && (nl = data.indexOf('\n', scanned)) >= 0; scanned = nl + 1) {
+      if (data.mid(scanned, 4) == "END " || data.mid(scanned, 4) == "ERR ")
+        --answers;
+    }
+  }
+  return data;
+}
+
+// Reads until the service closes the connection.
+static bool waitForClose(int fd) {
+  bool closed = false;
+  readAnswers(fd, 1, &closed);
+  return closed;
+}
+
+void SampleQueryServiceTest::initTestCase() {
+  QVERIFY(m_dir.isValid());
+  QFile log(m_dir.filePath("samples.log"));
+  QVERIFY(log.open(QIODevice::WriteOnly));
+  for (int i = 0; i < Samples; ++i)
+    log.write(line(i));
+  log.close();
+  m_index = new SampleLogIndex(log.fileName());
+  m_service = new SampleQueryService(m_dir.filePath("query.sock"), m_index, nullptr, this);
+}
+
+void SampleQueryServiceTest::cleanupTestCase() {
+  delete m_service;
+  delete m_index;
+}
+
+void SampleQueryServiceTest::init() {
+  int fds[2];
+  QCOMPARE(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds), 0);
+  // A small send buffer, so answers back up into the service's own.
+  const int size = 4096;
+  setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+  QVERIFY(m_service->adopt(fds[0]));
+  m_client = fds[1];
+  fcntl(m_client, F_SETFL, fcntl(m_client, F_GETFL) | O_NONBLOCK);
+}
+
+void SampleQueryServiceTest::cleanup() {
+  close(m_client);
+  // Lets the service see the hang up and free the connection.
+  for (int i = 0; i < 10; ++i)
+    QCoreApplication::processEvents();
+}
+
+void SampleQueryServiceTest::rangeAnswersEveryRow() {
+  const qint64 from = Start + 1000 * 1000, to = Start + 1100 * 1000;
+  QVERIFY(sendAll(m_client, "RANGE * " + QByteArray::number(from) + ' ' + QByteArray::number(to) + '\n'));
+  QCOMPARE(readAnswers(m_client, 1), expectedRange(-1, from, to));
+  QVERIFY(sendAll(m_client, "RANGE 1 " + QByteArray::number(from) + ' ' + QByteArray::number(to) + '\n'));
+  QCOMPARE(readAnswers(m_client, 1), expectedRange(1, from, to));
+  QVERIFY(sendAll(m_client, "RANGE 0 " + QByteArray::number(to) + ' ' + QByteArray::number(from) + '\n'));
+  QCOMPARE(readAnswers(m_client, 1), QByteArray("END 0\n"));
+}
+
+void SampleQueryServiceTest::pointAnswersLastSample() {
+  // Between samples of band 1: the one before.
+  QVERIFY(sendAll(m_client, "POINT 1 " + QByteArray::number(Start + 5000 * 1000LL + 500) + '\n'));
+  QCOMPARE(readAnswers(m_client, 1), line(2 * 5000 + 1) + "END 1\n");
+  // Exactly on one.
+  QVERIFY(sendAll(m_client, "POINT 0 " + QByteArray::number(Start + 7000 * 1000LL) + '\n'));
+  QCOMPARE(readAnswers(m_client, 1), line(2 * 7000) + "END 1\n");
+  // After the log ends, and before it starts.
+  QVERIFY(sendAll(m_client, "POINT 0 " + QByteArray::number(Start + Samples * 1000LL) + '\n'));
+  QCOMPARE(readAnswers(m_client, 1), line(Samples - 2) + "END 1\n");
+  QVERIFY(sendAll(m_client, "POINT 0 " + QByteArray::number(Start - 1) + '\n'));
+  QCOMPARE(readAnswers(m_client, 1), QByteArray("END 0\n"));
+}
+
+void SampleQueryServiceTest::badRequests() {
+  QVERIFY(sendAll(m_client, "RANGE x 1 2\nLAST 0\nAGG 0 1 2\n\n"));
+  QCOMPARE(readAnswers(m_client, 4), QByteArray("ERR bad request\nERR bad request\nERR no rollups\nERR bad request\n"));
+}
+
+void SampleQueryServiceTest::slowReaderGetsWholeRange() {
+  // The range, then a request queued behind it that must be answered after it, in order.
+  const qint64 end = Start + Samples * 1000LL;
+  QVERIFY(sendAll(m_client, "RANGE * " + QByteArray::number(Start) + ' ' + QByteArray::number(end) + "\nPOINT 1 " + QByteArray::number(end) + '\n'));
+  // Nobody reads for a while; the service must wait, not buffer the lot or give up.
+  for (int i = 0; i < 200; ++i)
+    QCoreApplication::processEvents();
+  bool closed = false;
+  const QByteArray answers = readAnswers(m_client, 2, &closed);
+  QVERIFY(!closed);
+  QCOMPARE(answers, expectedRange(-1, Start, end) + line(Samples - 1) + "END 1\n");
+}
+
+void SampleQueryServiceTest::pipelinedRequestsWaitForAnswers() {
+  // Far more request bytes than the service reads ahead, sent while a range answer is stuck.
+  const qint64 end = Start + Samples * 1000LL;
+  QByteArray requests = "RANGE * " + QByteArray::number(Start) + ' ' + QByteArray::number(end) + '\n';
+  QByteArray expected = expectedRange(-1, Start, end);
+  for (int i = 0; i < 500; ++i) {
+    requests += "POINT 0 " + QByteArray::number(Start + i * 1000LL) + '\n';
+    expected += line(2 * i) + "END 1\n";
+  }
+  QVERIFY(sendAll(m_client, requests));
+  bool closed = false;
+  const QByteArray answers = readAnswers(m_client, 501, &closed);
+  QVERIFY(!closed);
+  QCOMPARE(answers, expected);
+}
+
+void SampleQueryServiceTest::halfClosedClientGetsAnswers() {
+  const qint64 end = Start + Samples * 1000LL;
+  QVERIFY(sendAll(m_client, "RANGE * " + QByteArray::number(Start) + ' ' + QByteArray::number(end) + "\nPOINT 0 " + QByteArray::number(Start) + '\n'));
+  QCOMPARE(shutdown(m_client, SHUT_WR), 0);
+  bool closed = false;
+  QCOMPARE(readAnswers(m_client, 2, &closed), expectedRange(-1, Start, end) + line(0) + "END 1\n");
+  QVERIFY(!closed);
+  // Everything asked for is sent, so now it hangs up.
+  QVERIFY(waitForClose(m_client));
+}
+
+void SampleQueryServiceTest::overlongLineDropsConnection() {
+  QVERIFY(sendAll(m_client, QByteArray(300, 'A')));
+  QVERIFY(waitForClose(m_client));
+}
+
+QTEST_GUILESS_MAIN(SampleQueryServiceTest)
+#include "SampleQueryServiceTest.moc"
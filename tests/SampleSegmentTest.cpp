@@ -0,0 +1,261 @@
+#include "SampleSegment.h"
+#include <QtEndian>
+#include <QtTest>
+#include <random>
+
+// Round trips of the segment codec through its edge cases, and readers fed truncated or
+// corrupt files. Build with -fsanitize=address,undefined to catch bad shifts and reads.
+class SampleSegmentTest : public QObject {
+  Q_OBJECT
+private slots:
+  void gapOverDeltaLimitStartsNewBlock();
+  void deltaOfDeltaBranches();
+  void stepsWrapAtMidnight();
+  void xorWindowReuse();
+  void olderSamplesAreRefused();
+  void closedBlocksPrefixTheSegment();
+  void sealPartialKeepsWholeBlocks();
+  void fullBlocks();
+  void truncatedFileIsRejected();
+  void corruptColumnsDoNotDecode();
+  void randomCorruption();
+};
+
+static const qint64 Start = 1'600'000'000'000LL;
+
+static QByteArray encode(const QVector<SegmentSample> &samples) {
+  SegmentEncoder encoder;
+  for (const SegmentSample &s : samples)
+    encoder.append(s);
+  return encoder.seal();
+}
+
+// Decodes every block of segment; fails the test if it is not accepted.
+static QVector<SegmentSample> decode(const QByteArray &segment, int *blocks = nullptr) {
+  QVector<SegmentSample> samples;
+  SegmentReader reader;
+  if (!reader.setData(reinterpret_cast<const uchar *>(segment.constData()), segment.size()))
+    return samples;
+  SegmentSample out[SegmentEncoder::BlockSamples];
+  for (int b = 0; b < reader.blockCount(); ++b) {
+    const int n = reader.decodeBlock(b, out);
+    for (int i = 0; i < n; ++i)
+      samples.append(out[i]);
+  }
+  if (blocks)
+    *blocks = reader.blockCount();
+  return samples;
+}
+
+static void compareSamples(const QVector<SegmentSample> &actual, const QVector<SegmentSample> &expected) {
+  QCOMPARE(actual.size(), expected.size());
+  for (int i = 0; i < expected.size(); ++i) {
+    QCOMPARE(actual[i].timestamp, expected[i].timestamp);
+    QCOMPARE(actual[i].hr, expected[i].hr);
+    QCOMPARE(actual[i].steps, expected[i].steps);
+    QCOMPARE(actual[i].rr, expected[i].rr);
+  }
+}
+
+static QVector<SegmentSample> fromTimestamps(const QVector<qint64> &timestamps) {
+  QVector<SegmentSample> samples;
+  for (qint64 t : timestamps)
+    samples.append(SegmentSample{t, 0, 0, 70});
+  return samples;
+}
+
+void SampleSegmentTest::gapOverDeltaLimitStartsNewBlock() {
+  // 0x3fffffff still fits the 32-bit delta-of-delta, one more does not.
+  const QVector<SegmentSample> samples = fromTimestamps({Start, Start + 1000, Start + 1000 + 0x3fffffff, Start + 2000 + 0x3fffffff,
+                                                         Start + 2000 + 0x3fffffff + 0x40000000, Start + 3000 + 0x3fffffff + 0x40000000});
+  int blocks = 0;
+  compareSamples(decode(encode(samples), &blocks), samples);
+  QCOMPARE(blocks, 2);
+
+  // A month apart.
+  const QVector<SegmentSample> jumps = fromTimestamps({Start, Start + 1000, Start + 30LL * 86'400'000, Start + 30LL * 86'400'000 + 1000});
+  compareSamples(decode(encode(jumps), &blocks), jumps);
+  QCOMPARE(blocks, 2);
+}
+
+void SampleSegmentTest::deltaOfDeltaBranches() {
+  // Each branch at both ends and one past them, then the 32-bit branch both ways, up to
+  // the widest delta a block takes and back down to 1 ms.
+  QVector<qint64> timestamps{Start, Start + 10000};
+  qint64 delta = 10000;
+  for (qint64 dod : {-63, 64, -64, 65, -255, 256, -256, 257, -2047, 2048, -2048, 2049, 0, 499'000, -499'000, 0x3fffffff - 10006, -(0x3fffffff - 1)}) {
+    delta += dod;
+    timestamps.append(timestamps.last() + delta);
+  }
+  const QVector<SegmentSample> samples = fromTimestamps(timestamps);
+  int blocks = 0;
+  compareSamples(decode(encode(samples), &blocks), samples);
+  QCOMPARE(blocks, 1);
+}
+
+void SampleSegmentTest::stepsWrapAtMidnight() {
+  QVector<SegmentSample> samples;
+  qint64 t = Start;
+  for (quint16 steps : {0, 1, 15, 16, 255, 256, 12000, 0, 5, 65535, 3, 0, 65535, 65535, 40000}) {
+    samples.append(SegmentSample{t, 0, steps, 70});
+    t += 1000;
+  }
+  compareSamples(decode(encode(samples)), samples);
+}
+
+void SampleSegmentTest::xorWindowReuse() {
+  // Narrow changes inside the first window, then ones that need a wider window on
+  // either side, then narrow again inside the wide one.
+  QVector<SegmentSample> samples;
+  qint64 t = Start;
+  const quint8 hr[] = {0x40, 0x48, 0x40, 0x48, 0x7f, 0x7e, 0xfe, 0x7e, 0x7f, 0x01, 0x80, 0x81, 0x00, 0xff, 0xfe, 0x00};
+  const quint16 rr[] = {800, 801, 800, 832, 1023, 1024, 0x8000, 0x8001, 0x0001, 0xffff, 0x7fff, 0, 0, 900, 0x8000, 1};
+  for (int i = 0; i < 16; ++i) {
+    samples.append(SegmentSample{t, rr[i], 0, hr[i]});
+    t += 1000;
+  }
+  compareSamples(decode(encode(samples)), samples);
+}
+
+void SampleSegmentTest::olderSamplesAreRefused() {
+  // The host clock stepping back must not leave blocks out of order for findBlock().
+  SegmentEncoder encoder;
+  QVERIFY(encoder.append(SegmentSample{Start, 0, 0, 70}));
+  QVERIFY(encoder.append(SegmentSample{Start + 1000, 0, 0, 70}));
+  QVERIFY(encoder.append(SegmentSample{Start + 1000, 0, 0, 71}));
+  QVERIFY(!encoder.append(SegmentSample{Start + 500, 0, 0, 72}));
+  QCOMPARE(encoder.size(), 3);
+  QCOMPARE(encoder.lastTimestamp(), Start + 1000);
+  QVector<SegmentSample> kept = fromTimestamps({Start, Start + 1000, Start + 1000});
+  kept[2].hr = 71;
+  compareSamples(decode(encoder.seal()), kept);
+
+  // A sealed encoder starts over and takes any timestamp.
+  QVERIFY(encoder.append(SegmentSample{Start + 500, 0, 0, 72}));
+}
+
+void SampleSegmentTest::closedBlocksPrefixTheSegment() {
+  SegmentEncoder encoder;
+  const QByteArray header = encoder.closedBlocks();
+  QCOMPARE(header.size(), 8);
+  for (int i = 0; i < SegmentEncoder::BlockSamples; ++i)
+    encoder.append(SegmentSample{Start + i * 1000, 0, 0, 70});
+  // The block closes with the first sample that does not fit.
+  QCOMPARE(encoder.closedBlocks(), header);
+  encoder.append(SegmentSample{Start + SegmentEncoder::BlockSamples * 1000, 0, 0, 70});
+  const QByteArray closed = encoder.closedBlocks();
+  QVERIFY(closed.size() > header.size());
+  QVERIFY(encoder.seal().startsWith(closed));
+}
+
+void SampleSegmentTest::sealPartialKeepsWholeBlocks() {
+  QVector<SegmentSample> samples;
+  SegmentEncoder encoder;
+  for (int i = 0; i < 2 * SegmentEncoder::BlockSamples + 100; ++i) {
+    samples.append(SegmentSample{Start + i * 1000, static_cast<quint16>(800 + i % 50), static_cast<quint16>(i / 4), static_cast<quint8>(60 + i % 30)});
+    encoder.append(samples.last());
+  }
+  // What a part file holds after a crash: header and the two closed blocks.
+  const QByteArray part = encoder.closedBlocks();
+  const QVector<SegmentSample> whole = samples.mid(0, 2 * SegmentEncoder::BlockSamples);
+  int blocks = 0;
+  compareSamples(decode(SegmentEncoder::sealPartial(part), &blocks), whole);
+  QCOMPARE(blocks, 2);
+
+  // Torn anywhere in the second block, the first one survives.
+  const QByteArray sealed = SegmentEncoder::sealPartial(part);
+  SegmentReader reader;
+  QVERIFY(reader.setData(reinterpret_cast<const uchar *>(sealed.constData()), sealed.size()));
+  for (int size = static_cast<int>(reader.block(1).offset); size < part.size(); size += 7) {
+    compareSamples(decode(SegmentEncoder::sealPartial(part.left(size)), &blocks), samples.mid(0, SegmentEncoder::BlockSamples));
+    QCOMPARE(blocks, 1);
+  }
+  // A header alone seals to an empty segment, less than that to nothing.
+  QCOMPARE(decode(SegmentEncoder::sealPartial(part.left(8)), &blocks).size(), 0);
+  QCOMPARE(blocks, 0);
+  QVERIFY(SegmentEncoder::sealPartial(part.left(7)).isEmpty());
+  // A corrupt first block is not sealed either.
+  QByteArray corrupt = part;
+  corrupt[8] = static_cast<char>(0xff);
+  decode(SegmentEncoder::sealPartial(corrupt), &blocks);
+  QCOMPARE(blocks, 0);
+}
+
+void SampleSegmentTest::fullBlocks() {
+  std::mt19937 rng(11);
+  QVector<SegmentSample> samples;
+  qint64 t = Start;
+  quint16 steps = 0;
+  for (int i = 0; i < 3 * SegmentEncoder::BlockSamples + 17; ++i) {
+    t += 1000 + static_cast<int>(rng() % 41) - 20;
+    steps += rng() % 3;
+    samples.append(SegmentSample{t, static_cast<quint16>(rng() % 2 ? 700 + rng() % 300 : 0), steps, static_cast<quint8>(50 + rng() % 100)});
+  }
+  int blocks = 0;
+  compareSamples(decode(encode(samples), &blocks), samples);
+  QCOMPARE(blocks, 4);
+}
+
+void SampleSegmentTest::truncatedFileIsRejected() {
+  const QByteArray segment = encode(fromTimestamps({Start, Start + 1000, Start + 2000}));
+  SegmentReader reader;
+  QVERIFY(reader.setData(reinterpret_cast<const uchar *>(segment.constData()), segment.size()));
+  for (int size = 0; size < segment.size(); ++size)
+    QVERIFY(!reader.setData(reinterpret_cast<const uchar *>(segment.constData()), size));
+}
+
+void SampleSegmentTest::corruptColumnsDoNotDecode() {
+  QVector<SegmentSample> samples;
+  for (int i = 0; i < 100; ++i)
+    samples.append(SegmentSample{Start + i * 1000, static_cast<quint16>(800 + i), static_cast<quint16>(i * 3), static_cast<quint8>(60 + i % 30)});
+  const QByteArray segment = encode(samples);
+  SegmentReader reader;
+  QVERIFY(reader.setData(reinterpret_cast<const uchar *>(segment.constData()), segment.size()));
+  const int block = static_cast<int>(reader.block(0).offset);
+  // Block: uint16 count, int64 first timestamp, then the timestamp column and the hr column.
+  const int hrColumn = block + 10 + 4 + static_cast<int>(qFromLittleEndian<quint32>(segment.constData() + block + 10));
+  SegmentSample out[SegmentEncoder::BlockSamples];
+
+  // A window starting at bit 7 and 8 bits long does not fit an 8-bit value.
+  QByteArray badWindow = segment;
+  badWindow[hrColumn + 4] = static_cast<char>(0xff);
+  QVERIFY(reader.setData(reinterpret_cast<const uchar *>(badWindow.constData()), badWindow.size()));
+  QCOMPARE(reader.decodeBlock(0, out), 0);
+
+  // A column length past the end of the blocks.
+  QByteArray badLength = segment;
+  qToLittleEndian<quint32>(0xfffffff0u, reinterpret_cast<uchar *>(badLength.data() + hrColumn));
+  QVERIFY(reader.setData(reinterpret_cast<const uchar *>(badLength.constData()), badLength.size()));
+  QCOMPARE(reader.decodeBlock(0, out), 0);
+
+  // A sample count that disagrees with the index.
+  QByteArray badCount = segment;
+  badCount[block] = static_cast<char>(badCount[block] + 1);
+  QVERIFY(reader.setData(reinterpret_cast<const uchar *>(badCount.constData()), badCount.size()));
+  QCOMPARE(reader.decodeBlock(0, out), 0);
+}
+
+void SampleSegmentTest::randomCorruption() {
+  std::mt19937 rng(5);
+  QVector<SegmentSample> samples;
+  qint64 t = Start;
+  for (int i = 0; i < 300; ++i) {
+    t += 1000 + static_cast<int>(rng() % 3000);
+    samples.append(SegmentSample{t, static_cast<quint16>(rng()), static_cast<quint16>(rng()), static_cast<quint8>(rng())});
+  }
+  const QByteArray segment = encode(samples);
+  SegmentSample out[SegmentEncoder::BlockSamples];
+  for (int round = 0; round < 2000; ++round) {
+    QByteArray corrupt = segment;
+    for (int flips = 1 + rng() % 4; flips > 0; --flips)
+      corrupt[static_cast<int>(rng() % corrupt.size())] = static_cast<char>(rng());
+    SegmentReader reader;
+    if (!reader.setData(reinterpret_cast<const uchar *>(corrupt.constData()), corrupt.size()))
+      continue;
+    for (int b = 0; b < reader.blockCount(); ++b)
+      QVERIFY(reader.decodeBlock(b, out) <= SegmentEncoder::BlockSamples);
+  }
+}
+
+QTEST_GUILESS_MAIN(SampleSegmentTest)
+#include "SampleSegmentTest.moc"
@@ -0,0 +1,537 @@
+#include "aes.hpp"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusMetaType>
+#include <QDBusObjectPath>
+#include <QDBusVariant>
+#include <QDBusVirtualObject>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QRandomGenerator>
+#include <QTimer>
+#include <QVector>
+#include <cstdio>
+#include <functional>
+
+// Stands in for bluetoothd: exports org.bluez with one adapter and a number of emulated
+// Mi Band 3 devices, so the unchanged daemon runs through Qt's BlueZ D-Bus backend with
+// no radio. Run it on a private bus (see tools/fake-bluez.sh) and point both processes
+// at it with DBUS_SYSTEM_BUS_ADDRESS; Qt uses its D-Bus LE controller only when
+// BLUETOOTH_FORCE_DBUS_LE_VERSION is set or bluetoothd is 5.42 or newer.
+//
+// Each band authenticates like the real one (key, challenge, AES-ECB response), streams
+// HR while continuous measurement is on and pinged, answers one-shot measurements and
+// steps reads, and takes alert level writes.
+
+typedef QMap<QString, QVariantMap> InterfaceList;
+typedef QMap<QDBusObjectPath, InterfaceList> ManagedObjectList;
+Q_DECLARE_METATYPE(InterfaceList)
+Q_DECLARE_METATYPE(ManagedObjectList)
+
+static const QString AdapterIface = QStringLiteral("org.bluez.Adapter1");
+static const QString DeviceIface = QStringLiteral("org.bluez.Device1");
+static const QString ServiceIface = QStringLiteral("org.bluez.GattService1");
+static const QString CharIface = QStringLiteral("org.bluez.GattCharacteristic1");
+static const QString DescIface = QStringLiteral("org.bluez.GattDescriptor1");
+static const QString PropertiesIface = QStringLiteral("org.freedesktop.DBus.Properties");
+static const QString ObjectManagerIface = QStringLiteral("org.freedesktop.DBus.ObjectManager");
+
+static const QString HrmUuid = QStringLiteral("00002a37-0000-1000-8000-00805f9b34fb");
+static const QString HrcpUuid = QStringLiteral("00002a39-0000-1000-8000-00805f9b34fb");
+static const QString AuthUuid = QStringLiteral("00000009-0000-3512-2118-0009af100700");
+static const QString StepsUuid = QStringLiteral("00000007-0000-3512-2118-0009af100700");
+static const QString AlertLevelUuid = QStringLiteral("00002a06-0000-1000-8000-00805f9b34fb");
+static const QString CccdUuid = QStringLiteral("00002902-0000-1000-8000-00805f9b34fb");
+
+// A real band stops continuous measurement when the ping stays away this long.
+static constexpr qint64 PingTimeoutMs = 30000;
+static constexpr int OneShotDelayMs = 1500;
+
+class FakeBluez : public QDBusVirtualObject {
+  Q_OBJECT
+public:
+  struct Timing {
+    int advertiseMs = 200;
+    int connectMs = 50;
+    int resolveMs = 100;
+    int notifyMs = 1000;
+  };
+
+  FakeBluez(QDBusConnection connection, int bands, const Timing &timing, QObject *parent = nullptr);
+
+  bool handleMessage(const QDBusMessage &message, const QDBusConnection &connection) override;
+  QString introspect(const QString &path) const override;
+
+public slots:
+  void report();
+
+private:
+  struct Band {
+    QString path;
+    QString hrm, hrcp, auth, steps, alert;
+    bool present = true;
+    bool connected = false;
+    bool continuous = false;
+    QByteArray key;
+    QByteArray challenge;
+    quint8 hr = 70;
+    quint16 stepCount = 0;
+    qint64 lastPing = 0;
+    QTimer *stream = nullptr;
+  };
+
+  QString addService(Band &band, int handle, const QString &uuid);
+  QString addChar(const QString &service, int handle, const QString &uuid, const QStringList &flags, bool notify);
+  Band *bandFor(const QString &path);
+  bool visible(const QString &path) const;
+  void setProperty(const QString &path, const QString &iface, const QString &name, const QVariant &value);
+  void notify(const QString &charPath, const QByteArray &value);
+  void setConnected(Band &band, bool connected);
+  void measure(Band &band);
+  void later(int ms, std::function<void()> f) { QTimer::singleShot(ms, this, f); }
+
+  void handleProperties(const QDBusMessage &message);
+  void handleAdapter(const QDBusMessage &message);
+  void handleDevice(const QDBusMessage &message, Band &band);
+  void handleChar(const QDBusMessage &message, Band &band);
+  void writeChar(Band &band, const QString &path, const QByteArray &value);
+
+  QDBusConnection m_bus;
+  Timing m_timing;
+  QString m_adapter = QStringLiteral("/org/bluez/hci0");
+  QMap<QString, InterfaceList> m_objects;
+  QVector<Band> m_bands;
+  QMap<QString, quint64> m_calls;
+  quint64 m_notifications = 0;
+  QElapsedTimer m_clock;
+  QElapsedTimer m_reportClock;
+};
+
+FakeBluez::FakeBluez(QDBusConnection connection, int bands, const Timing &timing, QObject *parent)
+    : QDBusVirtualObject(parent), m_bus(connection), m_timing(timing) {
+  m_objects[m_adapter][AdapterIface] = QVariantMap{{"Address", "00:1A:7D:DA:71:13"},
+                                                   {"AddressType", "public"},
+                                                   {"Name", "fake"},
+                                                   {"Alias", "fake"},
+                                                   {"Class", 0u},
+                                                   {"Powered", true},
+                                                   {"Discoverable", false},
+                                                   {"Pairable", false},
+                                                   {"Discovering", false},
+                                                   {"UUIDs", QStringList()}};
+
+  m_bands.resize(bands);
+  for (int i = 0; i < bands; ++i) {
+    Band &band = m_bands[i];
+    const QString address = QString("C8:0F:10:00:%1:%2").arg(i / 256, 2, 16, QChar('0')).arg(i % 256, 2, 16, QChar('0')).toUpper();
+    band.path = m_adapter + "/dev_" + QString(address).replace(':', '_');
+    band.hr = 60 + i % 40;
+    m_objects[band.path][DeviceIface] = QVariantMap{
+        {"Address", address},
+        {"AddressType", "random"},
+        {"Name", "Mi Band 3"},
+        {"Alias", "Mi Band 3"},
+        {"Adapter", QVariant::fromValue(QDBusObjectPath(m_adapter))},
+        {"Paired", false},
+        {"Trusted", false},
+        {"Blocked", false},
+        {"LegacyPairing", false},
+        {"Connected", false},
+        {"ServicesResolved", false},
+        {"RSSI", QVariant::fromValue<qint16>(-60)},
+        {"UUIDs", QStringList{"00001802-0000-1000-8000-00805f9b34fb", "0000180d-0000-1000-8000-00805f9b34fb", "0000fee0-0000-1000-8000-00805f9b34fb",
+                              "0000fee1-0000-1000-8000-00805f9b34fb"}}};
+
+    // Handles follow the band's attribute table closely enough for Qt's ordering.
+    const QString alertService = addService(band, 0x0c, "00001802-0000-1000-8000-00805f9b34fb");
+    band.alert = addChar(alertService, 0x0d, AlertLevelUuid, {"write-without-response"}, false);
+    const QString hrService = addService(band, 0x1d, "0000180d-0000-1000-8000-00805f9b34fb");
+    band.hrm = addChar(hrService, 0x1e, HrmUuid, {"notify"}, true);
+    band.hrcp = addChar(hrService, 0x21, HrcpUuid, {"read", "write"}, false);
+    const QString miBand0 = addService(band, 0x23, "0000fee0-0000-1000-8000-00805f9b34fb");
+    addChar(miBand0, 0x24, "00002a2b-0000-1000-8000-00805f9b34fb", {"read", "write"}, false);
+    addChar(miBand0, 0x26, "00000001-0000-3512-2118-0009af100700", {"write-without-response", "write"}, false);
+    addChar(miBand0, 0x28, "00000002-0000-3512-2118-0009af100700", {"notify"}, true);
+    band.steps = addChar(miBand0, 0x2b, StepsUuid, {"read", "notify"}, true);
+    const QString miBand1 = addService(band, 0x50, "0000fee1-0000-1000-8000-00805f9b34fb");
+    band.auth = addChar(miBand1, 0x51, AuthUuid, {"write-without-response", "notify"}, true);
+
+    band.stream = new QTimer(this);
+    connect(band.stream, &QTimer::timeout, this, [this, i]() { measure(m_bands[i]); });
+  }
+  m_clock.start();
+  m_reportClock.start();
+}
+
+QString FakeBluez::addService(Band &band, int handle, const QString &uuid) {
+  const QString path = band.path + QString("/service%1").arg(handle, 4, 16, QChar('0'));
+  m_objects[path][ServiceIface] = QVariantMap{{"UUID", uuid}, {"Primary", true}, {"Device", QVariant::fromValue(QDBusObjectPath(band.path))}};
+  return path;
+}
+
+QString FakeBluez::addChar(const QString &service, int handle, const QString &uuid, const QStringList &flags, bool notify) {
+  const QString path = service + QString("/char%1").arg(handle, 4, 16, QChar('0'));
+  QVariantMap props{{"UUID", uuid}, {"Service", QVariant::fromValue(QDBusObjectPath(service))}, {"Value", QByteArray()}, {"Flags", flags}};
+  if (notify) {
+    props.insert("Notifying", false);
+    const QString desc = path + QString("/desc%1").arg(handle + 2, 4, 16, QChar('0'));
+    m_objects[desc][DescIface] = QVariantMap{{"UUID", CccdUuid}, {"Characteristic", QVariant::fromValue(QDBusObjectPath(path))}, {"Value", QByteArray(2, 0)}};
+  }
+  m_objects[path][CharIface] = props;
+  return path;
+}
+
+FakeBluez::Band *FakeBluez::bandFor(const QString &path) {
+  for (Band &band : m_bands) {
+    if (path == band.path || path.startsWith(band.path + '/'))
+      return &band;
+  }
+  return nullptr;
+}
+
+// Removed devices disappear with their services until the next discovery.
+bool FakeBluez::visible(const QString &path) const {
+  if (!m_objects.contains(path))
+    return false;
+  for (const Band &band : m_bands) {
+    if (path == band.path || path.startsWith(band.path + '/'))
+      return band.present && (path == band.path || band.connected);
+  }
+  return true;
+}
+
+void FakeBluez::setProperty(const QString &path, const QString &iface, const QString &name, const QVariant &value) {
+  m_objects[path][iface][name] = value;
+  if (!visible(path))
+    return;
+  QDBusMessage signal = QDBusMessage::createSignal(path, PropertiesIface, "PropertiesChanged");
+  signal << iface << QVariantMap{{name, value}} << QStringList();
+  m_bus.send(signal);
+}
+
+void FakeBluez::notify(const QString &charPath, const QByteArray &value) {
+  if (!m_objects[charPath][CharIface].value("Notifying").toBool())
+    return;
+  m_notifications++;
+  setProperty(charPath, CharIface, "Value", value);
+}
+
+void FakeBluez::setConnected(Band &band, bool connected) {
+  if (band.connected == connected)
+    return;
+  if (!connected) {
+    band.stream->stop();
+    band.continuous = false;
+    band.key.clear();
+    for (auto it = m_objects.begin(); it != m_objects.end(); ++it) {
+      if (it.key().startsWith(band.path + '/') && it.value().contains(CharIface) && it.value()[CharIface].contains("Notifying"))
+        it.value()[CharIface]["Notifying"] = false;
+    }
+    setProperty(band.path, DeviceIface, "ServicesResolved", false);
+    setProperty(band.path, DeviceIface, "Connected", false);
+  }
+  band.connected = connected;
+  if (connected) {
+    // BlueZ announces the GATT objects once they are resolved.
+    for (auto it = m_objects.constBegin(); it != m_objects.constEnd(); ++it) {
+      if (!it.key().startsWith(band.path + '/'))
+        continue;
+      QDBusMessage signal = QDBusMessage::createSignal("/", ObjectManagerIface, "InterfacesAdded");
+      signal << QVariant::fromValue(QDBusObjectPath(it.key())) << QVariant::fromValue(it.value());
+      m_bus.send(signal);
+    }
+    setProperty(band.path, DeviceIface, "Connected", true);
+  }
+}
+
+void FakeBluez::measure(Band &band) {
+  if (band.continuous && m_clock.elapsed() - band.lastPing > PingTimeoutMs) {
+    qDebug() << band.path << "missed its ping, stopping continuous HR";
+    band.continuous = false;
+    band.stream->stop();
+    return;
+  }
+  // Wanders between 55 and 105 bpm so consumers see changing values.
+  band.hr = qBound(55, band.hr + QRandomGenerator::global()->bounded(-2, 3), 105);
+  QByteArray value(2, 0);
+  value[1] = char(band.hr);
+  notify(band.hrm, value);
+}
+
+bool FakeBluez::handleMessage(const QDBusMessage &message, const QDBusConnection &) {
+  const QString iface = message.interface();
+  m_calls[iface.section('.', -1) + '.' + message.member()]++;
+
+  if (iface == PropertiesIface) {
+    handleProperties(message);
+  } else if (iface == ObjectManagerIface && message.member() == "GetManagedObjects") {
+    ManagedObjectList objects;
+    for (auto it = m_objects.constBegin(); it != m_objects.constEnd(); ++it) {
+      if (visible(it.key()))
+        objects.insert(QDBusObjectPath(it.key()), it.value());
+    }
+    m_bus.send(message.createReply(QVariant::fromValue(objects)));
+  } else if (!visible(message.path())) {
+    m_bus.send(message.createErrorReply("org.freedesktop.DBus.Error.UnknownObject", "No such object " + message.path()));
+  } else if (iface == AdapterIface) {
+    handleAdapter(message);
+  } else if (Band *band = bandFor(message.path())) {
+    if (iface == DeviceIface)
+      handleDevice(message, *band);
+    else
+      handleChar(message, *band);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void FakeBluez::handleProperties(const QDBusMessage &message) {
+  const QList<QVariant> args = message.arguments();
+  const QString path = message.path();
+  const QString iface = args.value(0).toString();
+  if (!visible(path) || !m_objects[path].contains(iface)) {
+    m_bus.send(message.createErrorReply("org.freedesktop.DBus.Error.InvalidArgs", "No such interface " + iface));
+    return;
+  }
+  const QVariantMap &props = m_objects[path][iface];
+  if (message.member() == "GetAll") {
+    m_bus.send(message.createReply(props));
+  } else if (message.member() == "Get" && props.contains(args.value(1).toString())) {
+    m_bus.send(message.createReply(QVariant::fromValue(QDBusVariant(props.value(args.value(1).toString())))));
+  } else if (message.member() == "Set" && props.contains(args.value(1).toString())) {
+    const QString name = args.value(1).toString();
+    const QVariant value = qvariant_cast<QDBusVariant>(args.value(2)).variant();
+    setProperty(path, iface, name, value);
+    if (iface == AdapterIface && name == "Powered" && !value.toBool()) {
+      for (Band &band : m_bands)
+        setConnected(band, false);
+      setProperty(m_adapter, AdapterIface, "Discovering", false);
+    }
+    m_bus.send(message.createReply());
+  } else {
+    m_bus.send(message.createErrorReply("org.freedesktop.DBus.Error.InvalidArgs", "No such property"));
+  }
+}
+
+void FakeBluez::handleAdapter(const QDBusMessage &message) {
+  const QString member = message.member();
+  const bool powered = m_objects[m_adapter][AdapterIface].value("Powered").toBool();
+  if (member == "StartDiscovery") {
+    if (!powered) {
+      m_bus.send(message.createErrorReply("org.bluez.Error.NotReady", "Resource Not Ready"));
+      return;
+    }
+    setProperty(m_adapter, AdapterIface, "Discovering", true);
+    // Advertisements arrive a little after the scan starts.
+    later(m_timing.advertiseMs, [this]() {
+      if (!m_objects[m_adapter][AdapterIface].value("Discovering").toBool())
+        return;
+      for (Band &band : m_bands) {
+        if (band.present) {
+          setProperty(band.path, DeviceIface, "RSSI", QVariant::fromValue<qint16>(-55 - QRandomGenerator::global()->bounded(20)));
+          continue;
+        }
+        band.present = true;
+        QDBusMessage signal = QDBusMessage::createSignal("/", ObjectManagerIface, "InterfacesAdded");
+        signal << QVariant::fromValue(QDBusObjectPath(band.path)) << QVariant::fromValue(m_objects[band.path]);
+        m_bus.send(signal);
+      }
+    });
+  } else if (member == "StopDiscovery") {
+    setProperty(m_adapter, AdapterIface, "Discovering", false);
+  } else if (member == "RemoveDevice") {
+    Band *band = bandFor(qvariant_cast<QDBusObjectPath>(message.arguments().value(0)).path());
+    if (!band || !band->present) {
+      m_bus.send(message.createErrorReply("org.bluez.Error.DoesNotExist", "Does Not Exist"));
+      return;
+    }
+    setConnected(*band, false);
+    band->present = false;
+    QDBusMessage signal = QDBusMessage::createSignal("/", ObjectManagerIface, "InterfacesRemoved");
+    signal << QVariant::fromValue(QDBusObjectPath(band->path)) << QStringList{DeviceIface};
+    m_bus.send(signal);
+  } else if (member != "SetDiscoveryFilter") {
+    m_bus.send(message.createErrorReply("org.freedesktop.DBus.Error.UnknownMethod", "Unknown method " + member));
+    return;
+  }
+  m_bus.send(message.createReply());
+}
+
+void FakeBluez::handleDevice(const QDBusMessage &message, Band &band) {
+  if (message.member() == "Connect") {
+    // Connect returns once the link is up, the services resolve a little later.
+    later(m_timing.connectMs, [this, &band, message]() {
+      setConnected(band, true);
+      m_bus.send(message.createReply());
+      later(m_timing.resolveMs, [this, &band]() {
+        if (band.connected)
+          setProperty(band.path, DeviceIface, "ServicesResolved", true);
+      });
+    });
+  } else if (message.member() == "Disconnect") {
+    setConnected(band, false);
+    m_bus.send(message.createReply());
+  } else {
+    m_bus.send(message.createErrorReply("org.freedesktop.DBus.Error.UnknownMethod", "Unknown method " + message.member()));
+  }
+}
+
+void FakeBluez::handleChar(const QDBusMessage &message, Band &band) {
+  const QString path = message.path();
+  const QString member = message.member();
+  if (!band.connected) {
+    m_bus.send(message.createErrorReply("org.bluez.Error.NotConnected", "Not Connected"));
+    return;
+  }
+  if (message.interface() == DescIface) {
+    // BlueZ keeps the CCCD to itself; clients use StartNotify instead.
+    if (member == "ReadValue")
+      m_bus.send(message.createReply(m_objects[path][DescIface].value("Value")));
+    else
+      m_bus.send(message.createErrorReply("org.bluez.Error.NotPermitted", "Not Permitted"));
+    return;
+  }
+
+  if (member == "ReadValue") {
+    if (path == band.steps) {
+      // Same big-endian count the daemon parses.
+      band.stepCount += QRandomGenerator::global()->bounded(3);
+      const char steps[2] = {char(band.stepCount >> 8), char(band.stepCount)};
+      m_objects[path][CharIface]["Value"] = QByteArray(steps, 2);
+    }
+    m_bus.send(message.createReply(m_objects[path][CharIface].value("Value")));
+  } else if (member == "WriteValue") {
+    m_bus.send(message.createReply());
+    writeChar(band, path, message.arguments().value(0).toByteArray());
+  } else if (member == "StartNotify" || member == "StopNotify") {
+    const bool on = member == "StartNotify";
+    m_bus.send(message.createReply());
+    // The band offers authentication as soon as its auth notifications are enabled.
+    if (on && path == band.auth) {
+      m_objects[path][CharIface]["Notifying"] = true;
+      notify(path, QByteArray::fromHex("0101"));
+    }
+    setProperty(path, CharIface, "Notifying", on);
+  } else {
+    m_bus.send(message.createErrorReply("org.freedesktop.DBus.Error.UnknownMethod", "Unknown method " + member));
+  }
+}
+
+void FakeBluez::writeChar(Band &band, const QString &path, const QByteArray &value) {
+  if (path == band.auth) {
+    if (value.startsWith(QByteArray::fromHex("0100")) && value.size() >= 18) {
+      band.key = value.mid(2, 16);
+      notify(path, QByteArray::fromHex("100101"));
+    } else if (value.startsWith(QByteArray::fromHex("0200")) && !band.key.isEmpty()) {
+      band.challenge.resize(16);
+      for (char &c : band.challenge)
+        c = char(QRandomGenerator::global()->generate());
+      notify(path, QByteArray::fromHex("100201") + band.challenge);
+    } else if (value.startsWith(QByteArray::fromHex("0300")) && value.size() >= 18 && !band.challenge.isEmpty()) {
+      QByteArray expected = band.challenge;
+      struct AES_ctx ctx;
+      AES_init_ctx(&ctx, reinterpret_cast<const uint8_t *>(band.key.constData()));
+      AES_ECB_encrypt(&ctx, reinterpret_cast<uint8_t *>(expected.data()));
+      notify(path, QByteArray::fromHex(value.mid(2, 16) == expected ? "100301" : "100304"));
+    } else {
+      notify(path, QByteArray::fromHex("100104"));
+    }
+  } else if (path == band.hrcp) {
+    if (value == QByteArray::fromHex("150101")) {
+      band.continuous = true;
+      band.lastPing = m_clock.elapsed();
+      band.stream->start(m_timing.notifyMs);
+    } else if (value == QByteArray::fromHex("150100")) {
+      band.continuous = false;
+      band.stream->stop();
+    } else if (value == QByteArray::fromHex("150201")) {
+      later(OneShotDelayMs, [this, &band]() {
+        if (band.connected)
+          measure(band);
+      });
+    } else if (value == QByteArray::fromHex("16")) {
+      band.lastPing = m_clock.elapsed();
+    }
+  } else if (path == band.alert) {
+    qDebug() << band.path << "alert level" << (value.isEmpty() ? 0 : int(value[0]));
+  }
+}
+
+QString FakeBluez::introspect(const QString &path) const {
+  QString xml;
+  for (const QString &iface : m_objects.value(path).keys())
+    xml += QString("<interface name=\"%1\"/>").arg(iface);
+  const QString prefix = path == "/" ? path : path + '/';
+  QStringList children;
+  for (const QString &object : m_objects.keys()) {
+    if (object.startsWith(prefix) && visible(object)) {
+      const QString child = object.mid(prefix.size()).section('/', 0, 0);
+      if (!children.contains(child))
+        children.append(child);
+    }
+  }
+  for (const QString &child : children)
+    xml += QString("<node name=\"%1\"/>").arg(child);
+  return xml;
+}
+
+void FakeBluez::report() {
+  const double seconds = m_reportClock.restart() / 1000.0;
+  if (seconds <= 0)
+    return;
+  QStringList calls;
+  for (auto it = m_calls.constBegin(); it != m_calls.constEnd(); ++it)
+    calls.append(QString("%1=%2").arg(it.key()).arg(it.value()));
+  printf("%.0f notifications/s; calls: %s\n", m_notifications / seconds, qPrintable(calls.join(' ')));
+  fflush(stdout);
+  m_notifications = 0;
+  m_calls.clear();
+}
+
+int main(int argc, char *argv[]) {
+  QCoreApplication a(argc, argv);
+  QCommandLineParser parser;
+  parser.addHelpOption();
+  QCommandLineOption bandsOption("bands", "Emulated bands.", "count", "1");
+  parser.addOption(bandsOption);
+  QCommandLineOption notifyOption("notify-interval", "Continuous HR notification period.", "ms", "1000");
+  parser.addOption(notifyOption);
+  QCommandLineOption advertiseOption("advertise-delay", "Delay from StartDiscovery to the first advertisement.", "ms", "200");
+  parser.addOption(advertiseOption);
+  QCommandLineOption connectOption("connect-delay", "Delay from Device1.Connect to the link being up.", "ms", "50");
+  parser.addOption(connectOption);
+  QCommandLineOption resolveOption("resolve-delay", "Delay from link up to ServicesResolved.", "ms", "100");
+  parser.addOption(resolveOption);
+  QCommandLineOption reportOption("report", "Print notification and call rates every <s>, 0 disables.", "s", "10");
+  parser.addOption(reportOption);
+  parser.process(a);
+
+  qDBusRegisterMetaType<InterfaceList>();
+  qDBusRegisterMetaType<ManagedObjectList>();
+
+  FakeBluez::Timing timing;
+  timing.notifyMs = qMax(1, parser.value(notifyOption).toInt());
+  timing.advertiseMs = parser.value(advertiseOption).toInt();
+  timing.connectMs = parser.value(connectOption).toInt();
+  timing.resolveMs = parser.value(resolveOption).toInt();
+
+  // The system bus, which tools/fake-bluez.sh points at a private dbus-daemon.
+  QDBusConnection bus = QDBusConnection::systemBus();
+  FakeBluez bluez(bus, qBound(1, parser.value(bandsOption).toInt(), 65535), timing);
+  if (!bus.registerVirtualObject("/", &bluez, QDBusConnection::SubPath) || !bus.registerService("org.bluez")) {
+    qCritical() << "Could not claim org.bluez:" << bus.lastError().message();
+    return 1;
+  }
+
+  QTimer reportTimer;
+  QObject::connect(&reportTimer, &QTimer::timeout, &bluez, &FakeBluez::report);
+  if (int seconds = parser.value(reportOption).toInt())
+    reportTimer.start(seconds * 1000);
+  return a.exec();
+}
+
+#include "FakeBluez.moc"
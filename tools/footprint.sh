@@ -0,0 +1,42 @@
+#!/bin/sh
+# Reports binary size, peak RSS and time to first sample for one or more builds of the daemon.
+#   tools/footprint.sh [-t seconds] <build dir>... [-- daemon args]
+# Also used to train PGO: run it against a -DMIBAND3_PGO=GENERATE build with
+#   -- --replay <trace> --replay-speed 0
+# then rebuild with USE.
+set -e
+
+duration=60
+if [ "$1" = "-t" ]; then
+  duration=$2
+  shift 2
+fi
+
+builds=""
+while [ $# -gt 0 ] && [ "$1" != "--" ]; do
+  builds="$builds $1"
+  shift
+done
+[ "$1" = "--" ] && shift
+
+printf "%-32s %10s %10s %12s\n" "build" "size(B)" "rss(kB)" "first(ms)"
+for dir in $builds; do
+  bin="$dir/MiBand3"
+  log=$(mktemp)
+  "$bin" "$@" >"$log" 2>&1 &
+  pid=$!
+  rss=0
+  i=0
+  while [ $i -lt "$duration" ] && kill -0 $pid 2>/dev/null; do
+    hwm=$(awk '/VmHWM/ { print $2 }' /proc/$pid/status 2>/dev/null || echo 0)
+    [ -n "$hwm" ] && [ "$hwm" -gt "$rss" ] && rss=$hwm
+    sleep 1
+    i=$((i + 1))
+  done
+  # SIGINT lets a PGO build write its profile on exit.
+  kill -INT $pid 2>/dev/null || true
+  wait $pid 2>/dev/null || true
+  first=$(sed -n 's/.*Time to first sample: \([0-9]*\) ms.*/\1/p' "$log" | head -n 1)
+  printf "%-32s %10s %10s %12s\n" "$dir" "$(stat -c %s "$bin")" "$rss" "${first:--}"
+  rm -f "$log"
+done